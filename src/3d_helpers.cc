@@ -5,6 +5,7 @@
 
 // third party includes
 #include <raymath.h>
+#include <rlgl.h>
 
 // local includes
 #include "ems.h"
@@ -169,6 +170,82 @@ std::optional<Vector3> ray_to_plane(const Ray &ray, const Ray &plane) {
                  ray.position.z + ray.direction.z * amount};
 }
 
+Frustum get_frustum_from_camera(const Camera3D &camera, float aspect) {
+  Matrix projection;
+  if (camera.projection == CAMERA_PERSPECTIVE) {
+    projection =
+        MatrixPerspective(camera.fovy * DEG2RAD, aspect, RL_CULL_DISTANCE_NEAR,
+                          RL_CULL_DISTANCE_FAR);
+  } else {
+    const float top = camera.fovy / 2.0F;
+    const float right = top * aspect;
+    projection = MatrixOrtho(-right, right, -top, top, RL_CULL_DISTANCE_NEAR,
+                             RL_CULL_DISTANCE_FAR);
+  }
+  const Matrix view =
+      MatrixLookAt(camera.position, camera.target, camera.up);
+  // Clip space is projection * view, m0, m4, m8, m12 is the first row.
+  const Matrix clip = MatrixMultiply(view, projection);
+  const Vector4 row_x{clip.m0, clip.m4, clip.m8, clip.m12};
+  const Vector4 row_y{clip.m1, clip.m5, clip.m9, clip.m13};
+  const Vector4 row_z{clip.m2, clip.m6, clip.m10, clip.m14};
+  const Vector4 row_w{clip.m3, clip.m7, clip.m11, clip.m15};
+
+  Frustum frustum{Vector4Add(row_w, row_x),      Vector4Subtract(row_w, row_x),
+                  Vector4Add(row_w, row_y),      Vector4Subtract(row_w, row_y),
+                  Vector4Add(row_w, row_z),      Vector4Subtract(row_w, row_z)};
+  for (auto &plane : frustum) {
+    const float length =
+        std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    plane.x /= length;
+    plane.y /= length;
+    plane.z /= length;
+    plane.w /= length;
+  }
+
+  return frustum;
+}
+
+FrustumTest test_box_in_frustum(const Frustum &frustum,
+                                const BoundingBox &bb) {
+  FrustumTest result = FrustumTest::INSIDE;
+  for (const auto &plane : frustum) {
+    // Corners furthest along and against the plane's normal.
+    const Vector3 positive{plane.x >= 0.0F ? bb.max.x : bb.min.x,
+                           plane.y >= 0.0F ? bb.max.y : bb.min.y,
+                           plane.z >= 0.0F ? bb.max.z : bb.min.z};
+    const Vector3 negative{plane.x >= 0.0F ? bb.min.x : bb.max.x,
+                           plane.y >= 0.0F ? bb.min.y : bb.max.y,
+                           plane.z >= 0.0F ? bb.min.z : bb.max.z};
+    if (plane.x * positive.x + plane.y * positive.y + plane.z * positive.z +
+            plane.w <
+        0.0F) {
+      return FrustumTest::OUTSIDE;
+    } else if (plane.x * negative.x + plane.y * negative.y +
+                   plane.z * negative.z + plane.w <
+               0.0F) {
+      result = FrustumTest::INTERSECTS;
+    }
+  }
+  return result;
+}
+
+bool is_box_in_frustum(const Frustum &frustum, const BoundingBox &bb) {
+  return test_box_in_frustum(frustum, bb) != FrustumTest::OUTSIDE;
+}
+
+bool is_sphere_in_frustum(const Frustum &frustum, Vector3 center,
+                          float radius) {
+  for (const auto &plane : frustum) {
+    if (plane.x * center.x + plane.y * center.y + plane.z * center.z +
+            plane.w <
+        -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
 Vector3 from_edge_to_sphere_random(Vector3 center, Vector3 point,
                                    float radius) {
   Vector3 to_center = center - point;
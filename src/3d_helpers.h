@@ -28,6 +28,25 @@ extern bool ray_to_xz_plane(const Ray &ray, float &x_out, float &z_out);
 /// plane.direction is plane normal, plane.position is position on plane.
 extern std::optional<Vector3> ray_to_plane(const Ray &ray, const Ray &plane);
 
+/*
+ * Planes of the view frustum as (x, y, z, w) where (x, y, z) is the normal
+ * pointing into the frustum and w the distance, a point p is in front of a
+ * plane if dot(normal, p) + w >= 0.
+ *
+ * Order is left, right, bottom, top, near, far.
+ */
+using Frustum = std::array<Vector4, 6>;
+
+enum class FrustumTest { OUTSIDE, INTERSECTS, INSIDE };
+
+/// Uses the same projection as BeginMode3D() with the given aspect ratio.
+extern Frustum get_frustum_from_camera(const Camera3D &camera, float aspect);
+extern FrustumTest test_box_in_frustum(const Frustum &frustum,
+                                       const BoundingBox &bb);
+extern bool is_box_in_frustum(const Frustum &frustum, const BoundingBox &bb);
+extern bool is_sphere_in_frustum(const Frustum &frustum, Vector3 center,
+                                 float radius);
+
 extern Vector3 from_edge_to_sphere_random(Vector3 center, Vector3 point,
                                           float radius);
 
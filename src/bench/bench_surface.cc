@@ -0,0 +1,265 @@
+// standard library includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+// system includes
+#include <sys/resource.h>
+
+// third party includes
+#include <raylib.h>
+#include <raymath.h>
+
+// local includes
+#include "../flow_field.h"
+#include "../parallel.h"
+#include "../surface.h"
+#include "../surface_triangle.h"
+#include "../walker.h"
+
+/*
+ * Measures the surface's hot paths headlessly and prints the results as JSON
+ * to stdout: generating every chunk, reading every unit's bounding box,
+ * building the reset animation's triangles, moving them for one frame of the
+ * animation, picking with random rays and updating walkers at 60 updates per
+ * second on every thread until each of them roamed. Each is run for every
+ * size, seed and height format below, or only for the world file given as the
+ * argument. Allocations are counted per phase and the peak RSS is that of the
+ * whole run.
+ */
+
+namespace {
+
+constexpr unsigned int BENCH_SIZES[] = {128, 256, 512};
+constexpr unsigned int BENCH_SEEDS[] = {1, 2};
+constexpr SurfaceHeightFormat BENCH_FORMATS[] = {SurfaceHeightFormat::FLOAT32,
+                                                 SurfaceHeightFormat::UNORM16};
+constexpr unsigned int BENCH_RAY_COUNT = 10000;
+constexpr unsigned int BENCH_WALKER_COUNT = 10000;
+// Longer than the longest roaming wait, so that every walker roams.
+constexpr unsigned int BENCH_WALKER_STEPS =
+    (unsigned int)((ROAMING_WAIT_AMOUNT + ROAMING_WAIT_VARIANCE) * 60.0F) + 60;
+
+std::atomic<std::size_t> allocation_count{0};
+std::atomic<std::size_t> allocated_bytes{0};
+
+struct Phase {
+  const char *name;
+  double seconds;
+  std::size_t allocations;
+  std::size_t bytes;
+  /// Units, rays or walker updates processed.
+  std::size_t count;
+  const char *count_name;
+};
+
+/// Runs fn, which returns how many items it processed, and records its time
+/// and allocations.
+template <typename F>
+Phase measure(const char *name, const char *count_name, F fn) {
+  const std::size_t allocations_before = allocation_count;
+  const std::size_t bytes_before = allocated_bytes;
+  const auto start = std::chrono::steady_clock::now();
+  const std::size_t count = fn();
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  return Phase{.name = name,
+               .seconds = seconds,
+               .allocations = allocation_count - allocations_before,
+               .bytes = allocated_bytes - bytes_before,
+               .count = count,
+               .count_name = count_name};
+}
+
+void print_phase(const Phase &phase, bool is_last) {
+  std::cout << "        \"" << phase.name << "\": {\"seconds\": "
+            << phase.seconds << ", \"" << phase.count_name
+            << "\": " << phase.count << ", \"" << phase.count_name
+            << "_per_second\": "
+            << (phase.seconds > 0.0 ? (double)phase.count / phase.seconds : 0.0)
+            << ", \"allocations\": " << phase.allocations
+            << ", \"allocated_bytes\": " << phase.bytes << "}"
+            << (is_last ? "\n" : ",\n");
+}
+
+long get_peak_rss_kb() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/// Runs every phase on the surface and prints them as one run.
+void run_bench(Surface &surface, SurfaceTriangleBatch &shatter_triangles,
+               bool is_first_run) {
+  const unsigned int width = surface.get_width();
+  const unsigned int height = surface.get_height();
+  const unsigned int seed = surface.get_seed();
+  const std::vector<Vector3> center{Vector3{0.0F, 0.0F, 0.0F}};
+
+  const Phase generate = measure("generate", "tiles", [&]() {
+    surface.update_residency(center, (float)std::max(width, height));
+    return surface.size();
+  });
+
+  const Phase bounding_boxes = measure("bounding_boxes", "tiles", [&]() {
+    float sum = 0.0F;
+    for (std::size_t idx = 0; idx < surface.size(); ++idx) {
+      sum += surface.get_bb(idx).max.y;
+    }
+    // Keeps the loop from being optimized away.
+    volatile float sink = sum;
+    (void)sink;
+    return surface.size();
+  });
+
+  const Phase triangles = measure("triangles", "tiles", [&]() {
+    std::minstd_rand engine(seed);
+    shatter_triangles.clear();
+    shatter_triangles.reserve(surface.size() * 2);
+    for (std::size_t idx = 0; idx < surface.size(); ++idx) {
+      append_unit_triangles(
+          shatter_triangles, surface[idx],
+          (float)(idx % width) - surface.get_x_offset(),
+          (float)(idx / width) - surface.get_y_offset(), engine);
+    }
+    return surface.size();
+  });
+
+  // A frame of the reset animation on the CPU.
+  std::vector<float> vertices(shatter_triangles.size() * 9);
+  const Phase shatter = measure("shatter", "triangles", [&]() {
+    get_surface_triangle_vertices(shatter_triangles, 1.0F,
+                                  vertices.data());
+    return shatter_triangles.size();
+  });
+
+  // Rays from above the surface at random angles, like mouse picks from
+  // the camera.
+  std::size_t hit_count = 0;
+  const Phase pick = measure("pick", "rays", [&]() {
+    std::minstd_rand engine(seed);
+    std::uniform_real_distribution<float> x_dist(-(float)width / 2.0F,
+                                                 (float)width / 2.0F);
+    std::uniform_real_distribution<float> z_dist(-(float)height / 2.0F,
+                                                 (float)height / 2.0F);
+    std::uniform_real_distribution<float> direction_dist(-1.0F, 1.0F);
+    for (unsigned int idx = 0; idx < BENCH_RAY_COUNT; ++idx) {
+      const Ray ray{
+          .position = Vector3{x_dist(engine), 20.0F, z_dist(engine)},
+          .direction = Vector3Normalize(
+              Vector3{direction_dist(engine), -1.0F,
+                      direction_dist(engine)})};
+      if (surface.pick(ray).has_value()) {
+        ++hit_count;
+      }
+    }
+    return (std::size_t)BENCH_RAY_COUNT;
+  });
+
+  // Walkers spread evenly over the surface, roaming as in the demo.
+  std::vector<Walker> walkers;
+  walkers.reserve(BENCH_WALKER_COUNT);
+  for (unsigned int idx = 0; idx < BENCH_WALKER_COUNT; ++idx) {
+    walkers.emplace_back(
+        (float)(idx % 100) * (float)width / 100.0F - surface.get_x_offset(),
+        (float)(idx / 100) * (float)height / 100.0F - surface.get_y_offset(),
+        true, seed + idx);
+  }
+  FlowFieldCache flow_fields;
+  const Phase walker_update = measure("walkers", "walker_updates", [&]() {
+    for (unsigned int step = 0; step < BENCH_WALKER_STEPS; ++step) {
+      for (Walker &walker : walkers) {
+        walker.update_roaming(1.0F / 60.0F, surface, flow_fields);
+      }
+      parallel_for(walkers.size(), get_default_thread_count(),
+                   [&](std::size_t begin, std::size_t end) {
+                     for (std::size_t idx = begin; idx < end; ++idx) {
+                       walkers[idx].update(1.0F / 60.0F, surface);
+                     }
+                   });
+    }
+    return (std::size_t)BENCH_WALKER_COUNT * BENCH_WALKER_STEPS;
+  });
+
+  std::cout << (is_first_run ? "" : ",\n") << "    {\n"
+            << "      \"width\": " << width << ",\n"
+            << "      \"height\": " << height << ",\n"
+            << "      \"seed\": " << seed << ",\n"
+            << "      \"format\": \""
+            << (surface.get_height_format() == SurfaceHeightFormat::UNORM16
+                    ? "unorm16"
+                    : "float32")
+            << "\",\n"
+            << "      \"mapped\": " << (surface.is_mapped() ? "true" : "false")
+            << ",\n"
+            << "      \"ray_hits\": " << hit_count << ",\n"
+            << "      \"flow_field_integrations\": "
+            << flow_fields.get_integration_count() << ",\n"
+            << "      \"phases\": {\n";
+  print_phase(generate, false);
+  print_phase(bounding_boxes, false);
+  print_phase(triangles, false);
+  print_phase(shatter, false);
+  print_phase(pick, false);
+  print_phase(walker_update, true);
+  std::cout << "      }\n    }";
+}
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+  ++allocation_count;
+  allocated_bytes += size;
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+int main(int argc, char **argv) {
+  // A world file saved with --save-world, mapped as the demo does.
+  std::optional<Surface> world;
+  if (argc > 1) {
+    world = Surface::load(argv[1], SIZE_MAX);
+    if (!world.has_value()) {
+      std::cerr << "Failed to load world file \"" << argv[1] << "\"\n";
+      return 1;
+    }
+  }
+
+  std::cout.precision(9);
+  std::cout << "{\n  \"benchmark\": \"bench_surface\",\n  \"runs\": [\n";
+  // Reused across runs like the surface reset does.
+  SurfaceTriangleBatch shatter_triangles;
+  if (world.has_value()) {
+    run_bench(world.value(), shatter_triangles, true);
+  } else {
+    bool is_first_run = true;
+    for (const unsigned int size : BENCH_SIZES) {
+      for (const unsigned int seed : BENCH_SEEDS) {
+        for (const SurfaceHeightFormat format : BENCH_FORMATS) {
+          // Everything stays resident, so every phase sees every chunk.
+          Surface surface(size, size, seed, SIZE_MAX, format);
+          run_bench(surface, shatter_triangles, is_first_run);
+          is_first_run = false;
+        }
+      }
+    }
+  }
+  std::cout << "\n  ],\n  \"peak_rss_kb\": " << get_peak_rss_kb() << "\n}\n";
+  return 0;
+}
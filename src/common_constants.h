@@ -4,11 +4,9 @@
 // Forward declaration.
 struct Color;
 
-constexpr unsigned int SURFACE_UNIT_WIDTH = 51;
-constexpr unsigned int SURFACE_UNIT_HEIGHT = 51;
-
-constexpr float SURFACE_X_OFFSET = (float)SURFACE_UNIT_WIDTH / 2.0F - 0.5F;
-constexpr float SURFACE_Y_OFFSET = (float)SURFACE_UNIT_HEIGHT / 2.0F - 0.5F;
+// Size of the surface when none is given, see Surface for the offsets.
+constexpr unsigned int DEFAULT_SURFACE_UNIT_WIDTH = 51;
+constexpr unsigned int DEFAULT_SURFACE_UNIT_HEIGHT = 51;
 
 enum class NeonColor {
   NEON_COLOR_RED = 0,
@@ -148,6 +148,13 @@ void ElectricityEffect::draw(Camera *camera) {
   }
 }
 
+Vector3 ElectricityEffect::get_center() const { return center; }
+
+float ElectricityEffect::get_bounding_radius() const {
+  // End points stay within radius, quads extend by at most their width.
+  return radius + QUAD_MAX_WIDTH;
+}
+
 Shader ElectricityEffect::get_shader() {
   if (!shader.has_value()) {
     init_shader();
@@ -24,6 +24,10 @@ class ElectricityEffect {
   /// Assumes draw mode is active.
   void draw(Camera *camera);
 
+  /// Bounding sphere of the effect.
+  Vector3 get_center() const;
+  float get_bounding_radius() const;
+
   static Shader get_shader();
   static void cleanup_shader();
   static void update_shader_height();
@@ -0,0 +1,221 @@
+#include "flow_field.h"
+
+// standard library includes
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace {
+
+constexpr std::uint8_t FLOW_FIELD_GOAL = 8;
+constexpr std::uint8_t FLOW_FIELD_UNREACHABLE = 9;
+
+// Neighbours by direction, straight ones first.
+constexpr int NEIGHBOR_X[8] = {1, -1, 0, 0, 1, -1, 1, -1};
+constexpr int NEIGHBOR_Y[8] = {0, 0, 1, -1, 1, -1, -1, 1};
+// Direction back to the unit that was reached in each direction.
+constexpr std::uint8_t NEIGHBOR_BACK[8] = {1, 0, 3, 2, 5, 4, 7, 6};
+
+/// Average height of every unit of the window's vertices, row by row. Loads
+/// the window's chunks that aren't resident.
+std::vector<float> get_unit_heights(const Surface &surface,
+                                    const SurfaceRect &window) {
+  const unsigned int window_width = window.x_max - window.x_min + 1;
+  std::vector<float> heights((std::size_t)window_width *
+                             (window.y_max - window.y_min + 1));
+  for (unsigned int y = window.y_min; y <= window.y_max; ++y) {
+    for (unsigned int x = window.x_min; x <= window.x_max; ++x) {
+      const Surface::Chunk &chunk =
+          surface.get_chunk(surface.get_chunk_idx(x, y));
+      const std::size_t vertex_width = chunk.width + 1;
+      const std::size_t nw = (x - chunk.x) + (y - chunk.y) * vertex_width;
+      heights[(x - window.x_min) + (std::size_t)(y - window.y_min) *
+                                       window_width] =
+          (chunk.get_vertex(nw) + chunk.get_vertex(nw + 1) +
+           chunk.get_vertex(nw + vertex_width) +
+           chunk.get_vertex(nw + vertex_width + 1)) /
+          4.0F;
+    }
+  }
+  return heights;
+}
+
+}  // namespace
+
+std::size_t get_flow_field_region(unsigned int width, std::size_t idx) {
+  const unsigned int region_columns =
+      (width + FLOW_FIELD_REGION_SIZE - 1) / FLOW_FIELD_REGION_SIZE;
+  return (idx % width) / FLOW_FIELD_REGION_SIZE +
+         (idx / width) / FLOW_FIELD_REGION_SIZE * region_columns;
+}
+
+SurfaceRect get_flow_field_window(unsigned int width, unsigned int height,
+                                  std::size_t region) {
+  const unsigned int region_columns =
+      (width + FLOW_FIELD_REGION_SIZE - 1) / FLOW_FIELD_REGION_SIZE;
+  const unsigned int x = region % region_columns * FLOW_FIELD_REGION_SIZE;
+  const unsigned int y = region / region_columns * FLOW_FIELD_REGION_SIZE;
+  return SurfaceRect{
+      x > FLOW_FIELD_WINDOW_MARGIN ? x - FLOW_FIELD_WINDOW_MARGIN : 0,
+      y > FLOW_FIELD_WINDOW_MARGIN ? y - FLOW_FIELD_WINDOW_MARGIN : 0,
+      std::min(x + FLOW_FIELD_REGION_SIZE - 1 + FLOW_FIELD_WINDOW_MARGIN,
+               width - 1),
+      std::min(y + FLOW_FIELD_REGION_SIZE - 1 + FLOW_FIELD_WINDOW_MARGIN,
+               height - 1)};
+}
+
+FlowField::FlowField(const Surface &surface, std::size_t region)
+    : directions(),
+      window(get_flow_field_window(surface.get_width(), surface.get_height(),
+                                   region)),
+      region(region),
+      width(surface.get_width()) {
+  // Everything below is in window coordinates.
+  const unsigned int window_width = window.x_max - window.x_min + 1;
+  const unsigned int window_height = window.y_max - window.y_min + 1;
+  const std::size_t window_size = (std::size_t)window_width * window_height;
+  directions.assign(window_size, FLOW_FIELD_UNREACHABLE);
+  const std::vector<float> heights = get_unit_heights(surface, window);
+  std::vector<float> costs(window_size, INFINITY);
+  using QueueEntry = std::pair<float, std::size_t>;
+  std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+                      std::greater<QueueEntry> >
+      queue;
+
+  const unsigned int region_columns =
+      (width + FLOW_FIELD_REGION_SIZE - 1) / FLOW_FIELD_REGION_SIZE;
+  const unsigned int x_min =
+      region % region_columns * FLOW_FIELD_REGION_SIZE - window.x_min;
+  const unsigned int y_min =
+      region / region_columns * FLOW_FIELD_REGION_SIZE - window.y_min;
+  for (unsigned int y = y_min;
+       y < std::min(y_min + FLOW_FIELD_REGION_SIZE, window_height); ++y) {
+    for (unsigned int x = x_min;
+         x < std::min(x_min + FLOW_FIELD_REGION_SIZE, window_width); ++x) {
+      const std::size_t idx = x + (std::size_t)y * window_width;
+      directions[idx] = FLOW_FIELD_GOAL;
+      costs[idx] = 0.0F;
+      queue.emplace(0.0F, idx);
+    }
+  }
+
+  while (!queue.empty()) {
+    const auto [cost, idx] = queue.top();
+    queue.pop();
+    if (cost > costs[idx]) {
+      continue;
+    }
+    const unsigned int x = idx % window_width;
+    const unsigned int y = idx / window_width;
+    for (std::uint8_t dir = 0; dir < 8; ++dir) {
+      const long long nx = (long long)x + NEIGHBOR_X[dir];
+      const long long ny = (long long)y + NEIGHBOR_Y[dir];
+      if (nx < 0 || ny < 0 || nx >= window_width || ny >= window_height) {
+        continue;
+      }
+      const std::size_t next = (std::size_t)nx + (std::size_t)ny * window_width;
+      const float distance = dir < 4 ? 1.0F : std::sqrt(2.0F);
+      const float climb = std::abs(heights[next] - heights[idx]);
+      if (climb > FLOW_FIELD_MAX_SLOPE * distance) {
+        continue;
+      }
+      const float next_cost = cost + distance + FLOW_FIELD_SLOPE_COST * climb;
+      if (next_cost < costs[next]) {
+        costs[next] = next_cost;
+        directions[next] = NEIGHBOR_BACK[dir];
+        queue.emplace(next_cost, next);
+      }
+    }
+  }
+}
+
+std::size_t FlowField::get_region() const { return region; }
+
+const SurfaceRect &FlowField::get_window() const { return window; }
+
+bool FlowField::is_goal(std::size_t idx) const {
+  const std::optional<std::size_t> window_idx = get_window_idx(idx);
+  return window_idx.has_value() &&
+         directions[window_idx.value()] == FLOW_FIELD_GOAL;
+}
+
+std::optional<std::size_t> FlowField::get_next(std::size_t idx) const {
+  const std::optional<std::size_t> window_idx = get_window_idx(idx);
+  if (!window_idx.has_value()) {
+    return std::nullopt;
+  }
+  const std::uint8_t dir = directions[window_idx.value()];
+  if (dir >= 8) {
+    return std::nullopt;
+  }
+  return (std::size_t)((long long)(idx % width) + NEIGHBOR_X[dir]) +
+         (std::size_t)((long long)(idx / width) + NEIGHBOR_Y[dir]) * width;
+}
+
+std::optional<std::size_t> FlowField::get_window_idx(std::size_t idx) const {
+  const unsigned int x = idx % width;
+  const unsigned int y = idx / width;
+  if (x < window.x_min || x > window.x_max || y < window.y_min ||
+      y > window.y_max) {
+    return std::nullopt;
+  }
+  return (x - window.x_min) +
+         (std::size_t)(y - window.y_min) * (window.x_max - window.x_min + 1);
+}
+
+FlowFieldCache::FlowFieldCache()
+    : entries(), generation(0), tick(0), integration_count(0) {}
+
+std::shared_ptr<const FlowField> FlowFieldCache::get(const Surface &surface,
+                                                     std::size_t region) {
+  ++tick;
+  for (Entry &entry : entries) {
+    if (entry.field->get_region() == region) {
+      entry.last_used = tick;
+      return entry.field;
+    }
+  }
+
+  if (entries.size() >= FLOW_FIELD_CACHE_SIZE) {
+    // Walkers still following the dropped field keep it alive.
+    entries.erase(std::min_element(entries.begin(), entries.end(),
+                                   [](const Entry &a, const Entry &b) {
+                                     return a.last_used < b.last_used;
+                                   }));
+  }
+  entries.push_back(
+      Entry{.field = std::make_shared<const FlowField>(surface, region),
+            .last_used = tick});
+  ++integration_count;
+  return entries.back().field;
+}
+
+void FlowFieldCache::clear() {
+  entries.clear();
+  ++generation;
+}
+
+void FlowFieldCache::invalidate(const SurfaceRect &rect) {
+  // Unit (x, y) has the vertices (x, y) to (x + 1, y + 1).
+  const auto size_before = entries.size();
+  std::erase_if(entries, [&rect](const Entry &entry) {
+    const SurfaceRect &window = entry.field->get_window();
+    return window.x_min <= rect.x_max && rect.x_min <= window.x_max + 1 &&
+           window.y_min <= rect.y_max && rect.y_min <= window.y_max + 1;
+  });
+  if (entries.size() != size_before) {
+    ++generation;
+  }
+}
+
+unsigned long long FlowFieldCache::get_generation() const {
+  return generation;
+}
+
+std::size_t FlowFieldCache::size() const { return entries.size(); }
+
+std::size_t FlowFieldCache::get_integration_count() const {
+  return integration_count;
+}
@@ -0,0 +1,110 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_FLOW_FIELD_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_FLOW_FIELD_H_
+
+// standard library includes
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// local includes
+#include "surface.h"
+
+// Goals are regions of FLOW_FIELD_REGION_SIZE x FLOW_FIELD_REGION_SIZE units,
+// all walkers heading into the same region share its field.
+constexpr unsigned int FLOW_FIELD_REGION_SIZE = 16;
+// Stepping between units costs their distance plus FLOW_FIELD_SLOPE_COST times
+// their height difference, steps steeper than FLOW_FIELD_MAX_SLOPE are not
+// taken.
+constexpr float FLOW_FIELD_SLOPE_COST = 4.0F;
+constexpr float FLOW_FIELD_MAX_SLOPE = 1.5F;
+// Fields of this many regions are kept, the least recently used is dropped.
+constexpr std::size_t FLOW_FIELD_CACHE_SIZE = 256;
+// A region's field covers the units within this many units of the region,
+// walkers farther away can't follow it.
+constexpr unsigned int FLOW_FIELD_WINDOW_MARGIN = 64;
+
+/// Region of the unit at idx, indexed the same as Surface::operator[], on a
+/// surface width units wide.
+extern std::size_t get_flow_field_region(unsigned int width, std::size_t idx);
+
+/// Units covered by the field of region, inclusive, on a surface of width x
+/// height units.
+extern SurfaceRect get_flow_field_window(unsigned int width,
+                                         unsigned int height,
+                                         std::size_t region);
+
+/*
+ * Directions from every unit of the region's window to the cheapest way into
+ * the goal region, found by a single Dijkstra pass outwards from the region's
+ * units. Units are connected to their eight neighbours, the height of a unit
+ * is the average of its vertices.
+ *
+ * Units outside the window are blocked. Integrating a field loads the chunks
+ * of its window that aren't resident, so it sees the whole window. Chunks
+ * evicted later are generated again with the same heights and edited ones are
+ * never evicted, so the field stays valid until the surface is deformed.
+ */
+class FlowField {
+ public:
+  /// Loads chunks, so not thread-safe.
+  FlowField(const Surface &surface, std::size_t region);
+
+  std::size_t get_region() const;
+  const SurfaceRect &get_window() const;
+  /// True if the unit at idx is in the goal region.
+  bool is_goal(std::size_t idx) const;
+  /// Neighbour of the unit at idx on the way into the goal region, nullopt if
+  /// the unit is in it or can't reach it.
+  std::optional<std::size_t> get_next(std::size_t idx) const;
+
+ private:
+  /// Index into directions of the unit at idx, nullopt if outside the window.
+  std::optional<std::size_t> get_window_idx(std::size_t idx) const;
+
+  /// Per unit of the window, row by row, the neighbour to go to, or one of the
+  /// values in flow_field.cc for goal and unreachable units.
+  std::vector<std::uint8_t> directions;
+  SurfaceRect window;
+  std::size_t region;
+  unsigned int width;
+};
+
+/*
+ * Flow fields by goal region, integrated the first time a region is asked for.
+ * clear() drops them all once the surface is replaced, invalidate() only those
+ * whose window sees changed vertices. Both start a new generation, so that
+ * walkers holding a field of an older one know to ask for it again.
+ */
+class FlowFieldCache {
+ public:
+  FlowFieldCache();
+
+  /// Not thread-safe since integrating loads chunks, the field itself may be
+  /// read on any thread.
+  std::shared_ptr<const FlowField> get(const Surface &surface,
+                                       std::size_t region);
+  void clear();
+  /// Drops the fields whose units touch the vertices within rect, as returned
+  /// by Surface::deform().
+  void invalidate(const SurfaceRect &rect);
+
+  unsigned long long get_generation() const;
+  std::size_t size() const;
+  /// Fields integrated so far.
+  std::size_t get_integration_count() const;
+
+ private:
+  struct Entry {
+    std::shared_ptr<const FlowField> field;
+    unsigned long long last_used;
+  };
+
+  std::vector<Entry> entries;
+  unsigned long long generation;
+  unsigned long long tick;
+  std::size_t integration_count;
+};
+
+#endif
@@ -7,10 +7,15 @@
 #include <raylib.h>
 #include <raymath.h>
 
-Game::Game()
+Game::Game(std::optional<std::string> world_path, unsigned int surface_width,
+           unsigned int surface_height)
     : screen_stack(ScreenStack::new_instance()),
-      prev_time(std::chrono::steady_clock::now()) {
-  screen_stack->push_constructing_screen<TRunnerScreen>();
+      prev_time(std::chrono::steady_clock::now()),
+      world_path(world_path),
+      surface_width(surface_width),
+      surface_height(surface_height) {
+  screen_stack->push_constructing_screen_args<TRunnerScreen>(
+      surface_width, surface_height, world_path);
 }
 
 void Game::update() {
@@ -27,5 +32,6 @@ void Game::clear_screens() { screen_stack->clear_screens(); }
 
 void Game::clear_and_push_trunner() {
   screen_stack->clear_screens();
-  screen_stack->push_constructing_screen<TRunnerScreen>();
+  screen_stack->push_constructing_screen_args<TRunnerScreen>(
+      surface_width, surface_height, world_path);
 }
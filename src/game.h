@@ -3,13 +3,21 @@
 
 // standard library includes
 #include <chrono>
+#include <optional>
+#include <string>
 
 // local includes
+#include "common_constants.h"
 #include "screen.h"
 
 class Game {
  public:
-  Game();
+  /// The trunner screen plays on the world file at world_path if it can be
+  /// loaded, on a random surface of surface_width x surface_height units
+  /// otherwise.
+  Game(std::optional<std::string> world_path = std::nullopt,
+       unsigned int surface_width = DEFAULT_SURFACE_UNIT_WIDTH,
+       unsigned int surface_height = DEFAULT_SURFACE_UNIT_HEIGHT);
 
   // No copy.
   Game(const Game&) = delete;
@@ -28,6 +36,9 @@ class Game {
  private:
   ScreenStack::Ptr screen_stack;
   std::chrono::steady_clock::time_point prev_time;
+  std::optional<std::string> world_path;
+  unsigned int surface_width;
+  unsigned int surface_height;
 };
 
 #endif
@@ -5,14 +5,22 @@
 
 #include "ems.h"
 #else
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
 #include <random>
+#include <string>
 #endif
 
 // third party includes
 #include <raylib.h>
 
 // local includes
+#include "common_constants.h"
 #include "game.h"
+#include "screen_trunner.h"
+#include "surface.h"
 
 #ifdef __EMSCRIPTEN__
 
@@ -56,7 +64,72 @@ void jumpartifact_demo_update(void *ud) {
   game->draw();
 }
 
-int main() {
+#ifndef __EMSCRIPTEN__
+// Positive number in arg, nullopt if it isn't one.
+std::optional<unsigned int> parse_positive(const char *arg) {
+  char *end = nullptr;
+  const unsigned long value = std::strtoul(arg, &end, 10);
+  if (end == arg || *end != '\0' || value == 0 ||
+      value > std::numeric_limits<unsigned int>::max()) {
+    return std::nullopt;
+  }
+  return (unsigned int)value;
+}
+
+// Generates a surface of width x height units and writes it to path, for use
+// as a world file.
+int save_world(const std::string &path, std::optional<unsigned int> seed,
+               unsigned int width, unsigned int height) {
+  Surface surface(width, height,
+                  seed.has_value() ? seed.value() : std::random_device()(),
+                  SURFACE_DEFAULT_MEMORY_BUDGET, SURFACE_HEIGHT_FORMAT);
+  if (!surface.save(path)) {
+    std::cerr << "Failed to save world to \"" << path << "\"\n";
+    return 1;
+  }
+  std::cout << "Saved " << width << "x" << height << " world with seed "
+            << surface.get_seed() << " to \"" << path << "\"\n";
+  return 0;
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifdef __EMSCRIPTEN__
+  (void)argc;
+  (void)argv;
+#else
+  // "demo_0 --save-world <file> [seed [width height]]" writes a world file,
+  // "demo_0 <file>" plays on it and "demo_0 [width height]" plays on a random
+  // surface of that size.
+  std::optional<std::string> world_path;
+  unsigned int surface_width = DEFAULT_SURFACE_UNIT_WIDTH;
+  unsigned int surface_height = DEFAULT_SURFACE_UNIT_HEIGHT;
+  if (argc >= 3 && std::string(argv[1]) == "--save-world") {
+    std::optional<unsigned int> seed;
+    if (argc >= 4) {
+      seed = (unsigned int)std::strtoul(argv[3], nullptr, 10);
+    }
+    if (argc >= 6) {
+      const std::optional<unsigned int> width = parse_positive(argv[4]);
+      const std::optional<unsigned int> height = parse_positive(argv[5]);
+      if (!width.has_value() || !height.has_value()) {
+        std::cerr << "Invalid world size \"" << argv[4] << "x" << argv[5]
+                  << "\"\n";
+        return 1;
+      }
+      surface_width = width.value();
+      surface_height = height.value();
+    }
+    return save_world(argv[2], seed, surface_width, surface_height);
+  } else if (argc >= 3 && parse_positive(argv[1]).has_value() &&
+             parse_positive(argv[2]).has_value()) {
+    surface_width = parse_positive(argv[1]).value();
+    surface_height = parse_positive(argv[2]).value();
+  } else if (argc >= 2) {
+    world_path = argv[1];
+  }
+#endif
+
 #ifdef __EMSCRIPTEN__
   InitWindow(call_js_get_canvas_width(), call_js_get_canvas_height(), "Demo");
 #else
@@ -80,7 +153,7 @@ int main() {
   emscripten_set_main_loop_arg(jumpartifact_demo_update, &game, 0, 1);
 #else
   {
-    Game game{};
+    Game game{world_path, surface_width, surface_height};
     SetTargetFPS(60);
     SetWindowState(FLAG_WINDOW_RESIZABLE);
 
@@ -0,0 +1,49 @@
+#include "mapped_file.h"
+
+// standard library includes
+#ifndef NDEBUG
+#include <iostream>
+#endif
+
+// system includes
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+#ifndef NDEBUG
+    std::cout << "MappedFile: failed to open \"" << path << "\"\n";
+#endif
+    return nullptr;
+  }
+
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+    close(fd);
+    return nullptr;
+  }
+  const std::size_t size = (std::size_t)file_stat.st_size;
+
+  // Private and writable, so callers may modify the data in place without
+  // the changes reaching the file.
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+#ifndef NDEBUG
+    std::cout << "MappedFile: failed to map \"" << path << "\"\n";
+#endif
+    return nullptr;
+  }
+
+  return std::unique_ptr<MappedFile>(
+      new MappedFile((unsigned char *)data, size));
+}
+
+MappedFile::MappedFile(unsigned char *data, std::size_t size)
+    : data(data), size(size) {}
+
+MappedFile::~MappedFile() { munmap(data, size); }
@@ -0,0 +1,43 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_MAPPED_FILE_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_MAPPED_FILE_H_
+
+// standard library includes
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/*
+ * A whole file mapped into memory copy-on-write. Writes to the mapping are
+ * private to the process and never reach the file. Pages are read from the
+ * file when first touched.
+ */
+class MappedFile {
+ public:
+  /// nullptr if the file can't be opened or mapped.
+  static std::unique_ptr<MappedFile> open(const std::string &path);
+
+  ~MappedFile();
+
+  // No copy.
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // No move.
+  MappedFile(MappedFile &&) = delete;
+  MappedFile &operator=(MappedFile &&) = delete;
+
+  unsigned char *get_data() const;
+  std::size_t get_size() const;
+
+ private:
+  MappedFile(unsigned char *data, std::size_t size);
+
+  unsigned char *data;
+  std::size_t size;
+};
+
+inline unsigned char *MappedFile::get_data() const { return data; }
+
+inline std::size_t MappedFile::get_size() const { return size; }
+
+#endif
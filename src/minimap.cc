@@ -0,0 +1,146 @@
+#include "minimap.h"
+
+// standard library includes
+#include <algorithm>
+
+// third party includes
+#include <raymath.h>
+
+unsigned int get_minimap_scale(unsigned int width, unsigned int height) {
+  const unsigned int longest = std::max(width, height);
+  unsigned int scale = 1;
+  while (longest > MINIMAP_MAX_RESOLUTION * scale) {
+    scale *= 2;
+  }
+  return scale;
+}
+
+Color get_minimap_height_color(float y) {
+  const float t = std::clamp(
+      (y - MINIMAP_LOW_Y) / (MINIMAP_HIGH_Y - MINIMAP_LOW_Y), 0.0F, 1.0F);
+  return Color{(unsigned char)(30.0F + t * 200.0F),
+               (unsigned char)(60.0F + t * 180.0F),
+               (unsigned char)(40.0F + t * 160.0F), 255};
+}
+
+Minimap::Minimap()
+    : texture(),
+      chunk_versions(),
+      texels(),
+      bounds{0.0F, 0.0F, 0.0F, 0.0F},
+      scale(1),
+      surface_width(0),
+      surface_height(0),
+      x_offset(0.0F),
+      y_offset(0.0F),
+      is_loaded(false) {}
+
+Minimap::~Minimap() { clear(); }
+
+void Minimap::clear() {
+  if (is_loaded) {
+    UnloadTexture(texture);
+    is_loaded = false;
+  }
+  chunk_versions.clear();
+}
+
+void Minimap::update(const Surface &surface) {
+  if (!is_loaded) {
+    load(surface);
+  }
+  for (std::size_t chunk_idx = 0; chunk_idx < chunk_versions.size();
+       ++chunk_idx) {
+    const Surface::Chunk *chunk = surface.get_resident_chunk(chunk_idx);
+    if (chunk && chunk_versions[chunk_idx] != chunk->version) {
+      update_chunk(*chunk);
+      chunk_versions[chunk_idx] = chunk->version;
+    }
+  }
+}
+
+void Minimap::draw(Rectangle area) {
+  if (!is_loaded) {
+    return;
+  }
+  const float fit = std::min(area.width / (float)surface_width,
+                             area.height / (float)surface_height);
+  bounds.width = (float)surface_width * fit;
+  bounds.height = (float)surface_height * fit;
+  bounds.x = area.x + (area.width - bounds.width) / 2.0F;
+  bounds.y = area.y + (area.height - bounds.height) / 2.0F;
+  // The last texels may cover units beyond the surface's edges.
+  DrawTexturePro(texture,
+                 Rectangle{0.0F, 0.0F, (float)surface_width / (float)scale,
+                           (float)surface_height / (float)scale},
+                 bounds, Vector2{0.0F, 0.0F}, 0.0F, WHITE);
+  DrawRectangleLines((int)bounds.x, (int)bounds.y, (int)bounds.width,
+                     (int)bounds.height, BLACK);
+}
+
+void Minimap::draw_marker(Vector3 pos, Color color) const {
+  DrawCircleV(get_screen_pos(pos), MINIMAP_MARKER_RADIUS, color);
+}
+
+void Minimap::draw_heading(Vector3 pos, Vector3 direction, Color color) const {
+  const Vector2 start = get_screen_pos(pos);
+  const Vector2 dir =
+      Vector2Normalize(Vector2{direction.x, direction.z}) *
+      MINIMAP_HEADING_LENGTH;
+  DrawLineEx(start, start + dir, 2.0F, color);
+}
+
+Vector2 Minimap::get_screen_pos(Vector3 pos) const {
+  // Unit x spans world x - x_offset - 0.5 to x - x_offset + 0.5.
+  const float u = (pos.x + x_offset + 0.5F) / (float)surface_width;
+  const float v = (pos.z + y_offset + 0.5F) / (float)surface_height;
+  return Vector2{bounds.x + u * bounds.width, bounds.y + v * bounds.height};
+}
+
+void Minimap::load(const Surface &surface) {
+  scale = get_minimap_scale(surface.get_width(), surface.get_height());
+  surface_width = surface.get_width();
+  surface_height = surface.get_height();
+  x_offset = surface.get_x_offset();
+  y_offset = surface.get_y_offset();
+  chunk_versions.assign(surface.get_chunk_count(), std::nullopt);
+
+  const int texture_width = (int)((surface_width + scale - 1) / scale);
+  const int texture_height = (int)((surface_height + scale - 1) / scale);
+  texels.assign((std::size_t)texture_width * texture_height, BLANK);
+  const Image image{.data = texels.data(),
+                    .width = texture_width,
+                    .height = texture_height,
+                    .mipmaps = 1,
+                    .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  texture = LoadTextureFromImage(image);
+  // Not a power of two, so it can't repeat on WebGL 1.
+  SetTextureWrap(texture, TEXTURE_WRAP_CLAMP);
+  is_loaded = true;
+}
+
+void Minimap::update_chunk(const Surface::Chunk &chunk) {
+  // Texels of the units at multiples of scale within the chunk.
+  const unsigned int tx_min = (chunk.x + scale - 1) / scale;
+  const unsigned int ty_min = (chunk.y + scale - 1) / scale;
+  const unsigned int tx_end = (chunk.x + chunk.width + scale - 1) / scale;
+  const unsigned int ty_end = (chunk.y + chunk.height + scale - 1) / scale;
+  if (tx_min >= tx_end || ty_min >= ty_end) {
+    return;
+  }
+
+  const std::size_t vertex_width = chunk.width + 1;
+  texels.clear();
+  for (unsigned int ty = ty_min; ty < ty_end; ++ty) {
+    for (unsigned int tx = tx_min; tx < tx_end; ++tx) {
+      // The unit's nw vertex stands in for the whole block.
+      texels.push_back(get_minimap_height_color(chunk.get_vertex(
+          (tx * scale - chunk.x) + (ty * scale - chunk.y) * vertex_width)));
+    }
+  }
+  UpdateTextureRec(texture,
+                   Rectangle{(float)tx_min, (float)ty_min,
+                             (float)(tx_end - tx_min),
+                             (float)(ty_end - ty_min)},
+                   texels.data());
+}
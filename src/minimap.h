@@ -0,0 +1,88 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_MINIMAP_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_MINIMAP_H_
+
+// standard library includes
+#include <optional>
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+// local includes
+#include "surface.h"
+
+// The minimap's texture has at most this many texels on its longest side, each
+// texel shows the height of one unit out of every block of scale x scale.
+constexpr unsigned int MINIMAP_MAX_RESOLUTION = 256;
+// Heights are shaded from dark at MINIMAP_LOW_Y to light at MINIMAP_HIGH_Y,
+// about the range of generated surfaces.
+constexpr float MINIMAP_LOW_Y = -4.0F;
+constexpr float MINIMAP_HIGH_Y = 4.0F;
+constexpr float MINIMAP_MARKER_RADIUS = 3.0F;
+constexpr float MINIMAP_HEADING_LENGTH = 12.0F;
+
+/// Smallest power of two scale that fits a surface of width x height units
+/// into MINIMAP_MAX_RESOLUTION texels.
+extern unsigned int get_minimap_scale(unsigned int width, unsigned int height);
+
+/// Color of a minimap texel at height y.
+extern Color get_minimap_height_color(float y);
+
+/*
+ * Top-down view of a Surface's heights, drawn as one textured quad with
+ * markers on top.
+ *
+ * The texture is only written when the surface changes: update() compares
+ * every resident chunk's version to the one its texels were written at and
+ * uploads the texels of the chunks that changed. Chunks that were never
+ * resident stay blank, evicted chunks keep their texels since they are
+ * generated again with the same heights.
+ */
+class Minimap {
+ public:
+  Minimap();
+  ~Minimap();
+
+  // No copy.
+  Minimap(const Minimap &) = delete;
+  Minimap &operator=(const Minimap &) = delete;
+
+  // No move.
+  Minimap(Minimap &&) = delete;
+  Minimap &operator=(Minimap &&) = delete;
+
+  /// Unloads the texture, must be called when the Surface is replaced.
+  void clear();
+
+  /// Writes the texels of resident chunks that changed since the last update.
+  void update(const Surface &surface);
+
+  /// Draws the texture into the largest rectangle of the surface's aspect
+  /// ratio centered in area. Markers are placed relative to it.
+  void draw(Rectangle area);
+  /// Marks the world position on the last drawn minimap.
+  void draw_marker(Vector3 pos, Color color) const;
+  /// Draws a line from the world position along direction on the xz plane.
+  void draw_heading(Vector3 pos, Vector3 direction, Color color) const;
+
+  /// Position on screen of the world position on the last drawn minimap.
+  Vector2 get_screen_pos(Vector3 pos) const;
+
+ private:
+  Texture2D texture;
+  /// Version of each chunk when its texels were written, nullopt if never.
+  std::vector<std::optional<unsigned long long> > chunk_versions;
+  std::vector<Color> texels;
+  Rectangle bounds;
+  unsigned int scale;
+  unsigned int surface_width;
+  unsigned int surface_height;
+  float x_offset;
+  float y_offset;
+  bool is_loaded;
+
+  void load(const Surface &surface);
+  void update_chunk(const Surface::Chunk &chunk);
+};
+
+#endif
@@ -0,0 +1,173 @@
+#include "parallel.h"
+
+// standard library includes
+#include <algorithm>
+#ifndef __EMSCRIPTEN__
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+#ifndef __EMSCRIPTEN__
+namespace {
+
+/// One parallel_for() call, its ranges are claimed by the caller and by any
+/// pool threads that pick it up.
+struct Job {
+  Job(const std::function<void(std::size_t, std::size_t)> &fn,
+      std::size_t count, std::size_t ranges)
+      : fn(&fn),
+        count(count),
+        ranges(ranges),
+        next_range(0),
+        done_ranges(0),
+        mutex(),
+        done() {}
+
+  // No copy.
+  Job(const Job &) = delete;
+  Job &operator=(const Job &) = delete;
+
+  // No move.
+  Job(Job &&) = delete;
+  Job &operator=(Job &&) = delete;
+
+  const std::function<void(std::size_t, std::size_t)> *fn;
+  std::size_t count;
+  std::size_t ranges;
+  std::atomic<std::size_t> next_range;
+  std::size_t done_ranges;
+  std::mutex mutex;
+  std::condition_variable done;
+
+  /// Runs ranges until none are left to claim.
+  void work() {
+    for (std::size_t range = next_range++; range < ranges;
+         range = next_range++) {
+      (*fn)(count * range / ranges, count * (range + 1) / ranges);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (++done_ranges == ranges) {
+        done.notify_all();
+      }
+    }
+  }
+};
+
+/*
+ * Threads started once and kept for the whole run, so that parallel_for()
+ * can be called every frame without starting threads. The caller of
+ * parallel_for() works on its own job too, so jobs finish even while every
+ * pool thread is busy with another caller's job, and parallel_for() may be
+ * called from several threads at once.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(unsigned int thread_count)
+      : threads(), queue(), mutex(), has_work(), is_stopping(false) {
+    threads.reserve(thread_count);
+    for (unsigned int idx = 0; idx < thread_count; ++idx) {
+      threads.emplace_back([this]() { run(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_stopping = true;
+    }
+    has_work.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // No copy.
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // No move.
+  ThreadPool(ThreadPool &&) = delete;
+  ThreadPool &operator=(ThreadPool &&) = delete;
+
+  /// Wakes up to helper_count threads to work on the job.
+  void submit(const std::shared_ptr<Job> &job, std::size_t helper_count) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (std::size_t idx = 0; idx < helper_count; ++idx) {
+        queue.push_back(job);
+      }
+    }
+    has_work.notify_all();
+  }
+
+ private:
+  std::vector<std::thread> threads;
+  std::deque<std::shared_ptr<Job> > queue;
+  std::mutex mutex;
+  std::condition_variable has_work;
+  bool is_stopping;
+
+  void run() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        has_work.wait(lock, [this]() { return is_stopping || !queue.empty(); });
+        if (is_stopping) {
+          return;
+        }
+        job = std::move(queue.front());
+        queue.pop_front();
+      }
+      job->work();
+    }
+  }
+};
+
+ThreadPool &get_thread_pool() {
+  // The calling thread is the other one.
+  static ThreadPool pool(get_default_thread_count() - 1);
+  return pool;
+}
+
+}  // namespace
+#endif
+
+unsigned int get_default_thread_count() {
+#ifdef __EMSCRIPTEN__
+  return 1;
+#else
+  return std::max(std::thread::hardware_concurrency(), 1U);
+#endif
+}
+
+void parallel_for(std::size_t count, unsigned int thread_count,
+                  const std::function<void(std::size_t, std::size_t)> &fn) {
+#ifdef __EMSCRIPTEN__
+  (void)thread_count;
+  if (count > 0) {
+    fn(0, count);
+  }
+#else
+  const std::size_t ranges =
+      std::min((std::size_t)std::max(thread_count, 1U), count);
+  if (ranges <= 1) {
+    if (count > 0) {
+      fn(0, count);
+    }
+    return;
+  }
+
+  // Ranges are the same as with a thread per range, only who runs them
+  // differs.
+  auto job = std::make_shared<Job>(fn, count, ranges);
+  get_thread_pool().submit(job, ranges - 1);
+  job->work();
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->done.wait(lock, [&job]() { return job->done_ranges == job->ranges; });
+#endif
+}
@@ -0,0 +1,18 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_PARALLEL_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_PARALLEL_H_
+
+// standard library includes
+#include <cstddef>
+#include <functional>
+
+/// Threads available for parallel_for(), always 1 on emscripten.
+extern unsigned int get_default_thread_count();
+
+/// Calls fn(begin, end) on contiguous ranges covering [0, count), using up to
+/// thread_count threads including the calling thread. Returns once all ranges
+/// are done.
+extern void parallel_for(
+    std::size_t count, unsigned int thread_count,
+    const std::function<void(std::size_t, std::size_t)> &fn);
+
+#endif
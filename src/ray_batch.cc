@@ -0,0 +1,252 @@
+#include "ray_batch.h"
+
+// third party includes
+#include <raymath.h>
+
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+#define RAY_BATCH_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*
+ * The min and max helpers return their second argument if either one is NaN,
+ * which is what minps and maxps do. That happens when a ray starts exactly on
+ * a slab plane it runs parallel to (0 * infinity), the slab is then ignored.
+ * The kernels do the same subtracts and multiplies as the scalar code, so all
+ * of them give bit-identical results.
+ */
+
+namespace {
+
+float min_slab(float a, float b) { return a < b ? a : b; }
+
+float max_slab(float a, float b) { return a > b ? a : b; }
+
+void clip_slab(float lo, float hi, float origin, float inv_dir, float &t0,
+               float &t1) {
+  const float a = (lo - origin) * inv_dir;
+  const float b = (hi - origin) * inv_dir;
+  t0 = max_slab(min_slab(a, b), t0);
+  t1 = min_slab(max_slab(a, b), t1);
+}
+
+void test_box_scalar(const RayBatch &rays, std::size_t ray_idx,
+                     const BoxBatch &boxes, std::size_t box_idx,
+                     std::optional<RayBoxHit> &hit) {
+  float t0 = 0.0F;
+  float t1 = rays.max_t[ray_idx];
+  clip_slab(boxes.min_x[box_idx], boxes.max_x[box_idx], rays.origin_x[ray_idx],
+            rays.inv_dir_x[ray_idx], t0, t1);
+  clip_slab(boxes.min_y[box_idx], boxes.max_y[box_idx], rays.origin_y[ray_idx],
+            rays.inv_dir_y[ray_idx], t0, t1);
+  clip_slab(boxes.min_z[box_idx], boxes.max_z[box_idx], rays.origin_z[ray_idx],
+            rays.inv_dir_z[ray_idx], t0, t1);
+  if (t0 <= t1 && (!hit.has_value() || t0 < hit->t)) {
+    hit = RayBoxHit{box_idx, t0};
+  }
+}
+
+std::optional<RayBoxHit> get_nearest_hit_scalar(const RayBatch &rays,
+                                                std::size_t ray_idx,
+                                                const BoxBatch &boxes) {
+  std::optional<RayBoxHit> hit;
+  for (std::size_t box_idx = 0; box_idx < boxes.size(); ++box_idx) {
+    test_box_scalar(rays, ray_idx, boxes, box_idx, hit);
+  }
+  return hit;
+}
+
+#ifdef RAY_BATCH_X86_KERNELS
+void clip_slab_sse(const float *lo, const float *hi, __m128 origin,
+                   __m128 inv_dir, __m128 &t0, __m128 &t1) {
+  const __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(lo), origin), inv_dir);
+  const __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(hi), origin), inv_dir);
+  t0 = _mm_max_ps(_mm_min_ps(a, b), t0);
+  t1 = _mm_min_ps(_mm_max_ps(a, b), t1);
+}
+
+std::optional<RayBoxHit> get_nearest_hit_sse(const RayBatch &rays,
+                                             std::size_t ray_idx,
+                                             const BoxBatch &boxes) {
+  const __m128 origin_x = _mm_set1_ps(rays.origin_x[ray_idx]);
+  const __m128 origin_y = _mm_set1_ps(rays.origin_y[ray_idx]);
+  const __m128 origin_z = _mm_set1_ps(rays.origin_z[ray_idx]);
+  const __m128 inv_dir_x = _mm_set1_ps(rays.inv_dir_x[ray_idx]);
+  const __m128 inv_dir_y = _mm_set1_ps(rays.inv_dir_y[ray_idx]);
+  const __m128 inv_dir_z = _mm_set1_ps(rays.inv_dir_z[ray_idx]);
+  const __m128 max_t = _mm_set1_ps(rays.max_t[ray_idx]);
+
+  std::optional<RayBoxHit> hit;
+  std::size_t box_idx = 0;
+  for (; box_idx + 4 <= boxes.size(); box_idx += 4) {
+    __m128 t0 = _mm_setzero_ps();
+    __m128 t1 = max_t;
+    clip_slab_sse(&boxes.min_x[box_idx], &boxes.max_x[box_idx], origin_x,
+                  inv_dir_x, t0, t1);
+    clip_slab_sse(&boxes.min_y[box_idx], &boxes.max_y[box_idx], origin_y,
+                  inv_dir_y, t0, t1);
+    clip_slab_sse(&boxes.min_z[box_idx], &boxes.max_z[box_idx], origin_z,
+                  inv_dir_z, t0, t1);
+    const int mask = _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+    if (mask == 0) {
+      continue;
+    }
+    alignas(16) float t[4];
+    _mm_store_ps(t, t0);
+    for (int lane = 0; lane < 4; ++lane) {
+      if ((mask & (1 << lane)) != 0 && (!hit.has_value() || t[lane] < hit->t)) {
+        hit = RayBoxHit{box_idx + lane, t[lane]};
+      }
+    }
+  }
+  for (; box_idx < boxes.size(); ++box_idx) {
+    test_box_scalar(rays, ray_idx, boxes, box_idx, hit);
+  }
+  return hit;
+}
+
+__attribute__((target("avx"))) void clip_slab_avx(const float *lo,
+                                                  const float *hi,
+                                                  __m256 origin, __m256 inv_dir,
+                                                  __m256 &t0, __m256 &t1) {
+  const __m256 a =
+      _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(lo), origin), inv_dir);
+  const __m256 b =
+      _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(hi), origin), inv_dir);
+  t0 = _mm256_max_ps(_mm256_min_ps(a, b), t0);
+  t1 = _mm256_min_ps(_mm256_max_ps(a, b), t1);
+}
+
+__attribute__((target("avx"))) std::optional<RayBoxHit> get_nearest_hit_avx(
+    const RayBatch &rays, std::size_t ray_idx, const BoxBatch &boxes) {
+  const __m256 origin_x = _mm256_set1_ps(rays.origin_x[ray_idx]);
+  const __m256 origin_y = _mm256_set1_ps(rays.origin_y[ray_idx]);
+  const __m256 origin_z = _mm256_set1_ps(rays.origin_z[ray_idx]);
+  const __m256 inv_dir_x = _mm256_set1_ps(rays.inv_dir_x[ray_idx]);
+  const __m256 inv_dir_y = _mm256_set1_ps(rays.inv_dir_y[ray_idx]);
+  const __m256 inv_dir_z = _mm256_set1_ps(rays.inv_dir_z[ray_idx]);
+  const __m256 max_t = _mm256_set1_ps(rays.max_t[ray_idx]);
+
+  std::optional<RayBoxHit> hit;
+  std::size_t box_idx = 0;
+  for (; box_idx + 8 <= boxes.size(); box_idx += 8) {
+    __m256 t0 = _mm256_setzero_ps();
+    __m256 t1 = max_t;
+    clip_slab_avx(&boxes.min_x[box_idx], &boxes.max_x[box_idx], origin_x,
+                  inv_dir_x, t0, t1);
+    clip_slab_avx(&boxes.min_y[box_idx], &boxes.max_y[box_idx], origin_y,
+                  inv_dir_y, t0, t1);
+    clip_slab_avx(&boxes.min_z[box_idx], &boxes.max_z[box_idx], origin_z,
+                  inv_dir_z, t0, t1);
+    const int mask = _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+    if (mask == 0) {
+      continue;
+    }
+    alignas(32) float t[8];
+    _mm256_store_ps(t, t0);
+    for (int lane = 0; lane < 8; ++lane) {
+      if ((mask & (1 << lane)) != 0 && (!hit.has_value() || t[lane] < hit->t)) {
+        hit = RayBoxHit{box_idx + lane, t[lane]};
+      }
+    }
+  }
+  for (; box_idx < boxes.size(); ++box_idx) {
+    test_box_scalar(rays, ray_idx, boxes, box_idx, hit);
+  }
+  return hit;
+}
+#endif
+
+}  // namespace
+
+void RayBatch::add(Ray ray, float max_distance) {
+  origin_x.push_back(ray.position.x);
+  origin_y.push_back(ray.position.y);
+  origin_z.push_back(ray.position.z);
+  inv_dir_x.push_back(1.0F / ray.direction.x);
+  inv_dir_y.push_back(1.0F / ray.direction.y);
+  inv_dir_z.push_back(1.0F / ray.direction.z);
+  max_t.push_back(max_distance / Vector3Length(ray.direction));
+}
+
+void RayBatch::clear() {
+  origin_x.clear();
+  origin_y.clear();
+  origin_z.clear();
+  inv_dir_x.clear();
+  inv_dir_y.clear();
+  inv_dir_z.clear();
+  max_t.clear();
+}
+
+void BoxBatch::add(const BoundingBox &bb) {
+  min_x.push_back(bb.min.x);
+  min_y.push_back(bb.min.y);
+  min_z.push_back(bb.min.z);
+  max_x.push_back(bb.max.x);
+  max_y.push_back(bb.max.y);
+  max_z.push_back(bb.max.z);
+}
+
+void BoxBatch::clear() {
+  min_x.clear();
+  min_y.clear();
+  min_z.clear();
+  max_x.clear();
+  max_y.clear();
+  max_z.clear();
+}
+
+bool is_ray_batch_kernel_supported(RayBatchKernel kernel) {
+  switch (kernel) {
+    case RayBatchKernel::SCALAR:
+      return true;
+#ifdef RAY_BATCH_X86_KERNELS
+    case RayBatchKernel::SSE:
+      // Part of the x86-64 baseline.
+      return true;
+    case RayBatchKernel::AVX:
+      return __builtin_cpu_supports("avx");
+#endif
+    default:
+      return false;
+  }
+}
+
+RayBatchKernel get_ray_batch_kernel() {
+  static const RayBatchKernel kernel = []() {
+    if (is_ray_batch_kernel_supported(RayBatchKernel::AVX)) {
+      return RayBatchKernel::AVX;
+    } else if (is_ray_batch_kernel_supported(RayBatchKernel::SSE)) {
+      return RayBatchKernel::SSE;
+    }
+    return RayBatchKernel::SCALAR;
+  }();
+  return kernel;
+}
+
+void get_nearest_ray_box_hits(RayBatchKernel kernel, const RayBatch &rays,
+                              const BoxBatch &boxes,
+                              std::vector<std::optional<RayBoxHit> > &hits) {
+  hits.resize(rays.size());
+  for (std::size_t ray_idx = 0; ray_idx < rays.size(); ++ray_idx) {
+    switch (kernel) {
+#ifdef RAY_BATCH_X86_KERNELS
+      case RayBatchKernel::SSE:
+        hits[ray_idx] = get_nearest_hit_sse(rays, ray_idx, boxes);
+        break;
+      case RayBatchKernel::AVX:
+        hits[ray_idx] = get_nearest_hit_avx(rays, ray_idx, boxes);
+        break;
+#endif
+      default:
+        hits[ray_idx] = get_nearest_hit_scalar(rays, ray_idx, boxes);
+        break;
+    }
+  }
+}
+
+void get_nearest_ray_box_hits(const RayBatch &rays, const BoxBatch &boxes,
+                              std::vector<std::optional<RayBoxHit> > &hits) {
+  get_nearest_ray_box_hits(get_ray_batch_kernel(), rays, boxes, hits);
+}
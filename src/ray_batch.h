@@ -0,0 +1,69 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_RAY_BATCH_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_RAY_BATCH_H_
+
+// standard library includes
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+/// Rays in structure-of-arrays form, ray n is at index n of every array.
+struct RayBatch {
+  std::vector<float> origin_x{}, origin_y{}, origin_z{};
+  /// Reciprocals of the directions, infinite for zero components.
+  std::vector<float> inv_dir_x{}, inv_dir_y{}, inv_dir_z{};
+  /// Hits further than this along the ray, in multiples of its direction, are
+  /// ignored.
+  std::vector<float> max_t{};
+
+  void add(Ray ray, float max_distance = INFINITY);
+  std::size_t size() const;
+  void clear();
+};
+
+/// Axis-aligned boxes in structure-of-arrays form.
+struct BoxBatch {
+  std::vector<float> min_x{}, min_y{}, min_z{};
+  std::vector<float> max_x{}, max_y{}, max_z{};
+
+  void add(const BoundingBox &bb);
+  std::size_t size() const;
+  void clear();
+};
+
+struct RayBoxHit {
+  std::size_t box_idx;
+  /// Where the ray enters the box in multiples of its direction, 0 if the ray
+  /// starts inside it.
+  float t;
+};
+
+/*
+ * Implementations of the slab tests, all of them give identical results. The
+ * vectorised ones test 4 or 8 boxes at once, only exist on x86-64 and are
+ * picked at runtime depending on what the CPU supports.
+ */
+enum class RayBatchKernel { SCALAR, SSE, AVX };
+
+extern bool is_ray_batch_kernel_supported(RayBatchKernel kernel);
+/// Fastest supported kernel, chosen on first call.
+extern RayBatchKernel get_ray_batch_kernel();
+
+/// Nearest box hit by every ray, hits is resized to rays.size(). Ties go to
+/// the box with the lower index.
+extern void get_nearest_ray_box_hits(
+    RayBatchKernel kernel, const RayBatch &rays, const BoxBatch &boxes,
+    std::vector<std::optional<RayBoxHit> > &hits);
+/// Same as above with get_ray_batch_kernel().
+extern void get_nearest_ray_box_hits(
+    const RayBatch &rays, const BoxBatch &boxes,
+    std::vector<std::optional<RayBoxHit> > &hits);
+
+inline std::size_t RayBatch::size() const { return origin_x.size(); }
+
+inline std::size_t BoxBatch::size() const { return min_x.size(); }
+
+#endif
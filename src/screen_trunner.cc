@@ -2,8 +2,8 @@
 
 // standard library includes
 #include <cassert>
+#include <chrono>
 #include <cmath>
-#include <queue>
 
 #ifndef NDEBUG
 #include <iostream>
@@ -16,13 +16,31 @@
 // local includes
 #include "3d_helpers.h"
 #include "ems.h"
+#include "parallel.h"
+#include "ray_batch.h"
 #include "screen_walker_hack.h"
 
 TRunnerScreen::TRunnerScreen(std::weak_ptr<ScreenStack> stack)
+    : TRunnerScreen(stack, DEFAULT_SURFACE_UNIT_WIDTH,
+                    DEFAULT_SURFACE_UNIT_HEIGHT) {}
+
+TRunnerScreen::TRunnerScreen(std::weak_ptr<ScreenStack> stack,
+                             std::optional<std::string> world_path)
+    : TRunnerScreen(stack, DEFAULT_SURFACE_UNIT_WIDTH,
+                    DEFAULT_SURFACE_UNIT_HEIGHT, world_path) {}
+
+TRunnerScreen::TRunnerScreen(std::weak_ptr<ScreenStack> stack,
+                             unsigned int surface_width,
+                             unsigned int surface_height,
+                             std::optional<std::string> world_path)
     : Screen(stack),
-      surface(),
-      surface_bbs(),
+      world_path(world_path),
+      surface(load_or_generate_surface(world_path, surface_width,
+                                       surface_height,
+                                       SURFACE_DEFAULT_MEMORY_BUDGET)),
       walkers(),
+      walker_thread_count(get_default_thread_count()),
+      flow_fields(),
       camera{Vector3{0.0F, 1.0F, 0.5F}, Vector3{0.0F, 0.0F, 0.0F},
              Vector3{0.0F, 1.0F, 0.0F}, 80.0F, CAMERA_PERSPECTIVE},
       flags(),
@@ -31,37 +49,52 @@ TRunnerScreen::TRunnerScreen(std::weak_ptr<ScreenStack> stack)
       TEMP_matrix(get_identity_matrix()),
       bgRenderTexture(),
       fgRenderTexture(),
+      surface_renderer(),
+      minimap(),
+      walker_renderer(),
       camera_pos{0.0F, 4.0F, 4.0F},
       camera_target{0.0F, 0.0F, 0.0F},
       mouse_hit{0.0F, 0.0F, 0.0F},
-      surface_triangles(),
+      surface_shatter(),
       electricityEffects(),
       sparkEffects(),
-      idx_hit(SURFACE_UNIT_WIDTH / 2 +
-              (SURFACE_UNIT_HEIGHT / 2) * SURFACE_UNIT_WIDTH),
+      idx_hit(surface->get_width() / 2 +
+              (surface->get_height() / 2) * surface->get_width()),
+      idx_hover(surface->size()),
       controlled_walker_idx(std::nullopt),
+      sculpt_brush(std::nullopt),
       left_text_width(MeasureText("Left", BUTTON_FONT_SIZE)),
       right_text_width(MeasureText("Right", BUTTON_FONT_SIZE)),
       forward_text_width(MeasureText("Forward", BUTTON_FONT_SIZE)),
       reset_surface_text_width(MeasureText("Reset Surface", BUTTON_FONT_SIZE)),
+      sculpt_text_width(MeasureText(get_sculpt_text(SurfaceBrush::FLATTEN),
+                                    BUTTON_FONT_SIZE)),
       surface_reset_anim_timer(0.0F),
-      walker_hack_success(false) {
-  surface = std::make_unique<SurfaceArrT>();
-  surface_bbs = std::make_unique<SurfaceBBsArrT>();
-  // NOLINTBEGIN(bugprone-integer-division)
-  walkers = std::make_unique<WalkersArrT>(WalkersArrT{
-      Walker{(float)(SURFACE_UNIT_WIDTH / 4) - SURFACE_X_OFFSET,
-             (float)(SURFACE_UNIT_HEIGHT / 4) - SURFACE_Y_OFFSET, true},
-
-      Walker{(float)((SURFACE_UNIT_WIDTH / 4) * 3) - SURFACE_X_OFFSET,
-             (float)(SURFACE_UNIT_HEIGHT / 4) - SURFACE_Y_OFFSET, true},
-
-      Walker{(float)(SURFACE_UNIT_WIDTH / 4) - SURFACE_X_OFFSET,
-             (float)((SURFACE_UNIT_HEIGHT / 4) * 3) - SURFACE_Y_OFFSET, true},
-
-      Walker{(float)((SURFACE_UNIT_WIDTH / 4) * 3) - SURFACE_X_OFFSET,
-             (float)((SURFACE_UNIT_HEIGHT / 4) * 3) - SURFACE_Y_OFFSET, true}});
-  // NOLINTEND(bugprone-integer-division)
+      walker_hack_success(false),
+      surface_reset(),
+      surface_reset_future() {
+  // A loaded world decides the size of the surface.
+  surface_width = surface->get_width();
+  surface_height = surface->get_height();
+  const float x_offset = surface->get_x_offset();
+  const float y_offset = surface->get_y_offset();
+  // Walkers i get seeds base_seed + i, drawn here since call_js_get_random()
+  // may only be called on this thread.
+  const unsigned int base_seed = get_random_surface_seed();
+  const unsigned int columns =
+      (unsigned int)std::ceil(std::sqrt((float)WALKER_COUNT));
+  const unsigned int rows = (WALKER_COUNT + columns - 1) / columns;
+  walkers = std::make_unique<WalkersArrT>();
+  walkers->reserve(WALKER_COUNT);
+  for (unsigned int idx = 0; idx < WALKER_COUNT; ++idx) {
+    // Centered in their cell of the grid.
+    walkers->emplace_back(
+        (float)(surface_width * (idx % columns * 2 + 1) / (columns * 2)) -
+            x_offset,
+        (float)(surface_height * (idx / columns * 2 + 1) / (rows * 2)) -
+            y_offset,
+        true, base_seed + idx);
+  }
 
 #ifndef NDEBUG
   std::cout << "idx_hit initialized to " << idx_hit << std::endl;
@@ -72,9 +105,6 @@ TRunnerScreen::TRunnerScreen(std::weak_ptr<ScreenStack> stack)
                               scale_matrix_xyz(0.5F, 0.5F, 0.5F) *
                               translate_matrix_y(0.5F);
 
-  // Initialize surface.
-  generate_surface();
-
   // Set up render textures.
   bgRenderTexture = LoadRenderTexture(GetScreenWidth(), GetScreenHeight());
   fgRenderTexture = LoadRenderTexture(GetScreenWidth(), GetScreenHeight());
@@ -184,6 +214,41 @@ bool TRunnerScreen::update(float dt, bool is_resized) {
       }
     }
 
+    const bool is_on_sculpt_button = GetTouchX() <= sculpt_text_width &&
+                                     GetTouchY() <= BUTTON_FONT_SIZE;
+    if (IsMouseButtonPressed(0) && is_on_sculpt_button) {
+      // Cycle through off, raise, lower and flatten.
+      if (!sculpt_brush.has_value()) {
+        sculpt_brush = SurfaceBrush::RAISE;
+      } else if (sculpt_brush.value() == SurfaceBrush::RAISE) {
+        sculpt_brush = SurfaceBrush::LOWER;
+      } else if (sculpt_brush.value() == SurfaceBrush::LOWER) {
+        sculpt_brush = SurfaceBrush::FLATTEN;
+      } else {
+        sculpt_brush.reset();
+      }
+      goto post_check_click;
+    } else if (sculpt_brush.has_value() && IsMouseButtonDown(0) &&
+               !is_on_sculpt_button) {
+      // Walkers follow the new heights on their next update.
+      if (std::optional<SurfaceRayHit> hit =
+              surface->pick(GetMouseRay(GetMousePosition(), camera));
+          hit.has_value()) {
+        if (const std::optional<SurfaceRect> changed = surface->deform(
+                hit->point.x, hit->point.z, SCULPT_RADIUS,
+                sculpt_brush.value() == SurfaceBrush::FLATTEN
+                    ? SCULPT_FLATTEN_RATE * dt
+                    : SCULPT_RATE * dt,
+                sculpt_brush.value());
+            changed.has_value()) {
+          // Roaming walkers pick up fields of the new heights at their next
+          // step, fields away from the brush are kept.
+          flow_fields.invalidate(changed.value());
+        }
+      }
+      goto post_check_click;
+    }
+
     if (IsMouseButtonPressed(0)) {
       float press_x = GetTouchX();
       float press_y = GetTouchY();
@@ -192,7 +257,9 @@ bool TRunnerScreen::update(float dt, bool is_resized) {
       if (!flags.test(0) &&
           press_x >= GetScreenWidth() - reset_surface_text_width &&
           press_y <= BUTTON_FONT_SIZE) {
-        generate_surface_with_triangles();
+        if (!surface_reset) {
+          start_surface_reset();
+        }
         goto post_check_click;
       }
 
@@ -205,14 +272,22 @@ bool TRunnerScreen::update(float dt, bool is_resized) {
                 << std::endl;
 #endif
 
-      // Check if clicked on a Walker.
-      for (unsigned int idx = 0; idx < walkers->size(); ++idx) {
-        if (GetRayCollisionBox(ray, (*walkers)[idx].get_body_bb()).hit) {
+      // Check if clicked on a Walker, the nearest one if they overlap.
+      {
+        RayBatch rays;
+        rays.add(ray);
+        BoxBatch boxes;
+        for (const Walker &walker : *walkers) {
+          boxes.add(walker.get_body_bb());
+        }
+        std::vector<std::optional<RayBoxHit> > hits;
+        get_nearest_ray_box_hits(rays, boxes, hits);
+        if (hits[0].has_value()) {
           if (controlled_walker_idx.has_value()) {
             (*walkers)[controlled_walker_idx.value()].set_player_controlled(
                 false);
           }
-          controlled_walker_idx = idx;
+          controlled_walker_idx = hits[0]->box_idx;
           auto s_stack = stack.lock();
           if (s_stack) {
             s_stack->push_constructing_screen_args<WalkerHackScreen>(
@@ -221,66 +296,41 @@ bool TRunnerScreen::update(float dt, bool is_resized) {
           }
           // (*walkers)[controlled_walker_idx.value()].set_player_controlled(true);
 
-          idx_hit = SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT;
+          idx_hit = surface->size();
 
           goto post_check_click;
         }
       }
 
-      // Check if clicked on ground.
-      for (unsigned int idx = 0; idx < SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT;
-           ++idx) {
-        int x = idx % SURFACE_UNIT_WIDTH;
-        int y = idx / SURFACE_UNIT_WIDTH;
-        float xf = (float)(x)-SURFACE_X_OFFSET;
-        float zf = (float)(y)-SURFACE_Y_OFFSET;
-
-        const auto &current = (*surface)[idx].value();
-        Vector3 nw{xf - 0.5F, current.nw, zf - 0.5F};
-        Vector3 ne{xf + 0.5F, current.ne, zf - 0.5F};
-        Vector3 sw{xf - 0.5F, current.sw, zf + 0.5F};
-        Vector3 se{xf + 0.5F, current.se, zf + 0.5F};
-
-        const auto on_collide_fn = [this, idx, xf, zf,
-                                    &current](const auto &collision) {
-          this->idx_hit = idx;
+      // Check if clicked on ground, only loaded chunks are visible.
+      if (std::optional<SurfaceRayHit> hit = surface->pick(ray);
+          hit.has_value()) {
+        const unsigned int width = surface->get_width();
+        const unsigned int height = surface->get_height();
+        idx_hit = hit->idx;
 #ifndef NDEBUG
-          std::cout << "idx_hit set to " << idx_hit << std::endl;
+        std::cout << "idx_hit set to " << idx_hit << std::endl;
 #endif
-          this->mouse_hit = collision;
-
-          this->camera_target.x = xf;
-          this->camera_target.y =
-              (current.nw + current.ne + current.sw + current.se) / 4.0F;
-          this->camera_target.z = zf;
-          if (idx != SURFACE_UNIT_WIDTH / 2 +
-                         (SURFACE_UNIT_HEIGHT / 2) * SURFACE_UNIT_WIDTH) {
-            this->camera_pos = (Vector3Normalize(this->camera_target) * 4.0F) +
-                               this->camera_target;
-            this->camera_pos.y += 4.0F;
-          } else {
-            this->camera_pos.x = 0.0F;
-            this->camera_pos.y = this->camera_target.y + 4.0F;
-            this->camera_pos.z = 0.0F;
-          }
-          this->camera_target.y += 1.0F;
-          if (this->controlled_walker_idx.has_value()) {
-            (*this->walkers)[this->controlled_walker_idx.value()]
-                .set_player_controlled(false);
-            this->controlled_walker_idx = std::nullopt;
-          }
-        };
-
-        if (GetRayCollisionBox(ray, (*surface_bbs)[idx]).hit) {
-          if (auto collision = GetRayCollisionTriangle(ray, nw, sw, ne);
-              collision.hit) {
-            on_collide_fn(collision.point);
-            goto post_check_click;
-          } else if (auto collision = GetRayCollisionTriangle(ray, ne, sw, se);
-                     collision.hit) {
-            on_collide_fn(collision.point);
-            goto post_check_click;
-          }
+        mouse_hit = hit->point;
+
+        const SurfaceUnit current = (*surface)[idx_hit];
+        camera_target.x = (float)(idx_hit % width) - surface->get_x_offset();
+        camera_target.y =
+            (current.nw + current.ne + current.sw + current.se) / 4.0F;
+        camera_target.z = (float)(idx_hit / width) - surface->get_y_offset();
+        if (idx_hit != width / 2 + (height / 2) * width) {
+          camera_pos = (Vector3Normalize(camera_target) * 4.0F) + camera_target;
+          camera_pos.y += 4.0F;
+        } else {
+          camera_pos.x = 0.0F;
+          camera_pos.y = camera_target.y + 4.0F;
+          camera_pos.z = 0.0F;
+        }
+        camera_target.y += 1.0F;
+        if (controlled_walker_idx.has_value()) {
+          (*walkers)[controlled_walker_idx.value()].set_player_controlled(
+              false);
+          controlled_walker_idx = std::nullopt;
         }
       }
     }
@@ -288,23 +338,56 @@ bool TRunnerScreen::update(float dt, bool is_resized) {
 
 post_check_click:
 
-  if (flags.test(0)) {
+  if (surface_reset && finish_surface_reset()) {
+    surface_reset_anim_timer = 0.0F;
+    flags.set(0);
+  } else if (flags.test(0)) {
     surface_reset_anim_timer += dt;
     if (surface_reset_anim_timer > SURFACE_RESET_TIME) {
       flags.reset(0);
-      surface_triangles.reset();
-    } else {
-      for (auto &tri : *surface_triangles) {
-        tri.update(dt);
-      }
+      surface_shatter.clear();
     }
   }
 
   camera_to_targets(dt);
 
-  for (auto &walker : *walkers) {
-    walker.update(flags.test(0) ? 0.0F : dt, (*surface_bbs), SURFACE_UNIT_WIDTH,
-                  SURFACE_UNIT_HEIGHT);
+  update_surface_residency();
+  // Only rewrites the minimap's texels of chunks that were loaded or edited.
+  minimap.update(*surface);
+
+  // Highlight the unit under the mouse.
+  idx_hover = surface->size();
+  if (!flags.test(0)) {
+    if (std::optional<SurfaceRayHit> hit =
+            surface->pick(GetMouseRay(GetMousePosition(), camera));
+        hit.has_value()) {
+      idx_hover = hit->idx;
+    }
+  }
+
+  {
+    const float walker_dt = flags.test(0) ? 0.0F : dt;
+    // Roaming may load chunks, so it isn't done in parallel.
+    for (auto &walker : *walkers) {
+      walker.update_roaming(walker_dt, *surface, flow_fields);
+    }
+    // Walkers out of view or far away are updated less often, so the cost
+    // follows what is seen rather than how many walkers there are.
+    const Frustum frustum = get_frustum_from_camera(
+        camera, (float)GetScreenWidth() / (float)GetScreenHeight());
+    // Each walker only reads resident chunks and writes to itself, so the
+    // result is the same on any number of threads.
+    parallel_for(
+        walkers->size(), walker_thread_count,
+        [this, walker_dt, &frustum](std::size_t begin, std::size_t end) {
+          for (std::size_t idx = begin; idx < end; ++idx) {
+            Walker &walker = (*walkers)[idx];
+            const WalkerLod lod = walker.get_lod(
+                is_box_in_frustum(frustum, walker.get_draw_bb()),
+                Vector3Distance(camera.position, walker.get_body_pos()));
+            walker.update_lod(walker_dt, *surface, lod);
+          }
+        });
   }
 
   {
@@ -349,45 +432,39 @@ bool TRunnerScreen::draw(RenderTexture *render_texture) {
   ClearBackground(PixelToColor(Pixel::PIXEL_SKY));
   BeginMode3D(camera);
 
-  for (unsigned int idx = 0; idx < SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT;
-       ++idx) {
-    int x = idx % SURFACE_UNIT_WIDTH;
-    int y = idx / SURFACE_UNIT_WIDTH;
-    int ox = x - SURFACE_UNIT_WIDTH / 2;
-    int oy = y - SURFACE_UNIT_HEIGHT / 2;
-    float xf = (float)(x)-SURFACE_X_OFFSET;
-    float zf = (float)(y)-SURFACE_Y_OFFSET;
-    Color color = idx == idx_hit
-                      ? RAYWHITE
-                      : Color{(unsigned char)(200 + ox * 2),
-                              (unsigned char)(150 + oy * 2), 20, 255};
-    const auto &current = (*surface)[idx].value();
-    float reset_y_offset = 0.0F;
-    if (flags.test(0)) {
-      reset_y_offset = (1.0F - std::sin(surface_reset_anim_timer /
-                                        SURFACE_RESET_TIME * PI / 2.0F)) *
-                       -SURFACE_RESET_Y_OFFSET;
-    }
-    DrawTriangle3D(Vector3{xf - 0.5F, current.nw + reset_y_offset, zf - 0.5F},
-                   Vector3{xf - 0.5F, current.sw + reset_y_offset, zf + 0.5F},
-                   Vector3{xf + 0.5F, current.ne + reset_y_offset, zf - 0.5F},
-                   color);
-    DrawTriangle3D(Vector3{xf + 0.5F, current.se + reset_y_offset, zf + 0.5F},
-                   Vector3{xf + 0.5F, current.ne + reset_y_offset, zf - 0.5F},
-                   Vector3{xf - 0.5F, current.sw + reset_y_offset, zf + 0.5F},
-                   color);
+  float reset_y_offset = 0.0F;
+  if (flags.test(0)) {
+    reset_y_offset = (1.0F - std::sin(surface_reset_anim_timer /
+                                      SURFACE_RESET_TIME * PI / 2.0F)) *
+                     -SURFACE_RESET_Y_OFFSET;
   }
+  // Skip submitting anything outside of the view.
+  const Frustum frustum = get_frustum_from_camera(
+      camera, (float)GetScreenWidth() / (float)GetScreenHeight());
+
+  surface_renderer.draw(*surface, frustum, camera.position, idx_hit,
+                        idx_hover, reset_y_offset);
 
-  for (auto &walker : *walkers) {
-    walker.draw(TEMP_cube_model);
+  // Visible walkers are drawn together, one draw call for all of them.
+  for (const auto &walker : *walkers) {
+    if (is_box_in_frustum(frustum, walker.get_draw_bb())) {
+      walker_renderer.add(walker, TEMP_cube_model);
+    }
   }
+  walker_renderer.draw(TEMP_cube_model);
 
   for (auto &ee : electricityEffects) {
-    ee.draw(&camera);
+    if (is_sphere_in_frustum(frustum, ee.get_center(),
+                             ee.get_bounding_radius())) {
+      ee.draw(&camera);
+    }
   }
 
   for (auto &se : sparkEffects) {
-    se.draw(&camera);
+    if (is_sphere_in_frustum(frustum, se.get_center(),
+                             se.get_bounding_radius())) {
+      se.draw(&camera);
+    }
   }
 
   // TODO DEBUG
@@ -441,6 +518,31 @@ bool TRunnerScreen::draw(RenderTexture *render_texture) {
                        reset_surface_text_width, BUTTON_FONT_SIZE, GREEN);
     DrawText("Reset Surface", GetScreenWidth() - reset_surface_text_width, 0,
              BUTTON_FONT_SIZE, BLACK);
+
+    DrawRectangle(0, 0, sculpt_text_width, BUTTON_FONT_SIZE,
+                  Color{255, 255, 255, 180});
+    DrawRectangleLines(0, 0, sculpt_text_width, BUTTON_FONT_SIZE, GREEN);
+    DrawText(get_sculpt_text(sculpt_brush), 0, 0, BUTTON_FONT_SIZE, BLACK);
+
+    minimap.draw(Rectangle{
+        (float)(GetScreenWidth() - MINIMAP_SCREEN_SIZE - MINIMAP_SCREEN_MARGIN),
+        (float)(GetScreenHeight() - MINIMAP_SCREEN_SIZE -
+                MINIMAP_SCREEN_MARGIN),
+        (float)MINIMAP_SCREEN_SIZE, (float)MINIMAP_SCREEN_SIZE});
+    for (unsigned int idx = 0; idx < walkers->size(); ++idx) {
+      const Walker &walker = (*walkers)[idx];
+      if (controlled_walker_idx == idx) {
+        // Walkers face +x rotated by their rotation about y.
+        minimap.draw_heading(
+            walker.get_body_pos(),
+            get_rotation_matrix_about_y(walker.get_rotation()) *
+                Vector3{1.0F, 0.0F, 0.0F},
+            GREEN);
+        minimap.draw_marker(walker.get_body_pos(), GREEN);
+      } else {
+        minimap.draw_marker(walker.get_body_pos(), RED);
+      }
+    }
   }
 
   EndTextureMode();
@@ -449,26 +551,11 @@ bool TRunnerScreen::draw(RenderTexture *render_texture) {
     BeginTextureMode(fgRenderTexture);
     ClearBackground(Color{0, 0, 0, 0});
     BeginMode3D(camera);
-    for (unsigned int idx = 0; idx < SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT;
-         ++idx) {
-      int x = idx % SURFACE_UNIT_WIDTH;
-      int y = idx / SURFACE_UNIT_WIDTH;
-      int ox = x - SURFACE_UNIT_WIDTH / 2;
-      int oy = y - SURFACE_UNIT_HEIGHT / 2;
-      Color color = idx == idx_hit
-                        ? RAYWHITE
-                        : Color{(unsigned char)(200 + ox * 2),
-                                (unsigned char)(150 + oy * 2), 20, 255};
-
-      if (surface_reset_anim_timer < SURFACE_RESET_TIME_TRI_DRAW) {
-        unsigned char alpha =
-            ((1.0F - surface_reset_anim_timer / SURFACE_RESET_TIME_TRI_DRAW) *
-             255.0F);
-        surface_triangles->at(x * 2 + y * SURFACE_UNIT_WIDTH * 2)
-            .draw(Color{color.r, color.g, color.b, alpha});
-        surface_triangles->at(x * 2 + 1 + y * SURFACE_UNIT_WIDTH * 2)
-            .draw(Color{color.r, color.g, color.b, alpha});
-      }
+    if (surface_reset_anim_timer < SURFACE_RESET_TIME_TRI_DRAW) {
+      unsigned char alpha =
+          ((1.0F - surface_reset_anim_timer / SURFACE_RESET_TIME_TRI_DRAW) *
+           255.0F);
+      surface_shatter.draw(surface_reset_anim_timer, alpha);
     }
     EndMode3D();
 
@@ -525,6 +612,44 @@ Color TRunnerScreen::PixelToColor(Pixel p) {
   }
 }
 
+const char *TRunnerScreen::get_sculpt_text(std::optional<SurfaceBrush> brush) {
+  if (!brush.has_value()) {
+    return "Sculpt: Off";
+  }
+  switch (brush.value()) {
+    case SurfaceBrush::RAISE:
+      return "Sculpt: Raise";
+    case SurfaceBrush::LOWER:
+      return "Sculpt: Lower";
+    case SurfaceBrush::FLATTEN:
+      return "Sculpt: Flatten";
+  }
+  return "";
+}
+
+unsigned int TRunnerScreen::get_random_surface_seed() {
+  return (unsigned int)(call_js_get_random() * 65536.0F) << 16 |
+         (unsigned int)(call_js_get_random() * 65536.0F);
+}
+
+std::unique_ptr<Surface> TRunnerScreen::load_or_generate_surface(
+    const std::optional<std::string> &world_path, unsigned int width,
+    unsigned int height, std::size_t memory_budget) {
+  if (world_path.has_value()) {
+    std::optional<Surface> loaded =
+        Surface::load(world_path.value(), memory_budget);
+    if (loaded.has_value()) {
+      return std::make_unique<Surface>(std::move(loaded.value()));
+    }
+#ifndef NDEBUG
+    std::cout << "Failed to load world \"" << world_path.value()
+              << "\", generating a random surface.\n";
+#endif
+  }
+  return std::make_unique<Surface>(width, height, get_random_surface_seed(),
+                                   memory_budget, SURFACE_HEIGHT_FORMAT);
+}
+
 void TRunnerScreen::camera_to_targets(float dt) {
   camera.position.x +=
       (camera_pos.x - camera.position.x) * CAMERA_UPDATE_RATE * dt;
@@ -541,166 +666,69 @@ void TRunnerScreen::camera_to_targets(float dt) {
       (camera_target.z - camera.target.z) * CAMERA_UPDATE_RATE * dt;
 }
 
-void TRunnerScreen::generate_surface() {
-  for (auto &su : *surface) {
-    su = std::nullopt;
-  }
+void TRunnerScreen::start_surface_reset() {
 #ifndef NDEBUG
   std::cout << "Initializing surface...\n";
 #endif
-  std::queue<unsigned int> to_update;
-  to_update.push(SURFACE_UNIT_WIDTH / 2 +
-                 (SURFACE_UNIT_HEIGHT / 2) * SURFACE_UNIT_WIDTH);
-  while (!to_update.empty()) {
-    unsigned int idx = to_update.front();
-    to_update.pop();
-    if (surface->at(idx).has_value()) {
-      continue;
-    }
-    SurfaceUnit current{0.0F, 0.0F, 0.0F, 0.0F};
-    // 0000 0001 - nw set
-    // 0000 0010 - ne set
-    // 0000 0100 - sw set
-    // 0000 1000 - se set
-    unsigned char flags = 0;
-
-    // Check adjacent.
-    if (idx % SURFACE_UNIT_WIDTH > 0) {
-      if (surface->at(idx - 1).has_value()) {
-        if ((flags & 1) == 0) {
-          current.nw = surface->at(idx - 1).value().ne;
-          flags |= 1;
-        }
-        if ((flags & 4) == 0) {
-          current.sw = surface->at(idx - 1).value().se;
-          flags |= 4;
-        }
-      } else {
-        to_update.push(idx - 1);
-      }
-    }
-    if (idx % SURFACE_UNIT_WIDTH < SURFACE_UNIT_WIDTH - 1) {
-      if (surface->at(idx + 1).has_value()) {
-        if ((flags & 2) == 0) {
-          current.ne = surface->at(idx + 1).value().nw;
-          flags |= 2;
-        }
-        if ((flags & 8) == 0) {
-          current.se = surface->at(idx + 1).value().sw;
-          flags |= 8;
-        }
-      } else {
-        to_update.push(idx + 1);
-      }
-    }
-    if (idx / SURFACE_UNIT_WIDTH > 0) {
-      if (surface->at(idx - SURFACE_UNIT_WIDTH).has_value()) {
-        if ((flags & 1) == 0) {
-          current.nw = surface->at(idx - SURFACE_UNIT_WIDTH).value().sw;
-          flags |= 1;
-        }
-        if ((flags & 2) == 0) {
-          current.ne = surface->at(idx - SURFACE_UNIT_WIDTH).value().se;
-          flags |= 2;
-        }
-      } else {
-        to_update.push(idx - SURFACE_UNIT_WIDTH);
-      }
-    }
-    if (idx / SURFACE_UNIT_WIDTH < SURFACE_UNIT_HEIGHT - 1) {
-      if (surface->at(idx + SURFACE_UNIT_WIDTH).has_value()) {
-        if ((flags & 4) == 0) {
-          current.sw = surface->at(idx + SURFACE_UNIT_WIDTH).value().nw;
-          flags |= 4;
-        }
-        if ((flags & 8) == 0) {
-          current.se = surface->at(idx + SURFACE_UNIT_WIDTH).value().ne;
-          flags |= 8;
-        }
-      } else {
-        to_update.push(idx + SURFACE_UNIT_WIDTH);
-      }
-    }
-
-    // Calculate remaining values.
-    float avg = 0.0F;
-    unsigned int count = 0;
-    if ((flags & 1) != 0) {
-      avg += current.nw;
-      ++count;
-    }
-    if ((flags & 2) != 0) {
-      avg += current.ne;
-      ++count;
-    }
-    if ((flags & 4) != 0) {
-      avg += current.sw;
-      ++count;
-    }
-    if ((flags & 8) != 0) {
-      avg += current.se;
-      ++count;
-    }
-    if (count != 0) {
-      avg = avg / (float)count;
-    }
-
-    if ((flags & 1) == 0) {
-      current.nw = avg + call_js_get_random() * SURFACE_HEIGHT_INTERVAL -
-                   SURFACE_HEIGHT_INTERVAL / 2.0F;
-    }
-    if ((flags & 2) == 0) {
-      current.ne = avg + call_js_get_random() * SURFACE_HEIGHT_INTERVAL -
-                   SURFACE_HEIGHT_INTERVAL / 2.0F;
-    }
-    if ((flags & 4) == 0) {
-      current.sw = avg + call_js_get_random() * SURFACE_HEIGHT_INTERVAL -
-                   SURFACE_HEIGHT_INTERVAL / 2.0F;
-    }
-    if ((flags & 8) == 0) {
-      current.se = avg + call_js_get_random() * SURFACE_HEIGHT_INTERVAL -
-                   SURFACE_HEIGHT_INTERVAL / 2.0F;
-    }
-
-    surface->at(idx) = current;
-
-    // Calculate bounding boxes.
-    int x = idx % SURFACE_UNIT_WIDTH;
-    int y = idx / SURFACE_UNIT_WIDTH;
-    float xf = (float)(x)-SURFACE_X_OFFSET;
-    float zf = (float)(y)-SURFACE_Y_OFFSET;
-    surface_bbs->at(idx).min.x = xf - 0.5F;
-    surface_bbs->at(idx).min.z = zf - 0.5F;
-    surface_bbs->at(idx).max.x = xf + 0.5F;
-    surface_bbs->at(idx).max.z = zf + 0.5F;
-
-    surface_bbs->at(idx).min.y = current.nw;
-    if (current.ne < surface_bbs->at(idx).min.y) {
-      surface_bbs->at(idx).min.y = current.ne;
-    }
-    if (current.sw < surface_bbs->at(idx).min.y) {
-      surface_bbs->at(idx).min.y = current.sw;
-    }
-    if (current.se < surface_bbs->at(idx).min.y) {
-      surface_bbs->at(idx).min.y = current.se;
-    }
+  std::vector<Vector3> focus_points{camera.target};
+  if (controlled_walker_idx.has_value()) {
+    focus_points.push_back(
+        (*walkers)[controlled_walker_idx.value()].get_body_pos());
+  }
+  // Chunks are generated from the new seed, or mapped again from the world
+  // file so that its pristine heights are restored. Random values are drawn
+  // here since call_js_get_random() may only be called on this thread.
+  surface_reset = std::make_unique<SurfaceReset>(
+      *surface,
+      load_or_generate_surface(world_path, surface->get_width(),
+                               surface->get_height(),
+                               surface->get_memory_budget()),
+      focus_points, SURFACE_RESIDENT_RADIUS, get_random_surface_seed(),
+      idx_hit, surface_shatter.is_gpu_animated(),
+      surface_shatter.take_triangles());
+#ifndef __EMSCRIPTEN__
+  surface_reset_future = std::async(
+      std::launch::async, [reset = surface_reset.get()]() { reset->run(); });
+#endif
+}
 
-    surface_bbs->at(idx).max.y = current.nw;
-    if (current.ne > surface_bbs->at(idx).max.y) {
-      surface_bbs->at(idx).max.y = current.ne;
-    }
-    if (current.sw > surface_bbs->at(idx).max.y) {
-      surface_bbs->at(idx).max.y = current.sw;
-    }
-    if (current.se > surface_bbs->at(idx).max.y) {
-      surface_bbs->at(idx).max.y = current.se;
-    }
+bool TRunnerScreen::finish_surface_reset() {
+#ifdef __EMSCRIPTEN__
+  // No threads, so the reset is prepared a slice per frame.
+  if (!surface_reset->step(SURFACE_RESET_SLICE_TIME)) {
+    return false;
   }
+#else
+  if (surface_reset_future.wait_for(std::chrono::seconds(0)) !=
+      std::future_status::ready) {
+    return false;
+  }
+  surface_reset_future.get();
+#endif
+  surface = surface_reset->take_surface();
+  // The colors and mesh arrays were prepared with the triangles, only the
+  // upload is left for this frame.
+  surface_shatter.load(surface_reset->take_triangles(),
+                       surface_reset->take_mesh());
+  surface_reset.reset();
+  surface_renderer.clear();
+  minimap.clear();
+  flow_fields.clear();
+  return true;
 }
 
-void TRunnerScreen::generate_surface_with_triangles() {
-  surface_triangles = surface_to_triangles(*surface, SURFACE_UNIT_WIDTH);
-  generate_surface();
-  surface_reset_anim_timer = 0.0F;
-  flags.set(0);
+void TRunnerScreen::update_surface_residency() {
+  std::vector<SurfaceFocus> focus{
+      SurfaceFocus{.point = camera.target, .radius = SURFACE_RESIDENT_RADIUS}};
+  focus.reserve(walkers->size() + 2);
+  if (controlled_walker_idx.has_value()) {
+    focus.push_back(SurfaceFocus{
+        .point = (*walkers)[controlled_walker_idx.value()].get_body_pos(),
+        .radius = SURFACE_RESIDENT_RADIUS});
+  }
+  for (const Walker &walker : *walkers) {
+    focus.push_back(SurfaceFocus{.point = walker.get_body_pos(),
+                                 .radius = WALKER_RESIDENT_RADIUS});
+  }
+  surface->update_residency(focus);
 }
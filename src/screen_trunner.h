@@ -4,10 +4,12 @@
 #include "screen.h"
 
 // standard library includes
-#include <array>
 #include <bitset>
+#include <future>
 #include <memory>
 #include <optional>
+#include <string>
+#include <vector>
 
 // third party includes
 #include <raylib.h>
@@ -15,20 +17,53 @@
 // local includes
 #include "common_constants.h"
 #include "electricity_effect.h"
+#include "flow_field.h"
+#include "minimap.h"
 #include "spark_effect.h"
+#include "surface.h"
+#include "surface_renderer.h"
+#include "surface_reset.h"
+#include "surface_shatter.h"
 #include "surface_triangle.h"
 #include "walker.h"
+#include "walker_renderer.h"
 
 constexpr float POS_VALUE_INC_RATE = 0.2F;
 constexpr float CAMERA_UPDATE_RATE = 1.0F;
 
-constexpr float SURFACE_HEIGHT_INTERVAL = 0.7F;
+// Surface chunks within this distance of the camera target or the controlled
+// walker are kept loaded.
+constexpr float SURFACE_RESIDENT_RADIUS = 96.0F;
+
+// Walkers are spread over the surface on a grid. Chunks within
+// WALKER_RESIDENT_RADIUS of each walker stay loaded, so that walkers updated
+// in parallel only read resident chunks.
+constexpr unsigned int WALKER_COUNT = 4;
+constexpr float WALKER_RESIDENT_RADIUS = 4.0F;
+
+// Generated surfaces store heights quantized to halve their memory.
+constexpr SurfaceHeightFormat SURFACE_HEIGHT_FORMAT =
+    SurfaceHeightFormat::UNORM16;
 
 constexpr int BUTTON_FONT_SIZE = 30;
 
+// Holding the mouse on the surface with a sculpt brush selected deforms it
+// around the mouse, raising or lowering by SCULPT_RATE units per second and
+// flattening SCULPT_FLATTEN_RATE of the way per second.
+constexpr float SCULPT_RADIUS = 4.0F;
+constexpr float SCULPT_RATE = 2.0F;
+constexpr float SCULPT_FLATTEN_RATE = 2.0F;
+
+// The minimap fits in a square of this many pixels in the bottom right corner.
+constexpr int MINIMAP_SCREEN_SIZE = 160;
+constexpr int MINIMAP_SCREEN_MARGIN = 8;
+
 constexpr float SURFACE_RESET_TIME = 4.0F;
 constexpr float SURFACE_RESET_TIME_TRI_DRAW = 3.0F;
 constexpr float SURFACE_RESET_Y_OFFSET = 40.0F;
+// Without threads the next surface is prepared in slices of this many seconds
+// per frame.
+constexpr double SURFACE_RESET_SLICE_TIME = 0.004;
 
 constexpr int ELECTRICITY_EFFECT_LINE_COUNT = 35;
 constexpr float ELECTRICITY_EFFECT_RADIUS = 2.0F;
@@ -41,11 +76,14 @@ constexpr float SPARK_EFFECT_LIFETIME = ELECTRICITY_EFFECT_LIFETIME;
 
 class TRunnerScreen : public Screen {
  public:
-  struct SurfaceUnit {
-    float nw, ne, sw, se;
-  };
-
   TRunnerScreen(std::weak_ptr<ScreenStack> stack);
+  /// Plays on the world file at world_path, also when the surface is reset.
+  /// Falls back to a random surface if the file can't be loaded.
+  TRunnerScreen(std::weak_ptr<ScreenStack> stack,
+                std::optional<std::string> world_path);
+  TRunnerScreen(std::weak_ptr<ScreenStack> stack, unsigned int surface_width,
+                unsigned int surface_height,
+                std::optional<std::string> world_path = std::nullopt);
   ~TRunnerScreen() override;
 
   bool update(float dt, bool is_resized) override;
@@ -69,15 +107,21 @@ class TRunnerScreen : public Screen {
   };
 
   static Color PixelToColor(Pixel p);
-
-  using SurfaceArrT = std::array<std::optional<SurfaceUnit>,
-                                 SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT>;
-  std::unique_ptr<SurfaceArrT> surface;
-  using SurfaceBBsArrT =
-      std::array<BoundingBox, SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT>;
-  std::unique_ptr<SurfaceBBsArrT> surface_bbs;
-  using WalkersArrT = std::array<Walker, 4>;
+  static const char *get_sculpt_text(std::optional<SurfaceBrush> brush);
+  static unsigned int get_random_surface_seed();
+  /// Loads the world file at world_path if given, otherwise or if it can't be
+  /// loaded generates a surface from a random seed.
+  static std::unique_ptr<Surface> load_or_generate_surface(
+      const std::optional<std::string> &world_path, unsigned int width,
+      unsigned int height, std::size_t memory_budget);
+
+  const std::optional<std::string> world_path;
+  std::unique_ptr<Surface> surface;
+  using WalkersArrT = std::vector<Walker>;
   std::unique_ptr<WalkersArrT> walkers;
+  unsigned int walker_thread_count;
+  /// Shared by the roaming walkers, invalidated wherever the surface changes.
+  FlowFieldCache flow_fields;
 
   Camera3D camera;
   /*
@@ -90,26 +134,42 @@ class TRunnerScreen : public Screen {
   Matrix TEMP_matrix;
   RenderTexture2D bgRenderTexture;
   RenderTexture2D fgRenderTexture;
+  SurfaceRenderer surface_renderer;
+  Minimap minimap;
+  WalkerRenderer walker_renderer;
   Vector3 camera_pos;
   Vector3 camera_target;
   Vector3 mouse_hit;
-  std::unique_ptr<std::array<SurfaceTriangle,
-                             SURFACE_UNIT_WIDTH * SURFACE_UNIT_HEIGHT * 2> >
-      surface_triangles;
+  SurfaceShatter surface_shatter;
   std::vector<ElectricityEffect> electricityEffects;
   std::vector<SparkEffect> sparkEffects;
   unsigned int idx_hit;
+  /// Unit under the mouse, surface->size() if none.
+  std::size_t idx_hover;
   std::optional<unsigned int> controlled_walker_idx;
+  /// Brush used while the mouse is held on the surface, none if not
+  /// sculpting.
+  std::optional<SurfaceBrush> sculpt_brush;
   const int left_text_width;
   const int right_text_width;
   const int forward_text_width;
   const int reset_surface_text_width;
+  const int sculpt_text_width;
   float surface_reset_anim_timer;
   bool walker_hack_success;
+  /// Reset in preparation, swapped in by update() once done.
+  std::unique_ptr<SurfaceReset> surface_reset;
+  /// Done once a worker thread finished preparing surface_reset, waits for it
+  /// on destruction so it's declared after surface_reset.
+  std::future<void> surface_reset_future;
 
   void camera_to_targets(float dt);
-  void generate_surface();
-  void generate_surface_with_triangles();
+  /// Starts preparing the next surface and the shatter triangles of the
+  /// current one.
+  void start_surface_reset();
+  /// True once the prepared reset was swapped in.
+  bool finish_surface_reset();
+  void update_surface_residency();
 };
 
 #endif
@@ -34,7 +34,12 @@ int SparkEffect::uniform_spark_pos = 0;
 
 SparkEffect::SparkEffect(int count, float lifetime, Vector3 pos,
                          float pos_xz_variance, float radius, Color color)
-    : sparks(), color(color), lifetime(lifetime), timer(0.0F) {
+    : sparks(),
+      bounds_center(pos),
+      color(color),
+      bounds_radius(0.0F),
+      lifetime(lifetime),
+      timer(0.0F) {
   sparks.reserve(count);
 
   Vector3 above_pos = pos;
@@ -51,6 +56,8 @@ SparkEffect::SparkEffect(int count, float lifetime, Vector3 pos,
             (SPARK_VEL_RATE + call_js_get_random() * SPARK_VEL_VARIANCE * 2.0F -
              SPARK_VEL_VARIANCE)});
   }
+
+  update_bounds();
 }
 
 bool SparkEffect::update(float dt) {
@@ -61,6 +68,8 @@ bool SparkEffect::update(float dt) {
     spark.pos = spark.pos + spark.vel * dt;
   }
 
+  update_bounds();
+
   return timer > lifetime;
 }
 
@@ -85,6 +94,25 @@ void SparkEffect::draw(Camera *camera) {
   }
 }
 
+Vector3 SparkEffect::get_center() const { return bounds_center; }
+
+float SparkEffect::get_bounding_radius() const { return bounds_radius; }
+
+void SparkEffect::update_bounds() {
+  if (sparks.empty()) {
+    bounds_radius = 0.0F;
+    return;
+  }
+  Vector3 min = sparks[0].pos;
+  Vector3 max = sparks[0].pos;
+  for (const auto &spark : sparks) {
+    min = Vector3Min(min, spark.pos);
+    max = Vector3Max(max, spark.pos);
+  }
+  bounds_center = (min + max) * 0.5F;
+  bounds_radius = Vector3Distance(min, max) / 2.0F + SPARK_RADIUS;
+}
+
 Shader SparkEffect::get_shader() {
   if (!shader.has_value()) {
     init_shader();
@@ -24,6 +24,10 @@ class SparkEffect {
   /// Assumes draw mode is active when called.
   void draw(Camera *camera);
 
+  /// Bounding sphere of the sparks, updated by update().
+  Vector3 get_center() const;
+  float get_bounding_radius() const;
+
   static Shader get_shader();
   static void cleanup_shader();
   static void update_shader_height();
@@ -38,10 +42,13 @@ class SparkEffect {
   static int uniform_spark_radius;
   static int uniform_spark_pos;
   std::vector<Spark> sparks;
+  Vector3 bounds_center;
   Color color;
+  float bounds_radius;
   float lifetime;
   float timer;
 
+  void update_bounds();
   static void update_shader_uniforms(float radius, Vector2 pos);
   static void init_shader();
 };
@@ -0,0 +1,1109 @@
+#include "surface.h"
+
+// standard library includes
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#ifndef NDEBUG
+#include <iostream>
+#endif
+
+// local includes
+#include "parallel.h"
+#include "surface_noise.h"
+
+namespace {
+
+// Quantized chunks grown by deform() get this much extra range.
+constexpr float SURFACE_DEFORM_HEADROOM = 1.0F;
+
+/*
+ * Surface file format, all values are little-endian:
+ *
+ * - SurfaceFileHeader.
+ * - A SurfaceFileChunk for every chunk, in the order of chunk indices.
+ * - The data of every chunk, starting at a multiple of
+ *   SURFACE_FILE_ALIGNMENT: (width + 1) * (height + 1) vertices followed by
+ *   width * height unit y ranges, laid out the same as in Surface::Chunk.
+ *   Heights are floats or 16-bit integers depending on the header's
+ *   height_format, for UNORM16 the chunk's min_y and max_y are its
+ *   quantization range.
+ *
+ * Chunks of a loaded file point at their data in the mapping, so a file can
+ * only be loaded on a little-endian host.
+ */
+constexpr char SURFACE_FILE_MAGIC[8] = {'J', 'A', 'D', '0', 'S', 'U', 'R', 'F'};
+constexpr std::uint32_t SURFACE_FILE_VERSION = 2;
+constexpr std::size_t SURFACE_FILE_ALIGNMENT = 64;
+
+struct SurfaceFileHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t seed;
+  std::uint32_t chunk_size;
+  std::uint32_t chunk_count;
+  SurfaceHeightFormat height_format;
+  std::uint32_t reserved;
+};
+static_assert(sizeof(SurfaceFileHeader) == 40);
+
+struct SurfaceFileChunk {
+  /// Offset of the chunk's data from the start of the file.
+  std::uint64_t offset;
+  float min_y;
+  float max_y;
+};
+static_assert(sizeof(SurfaceFileChunk) == 16);
+static_assert(sizeof(SurfaceFileHeader) % alignof(SurfaceFileChunk) == 0);
+
+std::size_t get_chunk_vertex_count(const Surface::Chunk &chunk) {
+  return (std::size_t)(chunk.width + 1) * (chunk.height + 1);
+}
+
+std::size_t get_chunk_range_count(const Surface::Chunk &chunk) {
+  return (std::size_t)chunk.width * chunk.height * 2;
+}
+
+std::size_t get_height_size(SurfaceHeightFormat format) {
+  return format == SurfaceHeightFormat::UNORM16 ? sizeof(std::uint16_t)
+                                                : sizeof(float);
+}
+
+float get_y_step(float min_y, float max_y) {
+  return (max_y - min_y) / 65535.0F;
+}
+
+/// Works on floats and quantized heights alike, quantization keeps the order
+/// of heights.
+template <typename T>
+void update_unit_y_range(const T *vertices, T *unit_y_ranges,
+                         unsigned int width, unsigned int ux,
+                         unsigned int uy) {
+  const std::size_t nw_idx = ux + (std::size_t)uy * (width + 1);
+  const T nw = vertices[nw_idx];
+  const T ne = vertices[nw_idx + 1];
+  const T sw = vertices[nw_idx + width + 1];
+  const T se = vertices[nw_idx + width + 2];
+  const std::size_t range_idx = (ux + (std::size_t)uy * width) * 2;
+  unit_y_ranges[range_idx] = std::min(std::min(nw, ne), std::min(sw, se));
+  unit_y_ranges[range_idx + 1] = std::max(std::max(nw, ne), std::max(sw, se));
+}
+
+/// Quantizes heights into the chunk's range and updates the unit y ranges.
+void quantize_chunk(Surface::Chunk &chunk, const float *heights) {
+  chunk.y_step = get_y_step(chunk.min_y, chunk.max_y);
+  const std::size_t vertex_count = get_chunk_vertex_count(chunk);
+  for (std::size_t idx = 0; idx < vertex_count; ++idx) {
+    chunk.quantized_vertices[idx] = chunk.quantize(heights[idx]);
+  }
+  for (unsigned int uy = 0; uy < chunk.height; ++uy) {
+    for (unsigned int ux = 0; ux < chunk.width; ++ux) {
+      update_unit_y_range(chunk.quantized_vertices,
+                          chunk.quantized_unit_y_ranges, chunk.width, ux, uy);
+    }
+  }
+}
+
+/// Same for heights whose unit y ranges are already known, quantization keeps
+/// the order of heights so the quantized ranges are those of the vertices.
+void quantize_chunk(Surface::Chunk &chunk, const float *heights,
+                    const float *unit_y_ranges) {
+  chunk.y_step = get_y_step(chunk.min_y, chunk.max_y);
+  const std::size_t vertex_count = get_chunk_vertex_count(chunk);
+  for (std::size_t idx = 0; idx < vertex_count; ++idx) {
+    chunk.quantized_vertices[idx] = chunk.quantize(heights[idx]);
+  }
+  const std::size_t range_count = get_chunk_range_count(chunk);
+  for (std::size_t idx = 0; idx < range_count; ++idx) {
+    chunk.quantized_unit_y_ranges[idx] = chunk.quantize(unit_y_ranges[idx]);
+  }
+}
+
+constexpr unsigned int get_pyramid_level_count() {
+  unsigned int count = 1;
+  for (unsigned int size = SURFACE_PYRAMID_LEAF_SIZE; size < SURFACE_CHUNK_SIZE;
+       size *= 2) {
+    ++count;
+  }
+  return count;
+}
+
+constexpr unsigned int SURFACE_PYRAMID_LEVELS = get_pyramid_level_count();
+
+unsigned int get_pyramid_columns(const Surface::Chunk &chunk,
+                                 unsigned int level) {
+  const unsigned int size = SURFACE_PYRAMID_LEAF_SIZE << level;
+  return (chunk.width + size - 1) / size;
+}
+
+unsigned int get_pyramid_rows(const Surface::Chunk &chunk, unsigned int level) {
+  const unsigned int size = SURFACE_PYRAMID_LEAF_SIZE << level;
+  return (chunk.height + size - 1) / size;
+}
+
+/// Index of the first float of the level in Chunk::pyramid.
+std::size_t get_pyramid_offset(const Surface::Chunk &chunk,
+                               unsigned int level) {
+  std::size_t offset = 0;
+  for (unsigned int idx = 0; idx < level; ++idx) {
+    offset += (std::size_t)get_pyramid_columns(chunk, idx) *
+              get_pyramid_rows(chunk, idx) * 2;
+  }
+  return offset;
+}
+
+/// Updates the pyramid blocks covering the chunk's units [x_min, x_max] x
+/// [y_min, y_max], from the finest level up.
+void update_pyramid(Surface::Chunk &chunk, unsigned int x_min,
+                    unsigned int y_min, unsigned int x_max,
+                    unsigned int y_max) {
+  if (chunk.pyramid.empty()) {
+    chunk.pyramid.resize(get_pyramid_offset(chunk, SURFACE_PYRAMID_LEVELS));
+  }
+  for (unsigned int level = 0; level < SURFACE_PYRAMID_LEVELS; ++level) {
+    const unsigned int size = SURFACE_PYRAMID_LEAF_SIZE << level;
+    const unsigned int columns = get_pyramid_columns(chunk, level);
+    float *ranges = chunk.pyramid.data() + get_pyramid_offset(chunk, level);
+    for (unsigned int by = y_min / size; by <= y_max / size; ++by) {
+      for (unsigned int bx = x_min / size; bx <= x_max / size; ++bx) {
+        float min_y = INFINITY;
+        float max_y = -INFINITY;
+        if (level == 0) {
+          for (unsigned int uy = by * size;
+               uy < std::min((by + 1) * size, chunk.height); ++uy) {
+            for (unsigned int ux = bx * size;
+                 ux < std::min((bx + 1) * size, chunk.width); ++ux) {
+              const std::size_t unit_idx = ux + (std::size_t)uy * chunk.width;
+              min_y = std::min(min_y, chunk.get_unit_min_y(unit_idx));
+              max_y = std::max(max_y, chunk.get_unit_max_y(unit_idx));
+            }
+          }
+        } else {
+          const unsigned int child_columns =
+              get_pyramid_columns(chunk, level - 1);
+          const unsigned int child_rows = get_pyramid_rows(chunk, level - 1);
+          const float *child_ranges =
+              chunk.pyramid.data() + get_pyramid_offset(chunk, level - 1);
+          for (unsigned int cy = by * 2; cy < std::min(by * 2 + 2, child_rows);
+               ++cy) {
+            for (unsigned int cx = bx * 2;
+                 cx < std::min(bx * 2 + 2, child_columns); ++cx) {
+              const float *child =
+                  child_ranges + (cx + (std::size_t)cy * child_columns) * 2;
+              min_y = std::min(min_y, child[0]);
+              max_y = std::max(max_y, child[1]);
+            }
+          }
+        }
+        ranges[(bx + (std::size_t)by * columns) * 2] = min_y;
+        ranges[(bx + (std::size_t)by * columns) * 2 + 1] = max_y;
+      }
+    }
+  }
+}
+
+void build_pyramid(Surface::Chunk &chunk) {
+  update_pyramid(chunk, 0, 0, chunk.width - 1, chunk.height - 1);
+}
+
+/// Narrows [t0, t1] to where origin + dir * t is within [lo, hi], false if
+/// that is empty.
+bool clip_ray_axis(float origin, float dir, float lo, float hi, float &t0,
+                   float &t1) {
+  if (dir == 0.0F) {
+    return origin >= lo && origin <= hi;
+  }
+  const float ta = (lo - origin) / dir;
+  const float tb = (hi - origin) / dir;
+  t0 = std::max(t0, std::min(ta, tb));
+  t1 = std::min(t1, std::max(ta, tb));
+  return t0 <= t1;
+}
+
+const SurfaceFileChunk *get_file_chunks(const MappedFile &file) {
+  return (const SurfaceFileChunk *)(file.get_data() +
+                                    sizeof(SurfaceFileHeader));
+}
+
+/// Height at (u, v) within the unit, on its triangles nw-sw-ne and ne-sw-se.
+float get_unit_height(const SurfaceUnit &unit, float u, float v) {
+  if (u + v <= 1.0F) {
+    return unit.nw + (unit.ne - unit.nw) * u + (unit.sw - unit.nw) * v;
+  }
+  return unit.se + (unit.sw - unit.se) * (1.0F - u) +
+         (unit.ne - unit.se) * (1.0F - v);
+}
+
+}  // namespace
+
+Surface::Surface(unsigned int width, unsigned int height, unsigned int seed,
+                 std::size_t memory_budget, SurfaceHeightFormat format)
+    : file(),
+      chunks(),
+      resident_count(0),
+      next_version(1),
+      memory_budget(memory_budget),
+      tick(0),
+      width(width),
+      height(height),
+      chunk_columns((width + SURFACE_CHUNK_SIZE - 1) / SURFACE_CHUNK_SIZE),
+      chunk_rows((height + SURFACE_CHUNK_SIZE - 1) / SURFACE_CHUNK_SIZE),
+      seed(seed),
+      thread_count(get_default_thread_count()),
+      format(format) {
+  assert(width > 0 && height > 0 && "Surface must not be empty!");
+  chunks.resize((std::size_t)chunk_columns * chunk_rows);
+}
+
+bool Surface::save(const std::string &path) const {
+  if constexpr (std::endian::native != std::endian::little) {
+    return false;
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+
+  SurfaceFileHeader header{};
+  std::memcpy(header.magic, SURFACE_FILE_MAGIC, sizeof(header.magic));
+  header.version = SURFACE_FILE_VERSION;
+  header.width = width;
+  header.height = height;
+  header.seed = seed;
+  header.chunk_size = SURFACE_CHUNK_SIZE;
+  header.chunk_count = (std::uint32_t)chunks.size();
+  header.height_format = format;
+  out.write((const char *)&header, sizeof(header));
+
+  // The table is written once all chunks are, their min and max y are only
+  // known after a chunk is generated. Chunks that aren't resident are only
+  // created for the duration of their write, so saving doesn't change what is
+  // resident.
+  std::vector<SurfaceFileChunk> table(chunks.size());
+  out.write((const char *)table.data(),
+            (std::streamsize)(table.size() * sizeof(SurfaceFileChunk)));
+  const std::array<char, SURFACE_FILE_ALIGNMENT> padding{};
+  const std::size_t height_size = get_height_size(format);
+  for (std::size_t idx = 0; idx < chunks.size(); ++idx) {
+    std::unique_ptr<Chunk> temporary;
+    if (!chunks[idx]) {
+      temporary = create_chunk(idx);
+      if (!file) {
+        generate_chunk(*temporary);
+      }
+    }
+    const Chunk &chunk = chunks[idx] ? *chunks[idx] : *temporary;
+
+    const std::size_t offset = (std::size_t)out.tellp();
+    const std::size_t padding_size =
+        (SURFACE_FILE_ALIGNMENT - offset % SURFACE_FILE_ALIGNMENT) %
+        SURFACE_FILE_ALIGNMENT;
+    out.write(padding.data(), (std::streamsize)padding_size);
+    table[idx] = SurfaceFileChunk{.offset = offset + padding_size,
+                                  .min_y = chunk.min_y,
+                                  .max_y = chunk.max_y};
+    if (format == SurfaceHeightFormat::UNORM16) {
+      out.write((const char *)chunk.quantized_vertices,
+                (std::streamsize)(get_chunk_vertex_count(chunk) * height_size));
+      out.write((const char *)chunk.quantized_unit_y_ranges,
+                (std::streamsize)(get_chunk_range_count(chunk) * height_size));
+    } else {
+      out.write((const char *)chunk.vertices,
+                (std::streamsize)(get_chunk_vertex_count(chunk) * height_size));
+      out.write((const char *)chunk.unit_y_ranges,
+                (std::streamsize)(get_chunk_range_count(chunk) * height_size));
+    }
+  }
+  out.seekp(sizeof(SurfaceFileHeader));
+  out.write((const char *)table.data(),
+            (std::streamsize)(table.size() * sizeof(SurfaceFileChunk)));
+
+  out.close();
+  return (bool)out;
+}
+
+std::optional<Surface> Surface::load(const std::string &path,
+                                     std::size_t memory_budget) {
+  if constexpr (std::endian::native != std::endian::little) {
+    return std::nullopt;
+  }
+
+  std::unique_ptr<MappedFile> file = MappedFile::open(path);
+  if (!file || file->get_size() < sizeof(SurfaceFileHeader)) {
+    return std::nullopt;
+  }
+
+  // Only the header and chunk table are validated, the heights are used as
+  // they are in the file.
+  SurfaceFileHeader header;
+  std::memcpy(&header, file->get_data(), sizeof(header));
+  if (std::memcmp(header.magic, SURFACE_FILE_MAGIC, sizeof(header.magic)) !=
+          0 ||
+      header.version != SURFACE_FILE_VERSION || header.width == 0 ||
+      header.height == 0 || header.chunk_size != SURFACE_CHUNK_SIZE ||
+      (header.height_format != SurfaceHeightFormat::FLOAT32 &&
+       header.height_format != SurfaceHeightFormat::UNORM16)) {
+#ifndef NDEBUG
+    std::cout << "Surface: \"" << path << "\" is not a surface file\n";
+#endif
+    return std::nullopt;
+  }
+
+  // Checked before the surface's chunk table is sized from the header, so a
+  // corrupt size can't make it allocate more than the file could describe.
+  const std::uint64_t chunk_count =
+      (((std::uint64_t)header.width + SURFACE_CHUNK_SIZE - 1) /
+       SURFACE_CHUNK_SIZE) *
+      (((std::uint64_t)header.height + SURFACE_CHUNK_SIZE - 1) /
+       SURFACE_CHUNK_SIZE);
+  if (header.chunk_count != chunk_count ||
+      chunk_count > (file->get_size() - sizeof(SurfaceFileHeader)) /
+                        sizeof(SurfaceFileChunk)) {
+#ifndef NDEBUG
+    std::cout << "Surface: \"" << path << "\" has a truncated chunk table\n";
+#endif
+    return std::nullopt;
+  }
+
+  Surface surface(header.width, header.height, header.seed, memory_budget,
+                  header.height_format);
+  surface.file = std::move(file);
+
+  const SurfaceFileChunk *table = get_file_chunks(*surface.file);
+  for (std::size_t idx = 0; idx < surface.chunks.size(); ++idx) {
+    const unsigned int chunk_width = std::min(
+        SURFACE_CHUNK_SIZE,
+        header.width - (unsigned int)(idx % surface.chunk_columns) *
+                           SURFACE_CHUNK_SIZE);
+    const unsigned int chunk_height = std::min(
+        SURFACE_CHUNK_SIZE,
+        header.height - (unsigned int)(idx / surface.chunk_columns) *
+                            SURFACE_CHUNK_SIZE);
+    const std::size_t height_size = get_height_size(header.height_format);
+    const std::size_t chunk_size =
+        ((std::size_t)(chunk_width + 1) * (chunk_height + 1) +
+         (std::size_t)chunk_width * chunk_height * 2) *
+        height_size;
+    if (table[idx].offset % height_size != 0 ||
+        table[idx].offset > surface.file->get_size() ||
+        surface.file->get_size() - table[idx].offset < chunk_size) {
+      return std::nullopt;
+    }
+  }
+
+#ifndef NDEBUG
+  std::cout << "Surface: mapped \"" << path << "\", "
+            << surface.file->get_size() << " bytes\n";
+#endif
+  return surface;
+}
+
+SurfaceUnit Surface::at(std::size_t idx) const {
+  assert(idx < size() && "Surface unit index out of range!");
+  return (*this)[idx];
+}
+
+void Surface::set_vertex(unsigned int x, unsigned int y, float height) {
+  assert(x <= width && y <= this->height && "Vertex out of range!");
+  // A vertex on a chunk's edge is shared with up to three other chunks, all of
+  // them are loaded and updated.
+  const unsigned int cx_max =
+      std::min(x / SURFACE_CHUNK_SIZE, chunk_columns - 1);
+  const unsigned int cy_max = std::min(y / SURFACE_CHUNK_SIZE, chunk_rows - 1);
+  const unsigned int cx_min = cx_max > 0 && x % SURFACE_CHUNK_SIZE == 0 &&
+                                      x < width
+                                  ? cx_max - 1
+                                  : cx_max;
+  const unsigned int cy_min = cy_max > 0 && y % SURFACE_CHUNK_SIZE == 0 &&
+                                      y < this->height
+                                  ? cy_max - 1
+                                  : cy_max;
+  for (unsigned int cy = cy_min; cy <= cy_max; ++cy) {
+    for (unsigned int cx = cx_min; cx <= cx_max; ++cx) {
+      write_chunk_vertices(get_chunk_mut(cx + (std::size_t)cy * chunk_columns),
+                           SurfaceRect{x, y, x, y}, &height, 0.0F);
+    }
+  }
+}
+
+std::optional<SurfaceRect> Surface::deform(float x, float z, float radius,
+                                           float amount, SurfaceBrush brush) {
+  // In grid space vertex (vx, vy) is at (vx, vy), same as for pick().
+  const float gx = x + get_x_offset() + 0.5F;
+  const float gz = z + get_y_offset() + 0.5F;
+  const float vx_min = std::max(std::ceil(gx - radius), 0.0F);
+  const float vy_min = std::max(std::ceil(gz - radius), 0.0F);
+  const float vx_max = std::min(std::floor(gx + radius), (float)width);
+  const float vy_max = std::min(std::floor(gz + radius), (float)height);
+  if (!(radius > 0.0F) || vx_min > vx_max || vy_min > vy_max) {
+    return std::nullopt;
+  }
+  const SurfaceRect rect{(unsigned int)vx_min, (unsigned int)vy_min,
+                         (unsigned int)vx_max, (unsigned int)vy_max};
+
+  // The brush's center may be off the surface, flatten towards the nearest
+  // height on it.
+  const float target =
+      brush == SurfaceBrush::FLATTEN
+          ? height_at(std::clamp(gx, 0.0F, (float)width) - get_x_offset() -
+                          0.5F,
+                      std::clamp(gz, 0.0F, (float)height) - get_y_offset() -
+                          0.5F)
+                .value_or(0.0F)
+          : 0.0F;
+
+  // New heights are computed once, so that vertices shared by chunks stay the
+  // same in all of them.
+  std::vector<float> heights;
+  heights.reserve((std::size_t)(rect.x_max - rect.x_min + 1) *
+                  (rect.y_max - rect.y_min + 1));
+  for (unsigned int vy = rect.y_min; vy <= rect.y_max; ++vy) {
+    for (unsigned int vx = rect.x_min; vx <= rect.x_max; ++vx) {
+      const float dx = (float)vx - gx;
+      const float dz = (float)vy - gz;
+      const float d2 = (dx * dx + dz * dz) / (radius * radius);
+      const float falloff = d2 < 1.0F ? (1.0F - d2) * (1.0F - d2) : 0.0F;
+      float y = get_vertex(vx, vy);
+      switch (brush) {
+        case SurfaceBrush::RAISE:
+          y += amount * falloff;
+          break;
+        case SurfaceBrush::LOWER:
+          y -= amount * falloff;
+          break;
+        case SurfaceBrush::FLATTEN:
+          y += (target - y) * std::min(amount * falloff, 1.0F);
+          break;
+      }
+      heights.push_back(y);
+    }
+  }
+
+  // Chunk cx has vertices cx * SURFACE_CHUNK_SIZE to (cx + 1) *
+  // SURFACE_CHUNK_SIZE.
+  const unsigned int cx_min =
+      rect.x_min > 0 ? (rect.x_min - 1) / SURFACE_CHUNK_SIZE : 0;
+  const unsigned int cy_min =
+      rect.y_min > 0 ? (rect.y_min - 1) / SURFACE_CHUNK_SIZE : 0;
+  const unsigned int cx_max =
+      std::min(rect.x_max / SURFACE_CHUNK_SIZE, chunk_columns - 1);
+  const unsigned int cy_max =
+      std::min(rect.y_max / SURFACE_CHUNK_SIZE, chunk_rows - 1);
+  for (unsigned int cy = cy_min; cy <= cy_max; ++cy) {
+    for (unsigned int cx = cx_min; cx <= cx_max; ++cx) {
+      write_chunk_vertices(get_chunk_mut(cx + (std::size_t)cy * chunk_columns),
+                           rect, heights.data(), SURFACE_DEFORM_HEADROOM);
+    }
+  }
+  return rect;
+}
+
+BoundingBox Surface::get_bb(std::size_t idx) const {
+  const unsigned int x = idx % width;
+  const unsigned int y = idx / width;
+  const Chunk &chunk = get_chunk(get_chunk_idx(x, y));
+  const std::size_t unit_idx =
+      (x - chunk.x) + (std::size_t)(y - chunk.y) * chunk.width;
+  const float xf = (float)x - get_x_offset();
+  const float zf = (float)y - get_y_offset();
+  return BoundingBox{
+      .min = Vector3{xf - 0.5F, chunk.get_unit_min_y(unit_idx), zf - 0.5F},
+      .max = Vector3{xf + 0.5F, chunk.get_unit_max_y(unit_idx), zf + 0.5F}};
+}
+
+std::optional<std::size_t> Surface::get_unit_idx(float x, float z) const {
+  const float xf = std::floor(x + get_x_offset() + 0.5F);
+  const float zf = std::floor(z + get_y_offset() + 0.5F);
+  if (xf < 0.0F || zf < 0.0F || xf >= (float)width || zf >= (float)height) {
+    return std::nullopt;
+  }
+  return (std::size_t)xf + (std::size_t)zf * width;
+}
+
+std::optional<float> Surface::height_at(float x, float z) const {
+  const float gx = x + get_x_offset() + 0.5F;
+  const float gz = z + get_y_offset() + 0.5F;
+  if (!(gx >= 0.0F && gz >= 0.0F && gx <= (float)width &&
+        gz <= (float)height)) {
+    return std::nullopt;
+  }
+  // The far edges belong to the last units.
+  const unsigned int ux = std::min((unsigned int)gx, width - 1);
+  const unsigned int uz = std::min((unsigned int)gz, height - 1);
+  const float u = gx - (float)ux;
+  const float v = gz - (float)uz;
+
+  return get_unit_height((*this)[ux + (std::size_t)uz * width], u, v);
+}
+
+std::optional<float> Surface::resident_height_at(float x, float z) const {
+  const float gx = x + get_x_offset() + 0.5F;
+  const float gz = z + get_y_offset() + 0.5F;
+  if (!(gx >= 0.0F && gz >= 0.0F && gx <= (float)width &&
+        gz <= (float)height)) {
+    return std::nullopt;
+  }
+  const unsigned int ux = std::min((unsigned int)gx, width - 1);
+  const unsigned int uz = std::min((unsigned int)gz, height - 1);
+  const Chunk *chunk = get_resident_chunk(get_chunk_idx(ux, uz));
+  if (!chunk) {
+    return std::nullopt;
+  }
+  return get_unit_height(get_chunk_unit(*chunk, ux, uz), gx - (float)ux,
+                         gz - (float)uz);
+}
+
+std::optional<SurfaceRayHit> Surface::pick(Ray ray, float max_distance) const {
+  // Work in grid space, where unit (x, y) covers [x, x + 1) x [y, y + 1).
+  Ray grid_ray = ray;
+  grid_ray.position.x += get_x_offset() + 0.5F;
+  grid_ray.position.z += get_y_offset() + 0.5F;
+  const float gx = grid_ray.position.x;
+  const float gz = grid_ray.position.z;
+  const float dx = ray.direction.x;
+  const float dz = ray.direction.z;
+  const float length =
+      std::sqrt(dx * dx + ray.direction.y * ray.direction.y + dz * dz);
+  if (length == 0.0F) {
+    return std::nullopt;
+  }
+  // Distances of hits are in multiples of the ray's direction.
+  const float t_limit = max_distance / length;
+
+  float t_enter = 0.0F;
+  float t_max = t_limit;
+  if (!clip_ray_axis(gx, dx, 0.0F, (float)width, t_enter, t_max) ||
+      !clip_ray_axis(gz, dz, 0.0F, (float)height, t_enter, t_max)) {
+    return std::nullopt;
+  }
+
+  // Walk the chunks under the ray in order, the first chunk with a hit has the
+  // nearest one. A ray straight down or up stays in its first chunk.
+  const float size = (float)SURFACE_CHUNK_SIZE;
+  int cx = std::clamp((int)std::floor((gx + dx * t_enter) / size), 0,
+                      (int)chunk_columns - 1);
+  int cz = std::clamp((int)std::floor((gz + dz * t_enter) / size), 0,
+                      (int)chunk_rows - 1);
+  const int step_x = dx > 0.0F ? 1 : -1;
+  const int step_z = dz > 0.0F ? 1 : -1;
+  const float t_delta_x = dx != 0.0F ? size / std::abs(dx) : INFINITY;
+  const float t_delta_z = dz != 0.0F ? size / std::abs(dz) : INFINITY;
+  float t_next_x =
+      dx != 0.0F ? ((float)(cx + (dx > 0.0F ? 1 : 0)) * size - gx) / dx
+                 : INFINITY;
+  float t_next_z =
+      dz != 0.0F ? ((float)(cz + (dz > 0.0F ? 1 : 0)) * size - gz) / dz
+                 : INFINITY;
+  while (true) {
+    if (const Chunk *chunk =
+            get_resident_chunk(cx + (std::size_t)cz * chunk_columns)) {
+      std::optional<SurfaceRayHit> hit =
+          pick_block(*chunk, SURFACE_PYRAMID_LEVELS - 1, 0, 0, grid_ray,
+                     0.0F, t_limit);
+      if (hit.has_value()) {
+        hit->point.x -= get_x_offset() + 0.5F;
+        hit->point.z -= get_y_offset() + 0.5F;
+        return hit;
+      }
+    }
+
+    if (std::min(t_next_x, t_next_z) >= t_max) {
+      return std::nullopt;
+    }
+    if (t_next_x < t_next_z) {
+      cx += step_x;
+      t_next_x += t_delta_x;
+    } else {
+      cz += step_z;
+      t_next_z += t_delta_z;
+    }
+    if (cx < 0 || cz < 0 || cx >= (int)chunk_columns ||
+        cz >= (int)chunk_rows) {
+      return std::nullopt;
+    }
+  }
+}
+
+bool Surface::line_of_sight(Vector3 a, Vector3 b) const {
+  const Vector3 diff{b.x - a.x, b.y - a.y, b.z - a.z};
+  const float distance =
+      std::sqrt(diff.x * diff.x + diff.y * diff.y + diff.z * diff.z);
+  return !pick(Ray{.position = a, .direction = diff}, distance).has_value();
+}
+
+std::optional<SurfaceRayHit> Surface::pick_block(
+    const Chunk &chunk, unsigned int level, unsigned int block_x,
+    unsigned int block_y, Ray grid_ray, float t_min, float t_max) const {
+  const unsigned int size = SURFACE_PYRAMID_LEAF_SIZE << level;
+  const unsigned int x0 = chunk.x + block_x * size;
+  const unsigned int x1 = std::min(x0 + size, chunk.x + chunk.width);
+  const unsigned int y0 = chunk.y + block_y * size;
+  const unsigned int y1 = std::min(y0 + size, chunk.y + chunk.height);
+  const float *range =
+      chunk.pyramid.data() + get_pyramid_offset(chunk, level) +
+      (block_x + (std::size_t)block_y * get_pyramid_columns(chunk, level)) * 2;
+  float t0 = t_min;
+  float t1 = t_max;
+  if (!clip_ray_axis(grid_ray.position.x, grid_ray.direction.x, (float)x0,
+                     (float)x1, t0, t1) ||
+      !clip_ray_axis(grid_ray.position.z, grid_ray.direction.z, (float)y0,
+                     (float)y1, t0, t1) ||
+      !clip_ray_axis(grid_ray.position.y, grid_ray.direction.y, range[0],
+                     range[1], t0, t1)) {
+    return std::nullopt;
+  }
+
+  if (level > 0) {
+    // Children don't overlap on the xz plane, so the first child along the
+    // ray that is hit has the nearest hit.
+    std::array<std::pair<float, unsigned int>, 4> children;
+    std::size_t child_count = 0;
+    const unsigned int child_columns = get_pyramid_columns(chunk, level - 1);
+    const unsigned int child_rows = get_pyramid_rows(chunk, level - 1);
+    for (unsigned int child = 0; child < 4; ++child) {
+      const unsigned int cx = block_x * 2 + child % 2;
+      const unsigned int cy = block_y * 2 + child / 2;
+      const unsigned int child_size = size / 2;
+      float child_t0 = t0;
+      float child_t1 = t1;
+      if (cx < child_columns && cy < child_rows &&
+          clip_ray_axis(grid_ray.position.x, grid_ray.direction.x,
+                        (float)(chunk.x + cx * child_size),
+                        (float)(chunk.x + (cx + 1) * child_size), child_t0,
+                        child_t1) &&
+          clip_ray_axis(grid_ray.position.z, grid_ray.direction.z,
+                        (float)(chunk.y + cy * child_size),
+                        (float)(chunk.y + (cy + 1) * child_size), child_t0,
+                        child_t1)) {
+        children[child_count++] = {child_t0, child};
+      }
+    }
+    std::sort(children.begin(), children.begin() + child_count);
+    for (std::size_t idx = 0; idx < child_count; ++idx) {
+      const unsigned int child = children[idx].second;
+      std::optional<SurfaceRayHit> hit =
+          pick_block(chunk, level - 1, block_x * 2 + child % 2,
+                     block_y * 2 + child / 2, grid_ray, t_min, t_max);
+      if (hit.has_value()) {
+        return hit;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // A leaf block is small, so every unit the ray may pass is tested.
+  std::optional<SurfaceRayHit> nearest;
+  const unsigned int vertex_width = chunk.width + 1;
+  for (unsigned int y = y0; y < y1; ++y) {
+    for (unsigned int x = x0; x < x1; ++x) {
+      const unsigned int lx = x - chunk.x;
+      const unsigned int ly = y - chunk.y;
+      const std::size_t unit_idx = lx + (std::size_t)ly * chunk.width;
+      float unit_t0 = t0;
+      float unit_t1 = t1;
+      if (!clip_ray_axis(grid_ray.position.x, grid_ray.direction.x, (float)x,
+                         (float)(x + 1), unit_t0, unit_t1) ||
+          !clip_ray_axis(grid_ray.position.z, grid_ray.direction.z, (float)y,
+                         (float)(y + 1), unit_t0, unit_t1) ||
+          !clip_ray_axis(grid_ray.position.y, grid_ray.direction.y,
+                         chunk.get_unit_min_y(unit_idx),
+                         chunk.get_unit_max_y(unit_idx), unit_t0, unit_t1)) {
+        continue;
+      }
+
+      const std::size_t nw_idx = lx + (std::size_t)ly * vertex_width;
+      const float xf = (float)x;
+      const float zf = (float)y;
+      const Vector3 nw{xf, chunk.get_vertex(nw_idx), zf};
+      const Vector3 ne{xf + 1.0F, chunk.get_vertex(nw_idx + 1), zf};
+      const Vector3 sw{xf, chunk.get_vertex(nw_idx + vertex_width), zf + 1.0F};
+      const Vector3 se{xf + 1.0F, chunk.get_vertex(nw_idx + vertex_width + 1),
+                       zf + 1.0F};
+      // The ray may cross both triangles of a unit.
+      for (const RayCollision &collision :
+           {GetRayCollisionTriangle(grid_ray, nw, sw, ne),
+            GetRayCollisionTriangle(grid_ray, ne, sw, se)}) {
+        if (collision.hit && collision.distance <= t_max &&
+            (!nearest.has_value() || collision.distance < nearest->distance)) {
+          nearest = SurfaceRayHit{.idx = x + (std::size_t)y * width,
+                                  .point = collision.point,
+                                  .distance = collision.distance};
+        }
+      }
+    }
+  }
+  return nearest;
+}
+
+BoundingBox Surface::get_chunk_bb(const Chunk &chunk) const {
+  return BoundingBox{
+      .min = Vector3{(float)chunk.x - get_x_offset() - 0.5F, chunk.min_y,
+                     (float)chunk.y - get_y_offset() - 0.5F},
+      .max = Vector3{(float)(chunk.x + chunk.width) - get_x_offset() - 0.5F,
+                     chunk.max_y,
+                     (float)(chunk.y + chunk.height) - get_y_offset() - 0.5F}};
+}
+
+std::vector<std::size_t> Surface::get_focus_chunks(
+    const std::vector<Vector3> &focus_points, float radius) const {
+  std::vector<SurfaceFocus> focus;
+  focus.reserve(focus_points.size());
+  for (const Vector3 &point : focus_points) {
+    focus.push_back(SurfaceFocus{.point = point, .radius = radius});
+  }
+  return get_focus_chunks(focus);
+}
+
+std::vector<std::size_t> Surface::get_focus_chunks(
+    const std::vector<SurfaceFocus> &focus) const {
+  std::vector<std::size_t> focus_chunks;
+  // Thousands of focus points mostly share chunks, so duplicates are marked
+  // instead of searched for.
+  std::vector<bool> is_focus_chunk(chunks.size(), false);
+  for (const auto &[point, radius] : focus) {
+    // Units covered by the square around the focus point.
+    const float x_min = point.x - radius + get_x_offset() + 0.5F;
+    const float x_max = point.x + radius + get_x_offset() + 0.5F;
+    const float z_min = point.z - radius + get_y_offset() + 0.5F;
+    const float z_max = point.z + radius + get_y_offset() + 0.5F;
+    if (x_max < 0.0F || z_max < 0.0F || x_min >= (float)width ||
+        z_min >= (float)height) {
+      continue;
+    }
+    const unsigned int ux_min = x_min < 0.0F ? 0 : (unsigned int)x_min;
+    const unsigned int uz_min = z_min < 0.0F ? 0 : (unsigned int)z_min;
+    const unsigned int ux_max = std::min((unsigned int)x_max, width - 1);
+    const unsigned int uz_max = std::min((unsigned int)z_max, height - 1);
+    for (unsigned int cy = uz_min / SURFACE_CHUNK_SIZE;
+         cy <= uz_max / SURFACE_CHUNK_SIZE; ++cy) {
+      for (unsigned int cx = ux_min / SURFACE_CHUNK_SIZE;
+           cx <= ux_max / SURFACE_CHUNK_SIZE; ++cx) {
+        const std::size_t idx = cx + (std::size_t)cy * chunk_columns;
+        if (!is_focus_chunk[idx]) {
+          is_focus_chunk[idx] = true;
+          focus_chunks.push_back(idx);
+        }
+      }
+    }
+  }
+  return focus_chunks;
+}
+
+void Surface::update_residency(const std::vector<Vector3> &focus_points,
+                               float radius) {
+  std::vector<SurfaceFocus> focus;
+  focus.reserve(focus_points.size());
+  for (const Vector3 &point : focus_points) {
+    focus.push_back(SurfaceFocus{.point = point, .radius = radius});
+  }
+  update_residency(focus);
+}
+
+void Surface::update_residency(const std::vector<SurfaceFocus> &focus) {
+  ++tick;
+  std::vector<std::size_t> to_load;
+  for (std::size_t idx : get_focus_chunks(focus)) {
+    if (chunks[idx]) {
+      chunks[idx]->last_used = tick;
+    } else {
+      to_load.push_back(idx);
+    }
+  }
+
+  // Chunks don't depend on each other, so they are generated in parallel.
+  // Chunks of a mapped file are ready as soon as they are created.
+  std::vector<std::unique_ptr<Chunk> > loaded(to_load.size());
+  for (std::size_t idx = 0; idx < to_load.size(); ++idx) {
+    loaded[idx] = create_chunk(to_load[idx]);
+  }
+  if (!file) {
+    parallel_for(loaded.size(), thread_count,
+                 [this, &loaded](std::size_t begin, std::size_t end) {
+                   for (std::size_t idx = begin; idx < end; ++idx) {
+                     generate_chunk(*loaded[idx]);
+                   }
+                 });
+  }
+  for (std::size_t idx = 0; idx < to_load.size(); ++idx) {
+    chunks[to_load[idx]] = std::move(loaded[idx]);
+    ++resident_count;
+  }
+
+  evict_chunks();
+}
+
+std::size_t Surface::get_resident_chunk_count() const { return resident_count; }
+
+std::size_t Surface::get_memory_usage() const {
+  std::size_t usage = 0;
+  for (const auto &chunk : chunks) {
+    if (chunk) {
+      usage += get_chunk_memory_usage(*chunk);
+    }
+  }
+  return usage;
+}
+
+std::size_t Surface::get_memory_budget() const { return memory_budget; }
+
+void Surface::set_memory_budget(std::size_t bytes) {
+  memory_budget = bytes;
+  evict_chunks();
+}
+
+unsigned int Surface::get_thread_count() const { return thread_count; }
+
+void Surface::set_thread_count(unsigned int count) { thread_count = count; }
+
+Surface::Chunk &Surface::load_chunk(std::size_t chunk_idx) const {
+  std::unique_ptr<Chunk> chunk = create_chunk(chunk_idx);
+  if (!file) {
+    generate_chunk(*chunk);
+  }
+
+  chunks[chunk_idx] = std::move(chunk);
+  ++resident_count;
+  return *chunks[chunk_idx];
+}
+
+std::unique_ptr<Surface::Chunk> Surface::create_chunk(
+    std::size_t chunk_idx) const {
+  const unsigned int cx = chunk_idx % chunk_columns;
+  const unsigned int cy = chunk_idx / chunk_columns;
+
+  const unsigned int chunk_width =
+      std::min(SURFACE_CHUNK_SIZE, width - cx * SURFACE_CHUNK_SIZE);
+  const unsigned int chunk_height =
+      std::min(SURFACE_CHUNK_SIZE, height - cy * SURFACE_CHUNK_SIZE);
+  auto chunk = std::make_unique<Chunk>(Chunk{.x = cx * SURFACE_CHUNK_SIZE,
+                                             .y = cy * SURFACE_CHUNK_SIZE,
+                                             .width = chunk_width,
+                                             .height = chunk_height,
+                                             .vertices = nullptr,
+                                             .unit_y_ranges = nullptr,
+                                             .quantized_vertices = nullptr,
+                                             .quantized_unit_y_ranges = nullptr,
+                                             .storage = {},
+                                             .quantized_storage = {},
+                                             .min_y = 0.0F,
+                                             .max_y = 0.0F,
+                                             .y_step = 0.0F,
+                                             .pyramid = {},
+                                             .version = next_version,
+                                             .dirty = {0, 0, chunk_width,
+                                                       chunk_height},
+                                             .dirty_version = next_version,
+                                             .last_used = tick,
+                                             .is_edited = false});
+  ++next_version;
+  const std::size_t vertex_count = get_chunk_vertex_count(*chunk);
+  const std::size_t height_count =
+      vertex_count + get_chunk_range_count(*chunk);
+  const bool is_quantized = format == SurfaceHeightFormat::UNORM16;
+  if (file) {
+    // The mapping is private, so set_vertex() may write to it in place.
+    const SurfaceFileChunk &entry = get_file_chunks(*file)[chunk_idx];
+    unsigned char *data = file->get_data() + entry.offset;
+    if (is_quantized) {
+      chunk->quantized_vertices = (std::uint16_t *)data;
+      chunk->quantized_unit_y_ranges = chunk->quantized_vertices + vertex_count;
+    } else {
+      chunk->vertices = (float *)data;
+      chunk->unit_y_ranges = chunk->vertices + vertex_count;
+    }
+    chunk->min_y = entry.min_y;
+    chunk->max_y = entry.max_y;
+    chunk->y_step = get_y_step(entry.min_y, entry.max_y);
+    build_pyramid(*chunk);
+  } else if (is_quantized) {
+    chunk->quantized_storage.resize(height_count, 0);
+    chunk->quantized_vertices = chunk->quantized_storage.data();
+    chunk->quantized_unit_y_ranges =
+        chunk->quantized_storage.data() + vertex_count;
+  } else {
+    chunk->storage.resize(height_count, 0.0F);
+    chunk->vertices = chunk->storage.data();
+    chunk->unit_y_ranges = chunk->storage.data() + vertex_count;
+  }
+  return chunk;
+}
+
+void Surface::generate_chunk(Chunk &chunk) const {
+  // Every height is a function of the seed and the vertex, so shared edges
+  // match their neighbours without looking at them. The y ranges of a row of
+  // units are computed right after its south vertices, while both rows are
+  // still in cache.
+  const SurfaceNoiseKernel kernel = get_surface_noise_kernel();
+  const unsigned int vertex_width = chunk.width + 1;
+  float *vertices = chunk.vertices;
+  float *unit_y_ranges = chunk.unit_y_ranges;
+  if (!chunk.vertices) {
+    // The quantization range is only known once every height is, so the
+    // heights and ranges are generated as floats into a buffer each thread
+    // reuses, then quantized.
+    thread_local std::vector<float> scratch;
+    const std::size_t vertex_count = get_chunk_vertex_count(chunk);
+    scratch.resize(vertex_count + get_chunk_range_count(chunk));
+    vertices = scratch.data();
+    unit_y_ranges = scratch.data() + vertex_count;
+  }
+
+  generate_surface_noise_row(kernel, seed, chunk.x, chunk.y, vertex_width,
+                             vertices);
+  chunk.min_y = vertices[0];
+  chunk.max_y = vertices[0];
+  for (unsigned int uy = 0; uy < chunk.height; ++uy) {
+    const float *north = vertices + (std::size_t)uy * vertex_width;
+    float *south = vertices + (std::size_t)(uy + 1) * vertex_width;
+    generate_surface_noise_row(kernel, seed, chunk.x, chunk.y + uy + 1,
+                               vertex_width, south);
+
+    float *ranges = unit_y_ranges + (std::size_t)uy * chunk.width * 2;
+    for (unsigned int ux = 0; ux < chunk.width; ++ux) {
+      const float min_y = std::min(std::min(north[ux], north[ux + 1]),
+                                   std::min(south[ux], south[ux + 1]));
+      const float max_y = std::max(std::max(north[ux], north[ux + 1]),
+                                   std::max(south[ux], south[ux + 1]));
+      ranges[ux * 2] = min_y;
+      ranges[ux * 2 + 1] = max_y;
+      chunk.min_y = std::min(chunk.min_y, min_y);
+      chunk.max_y = std::max(chunk.max_y, max_y);
+    }
+  }
+  if (!chunk.vertices) {
+    quantize_chunk(chunk, vertices, unit_y_ranges);
+  }
+  build_pyramid(chunk);
+}
+
+void Surface::write_chunk_vertices(Chunk &chunk, const SurfaceRect &rect,
+                                   const float *heights, float headroom) {
+  // Part of rect within the chunk, in chunk vertices.
+  const SurfaceRect local{
+      std::max(rect.x_min, chunk.x) - chunk.x,
+      std::max(rect.y_min, chunk.y) - chunk.y,
+      std::min(rect.x_max, chunk.x + chunk.width) - chunk.x,
+      std::min(rect.y_max, chunk.y + chunk.height) - chunk.y};
+  const unsigned int rect_width = rect.x_max - rect.x_min + 1;
+  const auto height_fn = [&](unsigned int lx, unsigned int ly) {
+    return heights[(chunk.x + lx - rect.x_min) +
+                   (std::size_t)(chunk.y + ly - rect.y_min) * rect_width];
+  };
+
+  float min_y = INFINITY;
+  float max_y = -INFINITY;
+  for (unsigned int ly = local.y_min; ly <= local.y_max; ++ly) {
+    for (unsigned int lx = local.x_min; lx <= local.x_max; ++lx) {
+      min_y = std::min(min_y, height_fn(lx, ly));
+      max_y = std::max(max_y, height_fn(lx, ly));
+    }
+  }
+  bool is_requantized = false;
+  if (chunk.vertices) {
+    // Only grows, the chunk's box stays a conservative bound.
+    chunk.min_y = std::min(chunk.min_y, min_y);
+    chunk.max_y = std::max(chunk.max_y, max_y);
+  } else if (min_y < chunk.min_y || max_y > chunk.max_y) {
+    requantize_chunk(chunk,
+                     min_y < chunk.min_y ? min_y - headroom : chunk.min_y,
+                     max_y > chunk.max_y ? max_y + headroom : chunk.max_y);
+    is_requantized = true;
+  }
+
+  for (unsigned int ly = local.y_min; ly <= local.y_max; ++ly) {
+    for (unsigned int lx = local.x_min; lx <= local.x_max; ++lx) {
+      const std::size_t vertex_idx = lx + (std::size_t)ly * (chunk.width + 1);
+      if (chunk.vertices) {
+        chunk.vertices[vertex_idx] = height_fn(lx, ly);
+      } else {
+        chunk.quantized_vertices[vertex_idx] =
+            chunk.quantize(height_fn(lx, ly));
+      }
+    }
+  }
+
+  // Update the y ranges of the units touching the vertices.
+  const unsigned int ux_min = local.x_min > 0 ? local.x_min - 1 : 0;
+  const unsigned int uy_min = local.y_min > 0 ? local.y_min - 1 : 0;
+  const unsigned int ux_max = std::min(local.x_max, chunk.width - 1);
+  const unsigned int uy_max = std::min(local.y_max, chunk.height - 1);
+  for (unsigned int uy = uy_min; uy <= uy_max; ++uy) {
+    for (unsigned int ux = ux_min; ux <= ux_max; ++ux) {
+      if (chunk.vertices) {
+        update_unit_y_range(chunk.vertices, chunk.unit_y_ranges, chunk.width,
+                            ux, uy);
+      } else {
+        update_unit_y_range(chunk.quantized_vertices,
+                            chunk.quantized_unit_y_ranges, chunk.width, ux,
+                            uy);
+      }
+    }
+  }
+  update_pyramid(chunk, ux_min, uy_min, ux_max, uy_max);
+
+  chunk.dirty = is_requantized
+                    ? SurfaceRect{0, 0, chunk.width, chunk.height}
+                    : local;
+  chunk.dirty_version = chunk.version;
+  chunk.version = next_version++;
+  chunk.is_edited = true;
+}
+
+void Surface::requantize_chunk(Chunk &chunk, float min_y, float max_y) {
+  std::vector<float> heights(get_chunk_vertex_count(chunk));
+  for (std::size_t idx = 0; idx < heights.size(); ++idx) {
+    heights[idx] = chunk.dequantize(chunk.quantized_vertices[idx]);
+  }
+  chunk.min_y = std::min(chunk.min_y, min_y);
+  chunk.max_y = std::max(chunk.max_y, max_y);
+  quantize_chunk(chunk, heights.data());
+  build_pyramid(chunk);
+}
+
+void Surface::evict_chunks() {
+  std::size_t usage = get_memory_usage();
+  if (usage <= memory_budget) {
+    return;
+  }
+
+  // Chunks used this tick are never evicted, they may still be referenced.
+  std::vector<std::size_t> candidates;
+  for (std::size_t idx = 0; idx < chunks.size(); ++idx) {
+    if (chunks[idx] && chunks[idx]->last_used != tick &&
+        !chunks[idx]->is_edited) {
+      candidates.push_back(idx);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [this](std::size_t a, std::size_t b) {
+              return chunks[a]->last_used < chunks[b]->last_used;
+            });
+
+  for (std::size_t idx : candidates) {
+    if (usage <= memory_budget) {
+      break;
+    }
+    usage -= get_chunk_memory_usage(*chunks[idx]);
+    chunks[idx].reset();
+    --resident_count;
+  }
+#ifndef NDEBUG
+  std::cout << "Surface: " << resident_count << " chunks resident, " << usage
+            << " bytes\n";
+#endif
+}
+
+std::size_t Surface::get_chunk_memory_usage(const Chunk &chunk) {
+  // The data of a mapped chunk is paged in and out of the file by the OS.
+  return sizeof(Chunk) + chunk.storage.capacity() * sizeof(float) +
+         chunk.quantized_storage.capacity() * sizeof(std::uint16_t) +
+         chunk.pyramid.capacity() * sizeof(float);
+}
@@ -0,0 +1,400 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_H_
+
+// standard library includes
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+// local includes
+#include "mapped_file.h"
+
+constexpr unsigned int SURFACE_CHUNK_SIZE = 64;
+// The finest blocks of a chunk's height pyramid are this many units wide, each
+// coarser level doubles the block size up to the whole chunk.
+constexpr unsigned int SURFACE_PYRAMID_LEAF_SIZE = 4;
+static_assert((SURFACE_CHUNK_SIZE & (SURFACE_CHUNK_SIZE - 1)) == 0 &&
+                  (SURFACE_PYRAMID_LEAF_SIZE &
+                   (SURFACE_PYRAMID_LEAF_SIZE - 1)) == 0 &&
+                  SURFACE_PYRAMID_LEAF_SIZE <= SURFACE_CHUNK_SIZE,
+              "Pyramid blocks must evenly divide chunks!");
+constexpr std::size_t SURFACE_DEFAULT_MEMORY_BUDGET = 32 * 1024 * 1024;
+
+enum class SurfaceHeightFormat : std::uint32_t {
+  /// 32-bit float heights.
+  FLOAT32,
+  /// 16-bit fixed point heights spanning each chunk's min_y to max_y. A height
+  /// is off by at most (max_y - min_y) / 65535 / 2 from the float it was
+  /// quantized from, plus float rounding. Generated chunks span less than 6.6
+  /// units, measured errors stay below 0.00005. Every time set_vertex() or
+  /// deform() widens a chunk's range the chunk is quantized again, which may
+  /// add another half step of the new range.
+  UNORM16
+};
+
+struct SurfaceUnit {
+  float nw, ne, sw, se;
+};
+
+struct SurfaceRayHit {
+  /// Index of the unit hit, same as for Surface::operator[].
+  std::size_t idx;
+  Vector3 point;
+  float distance;
+};
+
+/// Chunks with units within radius of point, on the xz plane, are kept
+/// loaded.
+struct SurfaceFocus {
+  Vector3 point;
+  float radius;
+};
+
+/// Vertices x_min to x_max and y_min to y_max, inclusive.
+struct SurfaceRect {
+  unsigned int x_min, y_min, x_max, y_max;
+};
+
+enum class SurfaceBrush {
+  /// Raises heights by up to the brush's amount.
+  RAISE,
+  /// Lowers heights by up to the brush's amount.
+  LOWER,
+  /// Moves heights up to the brush's amount, as a fraction of the way, to the
+  /// height at the brush's center.
+  FLATTEN
+};
+
+/*
+ * Heights of the surface stored as a grid of vertices shared between
+ * adjacent surface units. The size of the surface is chosen at construction.
+ *
+ * Unit (x, y) has its corners at vertices:
+ * nw (x, y)     -- ne (x + 1, y)
+ * |                |
+ * sw (x, y + 1) -- se (x + 1, y + 1)
+ *
+ * The surface is centered on the world origin, unit (x, y) is centered at
+ * world (x - get_x_offset(), y - get_y_offset()) on the xz plane.
+ *
+ * Units are split into chunks of SURFACE_CHUNK_SIZE x SURFACE_CHUNK_SIZE that
+ * are generated the first time they are accessed. update_residency() keeps the
+ * chunks around the given focus points loaded and evicts the least recently
+ * used chunks once the memory budget is exceeded. An evicted chunk is
+ * generated again from the surface's seed when it is next accessed. Chunks
+ * changed by set_vertex() or deform() are never evicted, so edits aren't lost.
+ *
+ * Heights are generated by get_surface_noise_height(), so a chunk is the same
+ * regardless of when, in which order or on how many threads it is generated.
+ *
+ * A surface written by save() is mapped by load() and its chunks point
+ * straight into the mapping instead of being generated, see surface.cc for the
+ * file format.
+ */
+class Surface {
+ public:
+  struct Chunk {
+    /// Unit at the chunk's nw corner.
+    unsigned int x, y;
+    /// Size in units, smaller than SURFACE_CHUNK_SIZE at the surface's edges.
+    unsigned int width, height;
+    /// (width + 1) * (height + 1) vertices, the edges are duplicated in the
+    /// adjacent chunks. nullptr if the surface's format is UNORM16.
+    float *vertices;
+    /// Lowest and highest vertex of each unit, two per unit. nullptr if the
+    /// surface's format is UNORM16.
+    float *unit_y_ranges;
+    /// Same as vertices and unit_y_ranges for the UNORM16 format, nullptr if
+    /// the surface's format is FLOAT32.
+    std::uint16_t *quantized_vertices;
+    std::uint16_t *quantized_unit_y_ranges;
+    /// Hold the vertices and unit y ranges of a generated chunk, empty if they
+    /// point into a mapped file.
+    std::vector<float> storage;
+    std::vector<std::uint16_t> quantized_storage;
+    /// For UNORM16 these are exactly the range of the quantized heights.
+    float min_y, max_y;
+    /// Height of one quantization step, (max_y - min_y) / 65535.
+    float y_step;
+    /// Lowest and highest unit y of blocks of
+    /// (SURFACE_PYRAMID_LEAF_SIZE << level)^2 units, two floats per block.
+    /// Levels are stored from the finest, blocks row by row.
+    std::vector<float> pyramid;
+    /// Changes whenever the chunk's vertices change.
+    unsigned long long version;
+    /// Vertices of the chunk changed by the latest edit, the others are the
+    /// same as at dirty_version. A copy of the chunk made at dirty_version
+    /// only needs these updated.
+    SurfaceRect dirty;
+    unsigned long long dirty_version;
+    unsigned long long last_used;
+    /// Edited chunks are pinned, they can't be generated again.
+    bool is_edited;
+
+    /// Vertex (x, y) is at idx "x + y * (width + 1)".
+    float get_vertex(std::size_t idx) const;
+    /// Unit (x, y) is at unit_idx "x + y * width".
+    float get_unit_min_y(std::size_t unit_idx) const;
+    float get_unit_max_y(std::size_t unit_idx) const;
+    std::uint16_t quantize(float y) const;
+    float dequantize(std::uint16_t q) const;
+  };
+
+  Surface(unsigned int width, unsigned int height, unsigned int seed,
+          std::size_t memory_budget = SURFACE_DEFAULT_MEMORY_BUDGET,
+          SurfaceHeightFormat format = SurfaceHeightFormat::FLOAT32);
+
+  // No copy.
+  Surface(const Surface &) = delete;
+  Surface &operator=(const Surface &) = delete;
+
+  // Allow move.
+  Surface(Surface &&) = default;
+  Surface &operator=(Surface &&) = default;
+
+  /// Number of surface units.
+  std::size_t size() const;
+  unsigned int get_width() const;
+  unsigned int get_height() const;
+  float get_x_offset() const;
+  float get_y_offset() const;
+  unsigned int get_seed() const;
+  SurfaceHeightFormat get_height_format() const;
+
+  /// Writes the surface to path, chunks that aren't resident are generated for
+  /// it without being loaded. False if the file couldn't be written.
+  bool save(const std::string &path) const;
+  /// Maps a file written by save(), nullopt if it can't be mapped or isn't
+  /// a valid surface file. Changes to the loaded surface never reach the file.
+  static std::optional<Surface> load(
+      const std::string &path,
+      std::size_t memory_budget = SURFACE_DEFAULT_MEMORY_BUDGET);
+  /// True if the chunks are read from a mapped file.
+  bool is_mapped() const;
+
+  /// idx is "x + y * get_width()".
+  SurfaceUnit operator[](std::size_t idx) const;
+  /// Same as operator[] but asserts that idx is in range.
+  SurfaceUnit at(std::size_t idx) const;
+
+  float get_vertex(unsigned int x, unsigned int y) const;
+  void set_vertex(unsigned int x, unsigned int y, float height);
+  /// Applies the brush to the vertices within radius of the world position,
+  /// its effect falling off smoothly to none at the radius. Only the units and
+  /// pyramid blocks touching the changed vertices are updated. Returns the
+  /// vertices that may have changed, nullopt if none are on the surface.
+  std::optional<SurfaceRect> deform(float x, float z, float radius,
+                                    float amount, SurfaceBrush brush);
+
+  /// Bounding box of a unit, indexed the same as operator[].
+  BoundingBox get_bb(std::size_t idx) const;
+  /// Unit under the world position, if on the surface.
+  std::optional<std::size_t> get_unit_idx(float x, float z) const;
+  /// Height of the surface's triangles at the world position, if on the
+  /// surface. Units are split into triangles nw-sw-ne and ne-sw-se.
+  std::optional<float> height_at(float x, float z) const;
+  /// Same as height_at() but nullopt if the chunk isn't resident. Doesn't
+  /// load or mark chunks as used, so it may be called from several threads
+  /// while the surface isn't changed.
+  std::optional<float> resident_height_at(float x, float z) const;
+  /// Nearest hit of the ray within max_distance on the triangles of resident
+  /// chunks. Chunks are visited in order along the ray, blocks of a chunk's
+  /// height pyramid that the ray passes above or below are skipped whole.
+  std::optional<SurfaceRayHit> pick(Ray ray,
+                                    float max_distance = INFINITY) const;
+  /// True if the segment from a to b doesn't cross the surface, only resident
+  /// chunks can block it.
+  bool line_of_sight(Vector3 a, Vector3 b) const;
+
+  unsigned int get_chunk_columns() const;
+  unsigned int get_chunk_rows() const;
+  std::size_t get_chunk_count() const;
+  /// Index of the chunk containing unit (x, y).
+  std::size_t get_chunk_idx(unsigned int x, unsigned int y) const;
+  /// Generates the chunk if it isn't resident.
+  const Chunk &get_chunk(std::size_t chunk_idx) const;
+  /// nullptr if the chunk isn't resident.
+  const Chunk *get_resident_chunk(std::size_t chunk_idx) const;
+  BoundingBox get_chunk_bb(const Chunk &chunk) const;
+
+  /// Chunks with units within radius of any of the focus points, on the xz
+  /// plane.
+  std::vector<std::size_t> get_focus_chunks(
+      const std::vector<Vector3> &focus_points, float radius) const;
+  /// Same for focus points with their own radius.
+  std::vector<std::size_t> get_focus_chunks(
+      const std::vector<SurfaceFocus> &focus) const;
+  /// Loads the chunks within radius of the focus points and then evicts the
+  /// least recently used chunks while over the memory budget.
+  void update_residency(const std::vector<Vector3> &focus_points,
+                        float radius);
+  void update_residency(const std::vector<SurfaceFocus> &focus);
+  std::size_t get_resident_chunk_count() const;
+  /// Bytes used by resident chunks.
+  std::size_t get_memory_usage() const;
+  std::size_t get_memory_budget() const;
+  void set_memory_budget(std::size_t bytes);
+  /// Threads used to generate the chunks loaded by update_residency().
+  unsigned int get_thread_count() const;
+  void set_thread_count(unsigned int count);
+
+ private:
+  std::unique_ptr<MappedFile> file;
+  mutable std::vector<std::unique_ptr<Chunk> > chunks;
+  mutable std::size_t resident_count;
+  mutable unsigned long long next_version;
+  std::size_t memory_budget;
+  unsigned long long tick;
+  unsigned int width;
+  unsigned int height;
+  unsigned int chunk_columns;
+  unsigned int chunk_rows;
+  unsigned int seed;
+  unsigned int thread_count;
+  SurfaceHeightFormat format;
+
+  Chunk &get_chunk_mut(std::size_t chunk_idx) const;
+  /// Unit (x, y), which must be within the chunk.
+  static SurfaceUnit get_chunk_unit(const Chunk &chunk, unsigned int x,
+                                    unsigned int y);
+  Chunk &load_chunk(std::size_t chunk_idx) const;
+  /// Points the chunk into the mapped file if there is one, otherwise it
+  /// still has to be generated.
+  std::unique_ptr<Chunk> create_chunk(std::size_t chunk_idx) const;
+  /// Only writes to chunk, may run on any thread.
+  void generate_chunk(Chunk &chunk) const;
+  /// Writes the heights of rect's vertices, row by row, to those that are
+  /// within the chunk. rect is in surface vertices. A quantized chunk whose
+  /// range has to grow is widened by headroom beyond the new heights, so that
+  /// repeated edits don't quantize it again every time.
+  void write_chunk_vertices(Chunk &chunk, const SurfaceRect &rect,
+                            const float *heights, float headroom);
+  /// Quantizes the chunk again for a range widened to include min_y and max_y.
+  static void requantize_chunk(Chunk &chunk, float min_y, float max_y);
+  /// Nearest hit within block (block_x, block_y) of the pyramid level. The ray
+  /// is in grid space, where unit (x, y) covers [x, x + 1) x [y, y + 1) on the
+  /// xz plane.
+  std::optional<SurfaceRayHit> pick_block(const Chunk &chunk,
+                                          unsigned int level,
+                                          unsigned int block_x,
+                                          unsigned int block_y, Ray grid_ray,
+                                          float t_min, float t_max) const;
+  void evict_chunks();
+
+  static std::size_t get_chunk_memory_usage(const Chunk &chunk);
+};
+
+inline std::size_t Surface::size() const {
+  return (std::size_t)width * height;
+}
+
+inline unsigned int Surface::get_width() const { return width; }
+
+inline unsigned int Surface::get_height() const { return height; }
+
+inline float Surface::get_x_offset() const {
+  return (float)width / 2.0F - 0.5F;
+}
+
+inline float Surface::get_y_offset() const {
+  return (float)height / 2.0F - 0.5F;
+}
+
+inline unsigned int Surface::get_seed() const { return seed; }
+
+inline SurfaceHeightFormat Surface::get_height_format() const {
+  return format;
+}
+
+inline float Surface::Chunk::dequantize(std::uint16_t q) const {
+  return min_y + (float)q * y_step;
+}
+
+inline std::uint16_t Surface::Chunk::quantize(float y) const {
+  if (y_step == 0.0F) {
+    return 0;
+  }
+  const float q = std::round((y - min_y) / y_step);
+  return (std::uint16_t)std::clamp(q, 0.0F, 65535.0F);
+}
+
+inline float Surface::Chunk::get_vertex(std::size_t idx) const {
+  return vertices ? vertices[idx] : dequantize(quantized_vertices[idx]);
+}
+
+inline float Surface::Chunk::get_unit_min_y(std::size_t unit_idx) const {
+  return unit_y_ranges ? unit_y_ranges[unit_idx * 2]
+                       : dequantize(quantized_unit_y_ranges[unit_idx * 2]);
+}
+
+inline float Surface::Chunk::get_unit_max_y(std::size_t unit_idx) const {
+  return unit_y_ranges ? unit_y_ranges[unit_idx * 2 + 1]
+                       : dequantize(quantized_unit_y_ranges[unit_idx * 2 + 1]);
+}
+
+inline bool Surface::is_mapped() const { return (bool)file; }
+
+inline unsigned int Surface::get_chunk_columns() const {
+  return chunk_columns;
+}
+
+inline unsigned int Surface::get_chunk_rows() const { return chunk_rows; }
+
+inline std::size_t Surface::get_chunk_count() const { return chunks.size(); }
+
+inline std::size_t Surface::get_chunk_idx(unsigned int x,
+                                          unsigned int y) const {
+  return (std::size_t)(y / SURFACE_CHUNK_SIZE) * chunk_columns +
+         x / SURFACE_CHUNK_SIZE;
+}
+
+inline const Surface::Chunk *Surface::get_resident_chunk(
+    std::size_t chunk_idx) const {
+  return chunks[chunk_idx].get();
+}
+
+inline Surface::Chunk &Surface::get_chunk_mut(std::size_t chunk_idx) const {
+  Chunk *chunk = chunks[chunk_idx].get();
+  if (!chunk) {
+    return load_chunk(chunk_idx);
+  }
+  chunk->last_used = tick;
+  return *chunk;
+}
+
+inline const Surface::Chunk &Surface::get_chunk(std::size_t chunk_idx) const {
+  return get_chunk_mut(chunk_idx);
+}
+
+inline SurfaceUnit Surface::operator[](std::size_t idx) const {
+  const unsigned int x = idx % width;
+  const unsigned int y = idx / width;
+  return get_chunk_unit(get_chunk(get_chunk_idx(x, y)), x, y);
+}
+
+inline SurfaceUnit Surface::get_chunk_unit(const Chunk &chunk, unsigned int x,
+                                           unsigned int y) {
+  const std::size_t vertex_width = chunk.width + 1;
+  const std::size_t nw_idx = (x - chunk.x) + (y - chunk.y) * vertex_width;
+  return SurfaceUnit{.nw = chunk.get_vertex(nw_idx),
+                     .ne = chunk.get_vertex(nw_idx + 1),
+                     .sw = chunk.get_vertex(nw_idx + vertex_width),
+                     .se = chunk.get_vertex(nw_idx + vertex_width + 1)};
+}
+
+inline float Surface::get_vertex(unsigned int x, unsigned int y) const {
+  // Vertices on the surface's far edges belong to the last chunk.
+  const Chunk &chunk = get_chunk(get_chunk_idx(x < width ? x : width - 1,
+                                               y < height ? y : height - 1));
+  return chunk.get_vertex((x - chunk.x) + (y - chunk.y) * (chunk.width + 1));
+}
+
+#endif
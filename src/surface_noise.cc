@@ -0,0 +1,294 @@
+#include "surface_noise.h"
+
+// standard library includes
+#include <cstddef>
+
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+#define SURFACE_NOISE_X86_KERNELS
+// third party includes
+#include <immintrin.h>
+#endif
+
+/*
+ * The kernels only use multiplies, adds and subtracts in the same order as the
+ * scalar code and never fused multiply-adds, so they round identically. Cell
+ * sizes are powers of two, so the fractions within a cell are exact.
+ */
+
+namespace {
+
+constexpr unsigned int HASH_X = 0x8da6b343U;
+constexpr unsigned int HASH_Y = 0xd8163841U;
+constexpr unsigned int HASH_OCTAVE = 0xcb1ab31fU;
+constexpr unsigned int HASH_MUL_A = 0x7feb352dU;
+constexpr unsigned int HASH_MUL_B = 0x846ca68bU;
+// Lattice values use 24 bits so that the conversion to float is exact.
+constexpr float LATTICE_SCALE = 2.0F / 16777216.0F;
+
+static_assert((SURFACE_NOISE_CELL_SIZE >> (SURFACE_NOISE_OCTAVES - 1)) >= 2,
+              "The last octave's cells must be at least 2 vertices wide!");
+
+constexpr unsigned int get_cell_shift(unsigned int octave) {
+  // Cell size of octave n is SURFACE_NOISE_CELL_SIZE / 2^n.
+  unsigned int shift = 0;
+  while ((SURFACE_NOISE_CELL_SIZE >> shift) > 1) {
+    ++shift;
+  }
+  return shift - octave;
+}
+
+unsigned int hash(unsigned int value) {
+  value ^= value >> 16;
+  value *= HASH_MUL_A;
+  value ^= value >> 15;
+  value *= HASH_MUL_B;
+  value ^= value >> 16;
+  return value;
+}
+
+/// Value in [-1, 1) at a lattice point of an octave.
+float lattice_value(unsigned int seed, unsigned int octave, unsigned int x,
+                    unsigned int y) {
+  const unsigned int value =
+      hash(seed ^ hash(x * HASH_X ^ y * HASH_Y ^ octave * HASH_OCTAVE));
+  return (float)(value >> 8) * LATTICE_SCALE - 1.0F;
+}
+
+float fade(float t) { return t * t * (3.0F - 2.0F * t); }
+
+/// Fraction of a coordinate within its cell, faded.
+float cell_fraction(unsigned int value, unsigned int octave) {
+  const unsigned int shift = get_cell_shift(octave);
+  return fade((float)(value & ((1U << shift) - 1)) *
+              (1.0F / (float)(1U << shift)));
+}
+
+void generate_row_scalar(unsigned int seed, unsigned int x, unsigned int y,
+                         unsigned int count, float *out) {
+  for (unsigned int idx = 0; idx < count; ++idx) {
+    out[idx] = get_surface_noise_height(seed, x + idx, y);
+  }
+}
+
+#ifdef SURFACE_NOISE_X86_KERNELS
+__attribute__((target("sse4.1"))) __m128i hash_sse4_1(__m128i value) {
+  value = _mm_xor_si128(value, _mm_srli_epi32(value, 16));
+  value = _mm_mullo_epi32(value, _mm_set1_epi32((int)HASH_MUL_A));
+  value = _mm_xor_si128(value, _mm_srli_epi32(value, 15));
+  value = _mm_mullo_epi32(value, _mm_set1_epi32((int)HASH_MUL_B));
+  return _mm_xor_si128(value, _mm_srli_epi32(value, 16));
+}
+
+/// Lattice values of cells x with the row's y and octave already hashed in.
+__attribute__((target("sse4.1"))) __m128 lattice_value_sse4_1(
+    unsigned int seed, __m128i x, unsigned int row_hash) {
+  __m128i value = _mm_xor_si128(_mm_mullo_epi32(x, _mm_set1_epi32((int)HASH_X)),
+                                _mm_set1_epi32((int)row_hash));
+  value = hash_sse4_1(
+      _mm_xor_si128(_mm_set1_epi32((int)seed), hash_sse4_1(value)));
+  return _mm_sub_ps(
+      _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(value, 8)),
+                 _mm_set1_ps(LATTICE_SCALE)),
+      _mm_set1_ps(1.0F));
+}
+
+__attribute__((target("sse4.1"))) void generate_row_sse4_1(
+    unsigned int seed, unsigned int x, unsigned int y, unsigned int count,
+    float *out) {
+  unsigned int idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    const __m128i vx = _mm_add_epi32(_mm_set1_epi32((int)(x + idx)),
+                                     _mm_setr_epi32(0, 1, 2, 3));
+    __m128 height = _mm_setzero_ps();
+    float amplitude = SURFACE_NOISE_AMPLITUDE;
+    for (unsigned int octave = 0; octave < SURFACE_NOISE_OCTAVES; ++octave) {
+      const unsigned int shift = get_cell_shift(octave);
+      const __m128i cx = _mm_srli_epi32(vx, (int)shift);
+      const __m128i cx1 = _mm_add_epi32(cx, _mm_set1_epi32(1));
+      const unsigned int cy = y >> shift;
+
+      // fade(t) = t * t * (3 - 2 * t)
+      __m128 tx = _mm_mul_ps(
+          _mm_cvtepi32_ps(
+              _mm_and_si128(vx, _mm_set1_epi32((int)((1U << shift) - 1)))),
+          _mm_set1_ps(1.0F / (float)(1U << shift)));
+      tx = _mm_mul_ps(_mm_mul_ps(tx, tx),
+                      _mm_sub_ps(_mm_set1_ps(3.0F),
+                                 _mm_mul_ps(_mm_set1_ps(2.0F), tx)));
+      const __m128 ty = _mm_set1_ps(cell_fraction(y, octave));
+
+      const unsigned int north_hash = cy * HASH_Y ^ octave * HASH_OCTAVE;
+      const unsigned int south_hash = (cy + 1) * HASH_Y ^ octave * HASH_OCTAVE;
+      const __m128 nw = lattice_value_sse4_1(seed, cx, north_hash);
+      const __m128 ne = lattice_value_sse4_1(seed, cx1, north_hash);
+      const __m128 sw = lattice_value_sse4_1(seed, cx, south_hash);
+      const __m128 se = lattice_value_sse4_1(seed, cx1, south_hash);
+      const __m128 north = _mm_add_ps(nw, _mm_mul_ps(_mm_sub_ps(ne, nw), tx));
+      const __m128 south = _mm_add_ps(sw, _mm_mul_ps(_mm_sub_ps(se, sw), tx));
+      height = _mm_add_ps(
+          height,
+          _mm_mul_ps(
+              _mm_add_ps(north, _mm_mul_ps(_mm_sub_ps(south, north), ty)),
+              _mm_set1_ps(amplitude)));
+
+      amplitude *= 0.5F;
+    }
+    _mm_storeu_ps(out + idx, height);
+  }
+  generate_row_scalar(seed, x + idx, y, count - idx, out + idx);
+}
+
+__attribute__((target("avx2"))) __m256i hash_avx2(__m256i value) {
+  value = _mm256_xor_si256(value, _mm256_srli_epi32(value, 16));
+  value = _mm256_mullo_epi32(value, _mm256_set1_epi32((int)HASH_MUL_A));
+  value = _mm256_xor_si256(value, _mm256_srli_epi32(value, 15));
+  value = _mm256_mullo_epi32(value, _mm256_set1_epi32((int)HASH_MUL_B));
+  return _mm256_xor_si256(value, _mm256_srli_epi32(value, 16));
+}
+
+__attribute__((target("avx2"))) __m256 lattice_value_avx2(
+    unsigned int seed, __m256i x, unsigned int row_hash) {
+  __m256i value =
+      _mm256_xor_si256(_mm256_mullo_epi32(x, _mm256_set1_epi32((int)HASH_X)),
+                       _mm256_set1_epi32((int)row_hash));
+  value = hash_avx2(
+      _mm256_xor_si256(_mm256_set1_epi32((int)seed), hash_avx2(value)));
+  return _mm256_sub_ps(
+      _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(value, 8)),
+                    _mm256_set1_ps(LATTICE_SCALE)),
+      _mm256_set1_ps(1.0F));
+}
+
+__attribute__((target("avx2"))) void generate_row_avx2(unsigned int seed,
+                                                       unsigned int x,
+                                                       unsigned int y,
+                                                       unsigned int count,
+                                                       float *out) {
+  unsigned int idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    const __m256i vx =
+        _mm256_add_epi32(_mm256_set1_epi32((int)(x + idx)),
+                         _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256 height = _mm256_setzero_ps();
+    float amplitude = SURFACE_NOISE_AMPLITUDE;
+    for (unsigned int octave = 0; octave < SURFACE_NOISE_OCTAVES; ++octave) {
+      const unsigned int shift = get_cell_shift(octave);
+      const __m256i cx = _mm256_srli_epi32(vx, (int)shift);
+      const __m256i cx1 = _mm256_add_epi32(cx, _mm256_set1_epi32(1));
+      const unsigned int cy = y >> shift;
+
+      // fade(t) = t * t * (3 - 2 * t)
+      __m256 tx = _mm256_mul_ps(
+          _mm256_cvtepi32_ps(_mm256_and_si256(
+              vx, _mm256_set1_epi32((int)((1U << shift) - 1)))),
+          _mm256_set1_ps(1.0F / (float)(1U << shift)));
+      tx = _mm256_mul_ps(
+          _mm256_mul_ps(tx, tx),
+          _mm256_sub_ps(_mm256_set1_ps(3.0F),
+                        _mm256_mul_ps(_mm256_set1_ps(2.0F), tx)));
+      const __m256 ty = _mm256_set1_ps(cell_fraction(y, octave));
+
+      const unsigned int north_hash = cy * HASH_Y ^ octave * HASH_OCTAVE;
+      const unsigned int south_hash = (cy + 1) * HASH_Y ^ octave * HASH_OCTAVE;
+      const __m256 nw = lattice_value_avx2(seed, cx, north_hash);
+      const __m256 ne = lattice_value_avx2(seed, cx1, north_hash);
+      const __m256 sw = lattice_value_avx2(seed, cx, south_hash);
+      const __m256 se = lattice_value_avx2(seed, cx1, south_hash);
+      const __m256 north =
+          _mm256_add_ps(nw, _mm256_mul_ps(_mm256_sub_ps(ne, nw), tx));
+      const __m256 south =
+          _mm256_add_ps(sw, _mm256_mul_ps(_mm256_sub_ps(se, sw), tx));
+      const __m256 value = _mm256_add_ps(
+          north, _mm256_mul_ps(_mm256_sub_ps(south, north), ty));
+      height = _mm256_add_ps(
+          height, _mm256_mul_ps(value, _mm256_set1_ps(amplitude)));
+
+      amplitude *= 0.5F;
+    }
+    _mm256_storeu_ps(out + idx, height);
+  }
+  generate_row_scalar(seed, x + idx, y, count - idx, out + idx);
+}
+#endif
+
+}  // namespace
+
+float get_surface_noise_height(unsigned int seed, unsigned int x,
+                               unsigned int y) {
+  float height = 0.0F;
+  float amplitude = SURFACE_NOISE_AMPLITUDE;
+  for (unsigned int octave = 0; octave < SURFACE_NOISE_OCTAVES; ++octave) {
+    const unsigned int shift = get_cell_shift(octave);
+    const unsigned int cx = x >> shift;
+    const unsigned int cy = y >> shift;
+    const float tx = cell_fraction(x, octave);
+    const float ty = cell_fraction(y, octave);
+
+    const float nw = lattice_value(seed, octave, cx, cy);
+    const float ne = lattice_value(seed, octave, cx + 1, cy);
+    const float sw = lattice_value(seed, octave, cx, cy + 1);
+    const float se = lattice_value(seed, octave, cx + 1, cy + 1);
+    const float north = nw + (ne - nw) * tx;
+    const float south = sw + (se - sw) * tx;
+    height += (north + (south - north) * ty) * amplitude;
+
+    amplitude *= 0.5F;
+  }
+  return height;
+}
+
+bool is_surface_noise_kernel_supported(SurfaceNoiseKernel kernel) {
+  switch (kernel) {
+    case SurfaceNoiseKernel::SCALAR:
+      return true;
+#ifdef SURFACE_NOISE_X86_KERNELS
+    case SurfaceNoiseKernel::SSE4_1:
+      return __builtin_cpu_supports("sse4.1");
+    case SurfaceNoiseKernel::AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+SurfaceNoiseKernel get_surface_noise_kernel() {
+  static const SurfaceNoiseKernel kernel = []() {
+    if (is_surface_noise_kernel_supported(SurfaceNoiseKernel::AVX2)) {
+      return SurfaceNoiseKernel::AVX2;
+    } else if (is_surface_noise_kernel_supported(SurfaceNoiseKernel::SSE4_1)) {
+      return SurfaceNoiseKernel::SSE4_1;
+    }
+    return SurfaceNoiseKernel::SCALAR;
+  }();
+  return kernel;
+}
+
+void generate_surface_noise_row(SurfaceNoiseKernel kernel, unsigned int seed,
+                                unsigned int x, unsigned int y,
+                                unsigned int count, float *out) {
+  switch (kernel) {
+#ifdef SURFACE_NOISE_X86_KERNELS
+    case SurfaceNoiseKernel::SSE4_1:
+      generate_row_sse4_1(seed, x, y, count, out);
+      break;
+    case SurfaceNoiseKernel::AVX2:
+      generate_row_avx2(seed, x, y, count, out);
+      break;
+#endif
+    default:
+      generate_row_scalar(seed, x, y, count, out);
+      break;
+  }
+}
+
+void generate_surface_noise_heights(unsigned int seed, unsigned int x,
+                                    unsigned int y, unsigned int width,
+                                    unsigned int height, float *out,
+                                    unsigned int out_stride) {
+  const SurfaceNoiseKernel kernel = get_surface_noise_kernel();
+  for (unsigned int row = 0; row < height; ++row) {
+    generate_surface_noise_row(kernel, seed, x, y + row, width,
+                               out + (std::size_t)row * out_stride);
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_NOISE_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_NOISE_H_
+
+// Value noise summed over octaves (fBm). The first octave has lattice cells of
+// SURFACE_NOISE_CELL_SIZE vertices, every further octave halves the cell size
+// and the amplitude.
+constexpr unsigned int SURFACE_NOISE_OCTAVES = 5;
+constexpr unsigned int SURFACE_NOISE_CELL_SIZE = 32;
+constexpr float SURFACE_NOISE_AMPLITUDE = 2.0F;
+
+/*
+ * Implementations of the noise, all of them give bit-identical results. The
+ * vectorised ones only exist on x86-64 and are picked at runtime depending on
+ * what the CPU supports.
+ */
+enum class SurfaceNoiseKernel { SCALAR, SSE4_1, AVX2 };
+
+/// Height of surface vertex (x, y), only depends on its arguments.
+extern float get_surface_noise_height(unsigned int seed, unsigned int x,
+                                      unsigned int y);
+
+extern bool is_surface_noise_kernel_supported(SurfaceNoiseKernel kernel);
+/// Fastest supported kernel, chosen on first call.
+extern SurfaceNoiseKernel get_surface_noise_kernel();
+
+/// Heights of vertices [x, x + count) of row y into out.
+extern void generate_surface_noise_row(SurfaceNoiseKernel kernel,
+                                       unsigned int seed, unsigned int x,
+                                       unsigned int y, unsigned int count,
+                                       float *out);
+
+/// Heights of vertices [x, x + width) x [y, y + height) into out, row by row
+/// with out_stride floats between rows. Same values as
+/// get_surface_noise_height().
+extern void generate_surface_noise_heights(unsigned int seed, unsigned int x,
+                                           unsigned int y, unsigned int width,
+                                           unsigned int height, float *out,
+                                           unsigned int out_stride);
+
+#endif
@@ -0,0 +1,517 @@
+#include "surface_renderer.h"
+
+// standard library includes
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+// third party includes
+#include <raymath.h>
+
+// local includes
+#include "3d_helpers.h"
+
+unsigned int get_surface_lod(float distance) {
+  unsigned int lod = 0;
+  for (float lod_distance = SURFACE_LOD_DISTANCE;
+       distance >= lod_distance && lod < SURFACE_LOD_MAX;
+       lod_distance *= 2.0F) {
+    ++lod;
+  }
+  return lod;
+}
+
+float get_stitched_chunk_height(const Surface::Chunk &chunk, unsigned int x,
+                                unsigned int y,
+                                const SurfaceChunkEdges &edge_steps) {
+  const unsigned int vertex_width = chunk.width + 1;
+  const auto vertex_fn = [&chunk, vertex_width](unsigned int vx,
+                                                unsigned int vy) {
+    return chunk.get_vertex(vx + (std::size_t)vy * vertex_width);
+  };
+
+  // Along a horizontal edge, interpolate between the edge's cell corners.
+  if ((y == 0 && edge_steps[0] > 1) ||
+      (y == chunk.height && edge_steps[1] > 1)) {
+    const unsigned int step = edge_steps[y == 0 ? 0 : 1];
+    const unsigned int x0 = x / step * step;
+    const unsigned int x1 = std::min(x0 + step, chunk.width);
+    if (x0 != x) {
+      const float t = (float)(x - x0) / (float)(x1 - x0);
+      return vertex_fn(x0, y) + (vertex_fn(x1, y) - vertex_fn(x0, y)) * t;
+    }
+  }
+  if ((x == 0 && edge_steps[2] > 1) ||
+      (x == chunk.width && edge_steps[3] > 1)) {
+    const unsigned int step = edge_steps[x == 0 ? 2 : 3];
+    const unsigned int y0 = y / step * step;
+    const unsigned int y1 = std::min(y0 + step, chunk.height);
+    if (y0 != y) {
+      const float t = (float)(y - y0) / (float)(y1 - y0);
+      return vertex_fn(x, y0) + (vertex_fn(x, y1) - vertex_fn(x, y0)) * t;
+    }
+  }
+  return vertex_fn(x, y);
+}
+
+void get_surface_height_texels(const Surface::Chunk &chunk,
+                               const SurfaceRect &rect,
+                               std::vector<std::uint16_t> &texels) {
+  texels.clear();
+  const float y_step = (chunk.max_y - chunk.min_y) / 65535.0F;
+  for (unsigned int y = rect.y_min; y <= rect.y_max; ++y) {
+    for (unsigned int x = rect.x_min; x <= rect.x_max; ++x) {
+      const std::size_t idx = x + (std::size_t)y * (chunk.width + 1);
+      if (chunk.quantized_vertices) {
+        texels.push_back(chunk.quantized_vertices[idx]);
+      } else if (y_step > 0.0F) {
+        texels.push_back((std::uint16_t)std::clamp(
+            std::round((chunk.vertices[idx] - chunk.min_y) / y_step), 0.0F,
+            65535.0F));
+      } else {
+        texels.push_back(0);
+      }
+    }
+  }
+}
+
+Color get_surface_unit_color(const Surface &surface, unsigned int x,
+                             unsigned int y) {
+  const int ox = (int)x - (int)(surface.get_width() / 2);
+  const int oy = (int)y - (int)(surface.get_height() / 2);
+  return Color{(unsigned char)(200 + ox * 2), (unsigned char)(150 + oy * 2),
+               20, 255};
+}
+
+SurfaceRenderer::SurfaceRenderer()
+    : textures(),
+      grid_meshes(),
+      visible_chunks(),
+      texels(),
+      drawn_triangle_count(0),
+      material(LoadMaterialDefault()),
+      default_texture(),
+      uniform_hit_tile(0),
+      uniform_hover_tile(0),
+      uniform_reset_y_offset(0),
+      uniform_chunk_size(0),
+      uniform_chunk_origin(0),
+      uniform_chunk_color_origin(0),
+      uniform_chunk_y(0),
+      uniform_edge_steps(0),
+      resident_min_y(0.0F),
+      resident_max_y(0.0F) {
+  default_texture = material.maps[MATERIAL_MAP_DIFFUSE].texture;
+  init_shader();
+}
+
+SurfaceRenderer::~SurfaceRenderer() {
+  clear();
+  for (auto &pair : grid_meshes) {
+    UnloadMesh(pair.second);
+  }
+  // Also unloads the surface shader.
+  UnloadMaterial(material);
+}
+
+void SurfaceRenderer::clear() {
+  for (auto &pair : textures) {
+    UnloadTexture(pair.second.texture);
+  }
+  textures.clear();
+}
+
+void SurfaceRenderer::draw(const Surface &surface, const Frustum &frustum,
+                           Vector3 camera_pos, std::size_t hit_idx,
+                           std::size_t hover_idx, float reset_y_offset) {
+  // Unload textures of evicted chunks.
+  for (auto iter = textures.begin(); iter != textures.end();) {
+    if (!surface.get_resident_chunk(iter->first)) {
+      UnloadTexture(iter->second.texture);
+      iter = textures.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  // Height range of the resident chunks, bounds groups of chunks.
+  bool is_first = true;
+  for (std::size_t idx = 0; idx < surface.get_chunk_count(); ++idx) {
+    if (const Surface::Chunk *chunk = surface.get_resident_chunk(idx)) {
+      resident_min_y =
+          is_first ? chunk->min_y : std::min(resident_min_y, chunk->min_y);
+      resident_max_y =
+          is_first ? chunk->max_y : std::max(resident_max_y, chunk->max_y);
+      is_first = false;
+    }
+  }
+  visible_chunks.clear();
+  cull_chunks(surface, frustum, 0, 0, surface.get_chunk_columns(),
+              surface.get_chunk_rows(), camera_pos, reset_y_offset, false);
+
+  // Unit center of the highlighted units, or far away if there is none.
+  const auto tile_fn = [&surface](std::size_t idx) {
+    if (idx >= surface.size()) {
+      return Vector2{-1.0e9F, -1.0e9F};
+    }
+    return Vector2{
+        (float)(idx % surface.get_width()) - surface.get_x_offset(),
+        (float)(idx / surface.get_width()) - surface.get_y_offset()};
+  };
+  const Vector2 hit_tile = tile_fn(hit_idx);
+  const Vector2 hover_tile = tile_fn(hover_idx);
+  SetShaderValue(material.shader, uniform_hit_tile, &hit_tile,
+                 SHADER_UNIFORM_VEC2);
+  SetShaderValue(material.shader, uniform_hover_tile, &hover_tile,
+                 SHADER_UNIFORM_VEC2);
+  SetShaderValue(material.shader, uniform_reset_y_offset, &reset_y_offset,
+                 SHADER_UNIFORM_FLOAT);
+
+  drawn_triangle_count = 0;
+  const unsigned int columns = surface.get_chunk_columns();
+  for (std::size_t idx : visible_chunks) {
+    const Surface::Chunk *chunk = surface.get_resident_chunk(idx);
+    const unsigned int lod = get_chunk_lod(surface, idx, camera_pos).value();
+
+    // Edges next to a coarser chunk use that chunk's cells.
+    SurfaceChunkEdges edge_steps{1, 1, 1, 1};
+    const unsigned int cx = idx % columns;
+    const unsigned int cy = idx / columns;
+    const std::array<std::optional<unsigned int>, 4> neighbour_lods{
+        cy > 0 ? get_chunk_lod(surface, idx - columns, camera_pos)
+               : std::nullopt,
+        cy + 1 < surface.get_chunk_rows()
+            ? get_chunk_lod(surface, idx + columns, camera_pos)
+            : std::nullopt,
+        cx > 0 ? get_chunk_lod(surface, idx - 1, camera_pos) : std::nullopt,
+        cx + 1 < columns ? get_chunk_lod(surface, idx + 1, camera_pos)
+                         : std::nullopt};
+    for (unsigned int edge = 0; edge < edge_steps.size(); ++edge) {
+      if (neighbour_lods[edge].has_value() &&
+          neighbour_lods[edge].value() > lod) {
+        edge_steps[edge] = 1 << neighbour_lods[edge].value();
+      }
+    }
+
+    const ChunkTexture &chunk_texture = update_chunk_texture(idx, *chunk);
+    const Vector2 chunk_size{(float)chunk->width, (float)chunk->height};
+    const Vector2 chunk_origin{
+        (float)chunk->x - surface.get_x_offset() - 0.5F,
+        (float)chunk->y - surface.get_y_offset() - 0.5F};
+    // Same as get_surface_unit_color().
+    const Vector2 chunk_color_origin{
+        (float)((int)chunk->x - (int)(surface.get_width() / 2)),
+        (float)((int)chunk->y - (int)(surface.get_height() / 2))};
+    const Vector2 chunk_y{chunk_texture.min_y,
+                          (chunk_texture.max_y - chunk_texture.min_y) /
+                              65535.0F};
+    const Vector4 shader_edge_steps{(float)edge_steps[0], (float)edge_steps[1],
+                                    (float)edge_steps[2], (float)edge_steps[3]};
+    SetShaderValue(material.shader, uniform_chunk_size, &chunk_size,
+                   SHADER_UNIFORM_VEC2);
+    SetShaderValue(material.shader, uniform_chunk_origin, &chunk_origin,
+                   SHADER_UNIFORM_VEC2);
+    SetShaderValue(material.shader, uniform_chunk_color_origin,
+                   &chunk_color_origin, SHADER_UNIFORM_VEC2);
+    SetShaderValue(material.shader, uniform_chunk_y, &chunk_y,
+                   SHADER_UNIFORM_VEC2);
+    SetShaderValue(material.shader, uniform_edge_steps, &shader_edge_steps,
+                   SHADER_UNIFORM_VEC4);
+    material.maps[MATERIAL_MAP_DIFFUSE].texture = chunk_texture.texture;
+
+    const Mesh &grid = get_grid_mesh(lod, chunk->width, chunk->height);
+    DrawMesh(grid, material, get_identity_matrix());
+    drawn_triangle_count += grid.triangleCount;
+  }
+  // UnloadMaterial() would unload the last chunk's texture otherwise.
+  material.maps[MATERIAL_MAP_DIFFUSE].texture = default_texture;
+}
+
+std::size_t SurfaceRenderer::get_drawn_chunk_count() const {
+  return visible_chunks.size();
+}
+
+std::size_t SurfaceRenderer::get_drawn_triangle_count() const {
+  return drawn_triangle_count;
+}
+
+void SurfaceRenderer::cull_chunks(const Surface &surface,
+                                  const Frustum &frustum, unsigned int x_min,
+                                  unsigned int y_min, unsigned int x_max,
+                                  unsigned int y_max, Vector3 camera_pos,
+                                  float y_offset, bool is_inside) {
+  if (x_min >= x_max || y_min >= y_max) {
+    return;
+  }
+
+  if (x_max - x_min == 1 && y_max - y_min == 1) {
+    const std::size_t idx =
+        x_min + (std::size_t)y_min * surface.get_chunk_columns();
+    const Surface::Chunk *chunk = surface.get_resident_chunk(idx);
+    if (!chunk) {
+      return;
+    }
+    BoundingBox bb = surface.get_chunk_bb(*chunk);
+    bb.min.y += y_offset;
+    bb.max.y += y_offset;
+    if (Vector3Distance(camera_pos, Vector3Clamp(camera_pos, bb.min, bb.max)) >
+            SURFACE_DRAW_DISTANCE ||
+        (!is_inside && !is_box_in_frustum(frustum, bb))) {
+      return;
+    }
+    visible_chunks.push_back(idx);
+    return;
+  }
+
+  if (!is_inside) {
+    const BoundingBox bb{
+        .min = Vector3{(float)(x_min * SURFACE_CHUNK_SIZE) -
+                           surface.get_x_offset() - 0.5F,
+                       resident_min_y + y_offset,
+                       (float)(y_min * SURFACE_CHUNK_SIZE) -
+                           surface.get_y_offset() - 0.5F},
+        .max = Vector3{(float)std::min(x_max * SURFACE_CHUNK_SIZE,
+                                       surface.get_width()) -
+                           surface.get_x_offset() - 0.5F,
+                       resident_max_y + y_offset,
+                       (float)std::min(y_max * SURFACE_CHUNK_SIZE,
+                                       surface.get_height()) -
+                           surface.get_y_offset() - 0.5F}};
+    if (Vector3Distance(camera_pos, Vector3Clamp(camera_pos, bb.min, bb.max)) >
+        SURFACE_DRAW_DISTANCE) {
+      return;
+    }
+    switch (test_box_in_frustum(frustum, bb)) {
+      case FrustumTest::OUTSIDE:
+        return;
+      case FrustumTest::INSIDE:
+        is_inside = true;
+        break;
+      case FrustumTest::INTERSECTS:
+        break;
+    }
+  }
+
+  const unsigned int x_mid = x_min + (x_max - x_min) / 2;
+  const unsigned int y_mid = y_min + (y_max - y_min) / 2;
+  cull_chunks(surface, frustum, x_min, y_min, x_mid, y_mid, camera_pos,
+              y_offset, is_inside);
+  cull_chunks(surface, frustum, x_mid, y_min, x_max, y_mid, camera_pos,
+              y_offset, is_inside);
+  cull_chunks(surface, frustum, x_min, y_mid, x_mid, y_max, camera_pos,
+              y_offset, is_inside);
+  cull_chunks(surface, frustum, x_mid, y_mid, x_max, y_max, camera_pos,
+              y_offset, is_inside);
+}
+
+void SurfaceRenderer::init_shader() {
+  // Heights, colors, highlighting of the hit and hovered units and the surface
+  // reset drop are all done on the GPU, so that drawing a static surface needs
+  // no per-frame vertex work and chunks share their meshes. Heights are decoded
+  // from the gray (low) and alpha (high) bytes of the little-endian texels,
+  // sampled at texel centers.
+  material.shader = LoadShaderFromMemory(
+      // vertex
+      "#version 100                       \n"
+      "attribute vec3 vertexPosition;     \n"
+      "attribute vec2 vertexTexCoord;     \n"
+      "varying vec4 fragColor;            \n"
+      "varying vec2 fragUnitPos;          \n"
+      "uniform mat4 mvp;                  \n"
+      "uniform sampler2D texture0;        \n"
+      "uniform vec2 chunk_size;           \n"
+      "uniform vec2 chunk_origin;         \n"
+      "uniform vec2 chunk_color_origin;   \n"
+      "uniform vec2 chunk_y;              \n"
+      "uniform vec4 edge_steps;           \n"
+      "uniform float reset_y_offset;      \n"
+      "float height(vec2 v)               \n"
+      "{                                  \n"
+      "    vec4 texel = texture2DLod(texture0, \n"
+      "                              (v + 0.5) / (chunk_size + 1.0), 0.0); \n"
+      "    float q = floor(texel.r * 255.0 + 0.5) + \n"
+      "              floor(texel.a * 255.0 + 0.5) * 256.0; \n"
+      "    return chunk_y.x + q * chunk_y.y; \n"
+      "}                                  \n"
+      "float stitched_height(vec2 v)      \n"
+      "{                                  \n"
+      "    if ((v.y == 0.0 && edge_steps.x > 1.0) || \n"
+      "        (v.y == chunk_size.y && edge_steps.y > 1.0)) { \n"
+      "        float size = v.y == 0.0 ? edge_steps.x : edge_steps.y; \n"
+      "        float x0 = floor(v.x / size) * size; \n"
+      "        float x1 = min(x0 + size, chunk_size.x); \n"
+      "        if (x0 != v.x) {           \n"
+      "            return mix(height(vec2(x0, v.y)), height(vec2(x1, v.y)), \n"
+      "                       (v.x - x0) / (x1 - x0)); \n"
+      "        }                          \n"
+      "    }                              \n"
+      "    if ((v.x == 0.0 && edge_steps.z > 1.0) || \n"
+      "        (v.x == chunk_size.x && edge_steps.w > 1.0)) { \n"
+      "        float size = v.x == 0.0 ? edge_steps.z : edge_steps.w; \n"
+      "        float y0 = floor(v.y / size) * size; \n"
+      "        float y1 = min(y0 + size, chunk_size.y); \n"
+      "        if (y0 != v.y) {           \n"
+      "            return mix(height(vec2(v.x, y0)), height(vec2(v.x, y1)), \n"
+      "                       (v.y - y0) / (y1 - y0)); \n"
+      "        }                          \n"
+      "    }                              \n"
+      "    return height(v);              \n"
+      "}                                  \n"
+      "void main()                        \n"
+      "{                                  \n"
+      "    vec2 unit = chunk_color_origin + vertexTexCoord; \n"
+      "    fragColor = vec4(mod(200.0 + unit.x * 2.0, 256.0) / 255.0, \n"
+      "                     mod(150.0 + unit.y * 2.0, 256.0) / 255.0, \n"
+      "                     20.0 / 255.0, 1.0); \n"
+      "    vec2 v = vertexPosition.xz;    \n"
+      "    fragUnitPos = chunk_origin + v; \n"
+      "    gl_Position = mvp*vec4(fragUnitPos.x, \n"
+      "                           stitched_height(v) + reset_y_offset, \n"
+      "                           fragUnitPos.y, 1.0); \n"
+      "}                                  \n",
+
+      // fragment
+      "#version 100                       \n"
+      "#ifdef GL_FRAGMENT_PRECISION_HIGH  \n"
+      "precision highp float;             \n"
+      "#else                              \n"
+      "precision mediump float;           \n"
+      "#endif                             \n"
+      "varying vec4 fragColor;            \n"
+      "varying vec2 fragUnitPos;          \n"
+      "uniform vec4 colDiffuse;           \n"
+      "uniform vec2 hit_tile;             \n"
+      "uniform vec2 hover_tile;           \n"
+      "void main()                        \n"
+      "{                                  \n"
+      "    vec2 diff = abs(fragUnitPos - hit_tile); \n"
+      "    vec2 hover_diff = abs(fragUnitPos - hover_tile); \n"
+      "    if (diff.x < 0.5 && diff.y < 0.5) { \n"
+      "        gl_FragColor = vec4(0.96, 0.96, 0.96, 1.0); \n"
+      "    } else if (hover_diff.x < 0.5 && hover_diff.y < 0.5) { \n"
+      "        gl_FragColor = vec4(mix(fragColor.rgb*colDiffuse.rgb, \n"
+      "                                vec3(0.96, 0.96, 0.96), 0.5), 1.0); \n"
+      "    } else {                       \n"
+      "        gl_FragColor = fragColor*colDiffuse; \n"
+      "    }                              \n"
+      "}                                  \n");
+
+  uniform_hit_tile = GetShaderLocation(material.shader, "hit_tile");
+  uniform_hover_tile = GetShaderLocation(material.shader, "hover_tile");
+  uniform_reset_y_offset =
+      GetShaderLocation(material.shader, "reset_y_offset");
+  uniform_chunk_size = GetShaderLocation(material.shader, "chunk_size");
+  uniform_chunk_origin = GetShaderLocation(material.shader, "chunk_origin");
+  uniform_chunk_color_origin =
+      GetShaderLocation(material.shader, "chunk_color_origin");
+  uniform_chunk_y = GetShaderLocation(material.shader, "chunk_y");
+  uniform_edge_steps = GetShaderLocation(material.shader, "edge_steps");
+}
+
+std::optional<unsigned int> SurfaceRenderer::get_chunk_lod(
+    const Surface &surface, std::size_t chunk_idx, Vector3 camera_pos) const {
+  const Surface::Chunk *chunk = surface.get_resident_chunk(chunk_idx);
+  if (!chunk) {
+    return std::nullopt;
+  }
+  const BoundingBox bb = surface.get_chunk_bb(*chunk);
+  return get_surface_lod(
+      Vector3Distance(camera_pos, Vector3Clamp(camera_pos, bb.min, bb.max)));
+}
+
+const SurfaceRenderer::ChunkTexture &SurfaceRenderer::update_chunk_texture(
+    std::size_t chunk_idx, const Surface::Chunk &chunk) {
+  const SurfaceRect all{0, 0, chunk.width, chunk.height};
+  auto iter = textures.find(chunk_idx);
+  if (iter == textures.end()) {
+    get_surface_height_texels(chunk, all, texels);
+    const Image image{.data = texels.data(),
+                      .width = (int)chunk.width + 1,
+                      .height = (int)chunk.height + 1,
+                      .mipmaps = 1,
+                      .format = PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA};
+    const Texture2D texture = LoadTextureFromImage(image);
+    // Not a power of two, so it can't repeat on WebGL 1.
+    SetTextureFilter(texture, TEXTURE_FILTER_POINT);
+    SetTextureWrap(texture, TEXTURE_WRAP_CLAMP);
+    return textures
+        .emplace(chunk_idx, ChunkTexture{.texture = texture,
+                                         .version = chunk.version,
+                                         .min_y = chunk.min_y,
+                                         .max_y = chunk.max_y})
+        .first->second;
+  }
+
+  ChunkTexture &chunk_texture = iter->second;
+  if (chunk_texture.version == chunk.version) {
+    return chunk_texture;
+  }
+  // Texels are fractions of the chunk's range, so if it changed every texel
+  // has to be uploaded again.
+  if (chunk_texture.version == chunk.dirty_version &&
+      chunk_texture.min_y == chunk.min_y &&
+      chunk_texture.max_y == chunk.max_y) {
+    get_surface_height_texels(chunk, chunk.dirty, texels);
+    UpdateTextureRec(
+        chunk_texture.texture,
+        Rectangle{(float)chunk.dirty.x_min, (float)chunk.dirty.y_min,
+                  (float)(chunk.dirty.x_max - chunk.dirty.x_min + 1),
+                  (float)(chunk.dirty.y_max - chunk.dirty.y_min + 1)},
+        texels.data());
+  } else {
+    get_surface_height_texels(chunk, all, texels);
+    UpdateTexture(chunk_texture.texture, texels.data());
+  }
+  chunk_texture.version = chunk.version;
+  chunk_texture.min_y = chunk.min_y;
+  chunk_texture.max_y = chunk.max_y;
+  return chunk_texture;
+}
+
+const Mesh &SurfaceRenderer::get_grid_mesh(unsigned int lod, unsigned int width,
+                                           unsigned int height) {
+  const GridKey key{lod, width, height};
+  if (auto iter = grid_meshes.find(key); iter != grid_meshes.end()) {
+    return iter->second;
+  }
+
+  // Two triangles per cell of (2^lod)x(2^lod) units, vertices are not shared
+  // between cells so that each cell keeps a flat color. Positions are chunk
+  // vertices, texture coordinates the nw unit of the vertex's cell.
+  Mesh mesh{};
+  const unsigned int step = 1 << lod;
+  const unsigned int cell_columns = (width + step - 1) / step;
+  const unsigned int cell_rows = (height + step - 1) / step;
+  const int vertex_count = cell_columns * cell_rows * 6;
+  mesh.vertexCount = vertex_count;
+  mesh.triangleCount = vertex_count / 3;
+  mesh.vertices = (float *)MemAlloc(vertex_count * 3 * sizeof(float));
+  mesh.texcoords = (float *)MemAlloc(vertex_count * 2 * sizeof(float));
+
+  unsigned int cell_idx = 0;
+  for (unsigned int y0 = 0; y0 < height; y0 += step) {
+    const unsigned int y1 = std::min(y0 + step, height);
+    for (unsigned int x0 = 0; x0 < width; x0 += step, ++cell_idx) {
+      const unsigned int x1 = std::min(x0 + step, width);
+      // Same winding as the previous DrawTriangle3D calls.
+      const std::array<Vector2, 6> cell_vertices{
+          Vector2{(float)x0, (float)y0}, Vector2{(float)x0, (float)y1},
+          Vector2{(float)x1, (float)y0}, Vector2{(float)x1, (float)y1},
+          Vector2{(float)x1, (float)y0}, Vector2{(float)x0, (float)y1}};
+      for (unsigned int vidx = 0; vidx < cell_vertices.size(); ++vidx) {
+        float *vertex = mesh.vertices + (cell_idx * 6 + vidx) * 3;
+        vertex[0] = cell_vertices[vidx].x;
+        vertex[1] = 0.0F;
+        vertex[2] = cell_vertices[vidx].y;
+
+        float *texcoord = mesh.texcoords + (cell_idx * 6 + vidx) * 2;
+        texcoord[0] = (float)x0;
+        texcoord[1] = (float)y0;
+      }
+    }
+  }
+
+  UploadMesh(&mesh, false);
+  return grid_meshes.emplace(key, mesh).first->second;
+}
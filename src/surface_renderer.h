@@ -0,0 +1,147 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_RENDERER_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_RENDERER_H_
+
+// standard library includes
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+// local includes
+#include "3d_helpers.h"
+#include "surface.h"
+
+// Chunks closer than this to the camera are drawn at full resolution, every
+// doubling of the distance halves the resolution down to SURFACE_LOD_MAX.
+constexpr float SURFACE_LOD_DISTANCE = 24.0F;
+constexpr unsigned int SURFACE_LOD_MAX = 4;
+// Chunks further than this from the camera are not drawn.
+constexpr float SURFACE_DRAW_DISTANCE = 192.0F;
+
+/// Level of detail for a chunk at distance, a chunk at level n is drawn with
+/// cells of (2^n)x(2^n) units.
+extern unsigned int get_surface_lod(float distance);
+
+/// Edges of a chunk in order north (y == 0), south, west (x == 0), east.
+using SurfaceChunkEdges = std::array<unsigned int, 4>;
+
+/// Height of the chunk's vertex (x, y) with vertices on an edge snapped to the
+/// cells of that edge's step, so that the edge matches a neighbour drawn with
+/// larger cells. The surface's vertex shader does the same.
+extern float get_stitched_chunk_height(const Surface::Chunk &chunk,
+                                       unsigned int x, unsigned int y,
+                                       const SurfaceChunkEdges &edge_steps);
+
+/// Heights of the chunk's vertices within rect, in chunk vertices, as texels
+/// of its height texture. Texels are row by row 16-bit fractions of the
+/// chunk's min_y to max_y, the vertices of a UNORM16 chunk as they are.
+extern void get_surface_height_texels(const Surface::Chunk &chunk,
+                                      const SurfaceRect &rect,
+                                      std::vector<std::uint16_t> &texels);
+
+/// Color of unit (x, y) of the surface.
+extern Color get_surface_unit_color(const Surface &surface, unsigned int x,
+                                    unsigned int y);
+
+/*
+ * Draws the resident chunks of a Surface by displacing flat grid meshes with
+ * the chunks' heights in the vertex shader.
+ *
+ * Every resident chunk's heights are uploaded to a height texture of
+ * (width + 1)x(height + 1) 16-bit texels, stored as gray and alpha bytes so
+ * that no float texture support is needed. Only the texels of the chunk's
+ * latest edit are uploaded again if the texture was up to date before it. The
+ * texture is unloaded once the chunk is evicted from the Surface.
+ *
+ * The grid meshes hold no heights or colors, so one per level of detail and
+ * chunk size is shared by all chunks. Cell colors are computed from the grid
+ * coordinates in the shader. Edges next to a chunk with a coarser level of
+ * detail are stitched to it in the shader so that there are no cracks between
+ * chunks.
+ *
+ * Chunks outside the view frustum or further than SURFACE_DRAW_DISTANCE are
+ * skipped by testing quads of the chunk grid from the whole surface down to
+ * single chunks.
+ */
+class SurfaceRenderer {
+ public:
+  SurfaceRenderer();
+  ~SurfaceRenderer();
+
+  // No copy.
+  SurfaceRenderer(const SurfaceRenderer &) = delete;
+  SurfaceRenderer &operator=(const SurfaceRenderer &) = delete;
+
+  // No move.
+  SurfaceRenderer(SurfaceRenderer &&) = delete;
+  SurfaceRenderer &operator=(SurfaceRenderer &&) = delete;
+
+  /// Unloads all height textures, must be called when the Surface is replaced.
+  void clear();
+
+  /// Assumes 3D mode is active. hit_idx and the fainter hover_idx are
+  /// highlighted if less than surface.size().
+  void draw(const Surface &surface, const Frustum &frustum,
+            Vector3 camera_pos, std::size_t hit_idx, std::size_t hover_idx,
+            float reset_y_offset);
+
+  /// Number of chunks drawn by the last draw().
+  std::size_t get_drawn_chunk_count() const;
+  /// Number of triangles drawn by the last draw().
+  std::size_t get_drawn_triangle_count() const;
+
+ private:
+  struct ChunkTexture {
+    Texture2D texture;
+    unsigned long long version;
+    /// Range of the chunk when its texels were uploaded.
+    float min_y, max_y;
+  };
+  /// Level of detail, width and height of a chunk.
+  using GridKey = std::array<unsigned int, 3>;
+
+  std::unordered_map<std::size_t, ChunkTexture> textures;
+  std::map<GridKey, Mesh> grid_meshes;
+  std::vector<std::size_t> visible_chunks;
+  std::vector<std::uint16_t> texels;
+  std::size_t drawn_triangle_count;
+  Material material;
+  Texture2D default_texture;
+  int uniform_hit_tile;
+  int uniform_hover_tile;
+  int uniform_reset_y_offset;
+  int uniform_chunk_size;
+  int uniform_chunk_origin;
+  int uniform_chunk_color_origin;
+  int uniform_chunk_y;
+  int uniform_edge_steps;
+  float resident_min_y;
+  float resident_max_y;
+
+  void init_shader();
+  /// Adds the visible resident chunks of chunk columns [x_min, x_max) and rows
+  /// [y_min, y_max) to visible_chunks, without testing if is_inside.
+  void cull_chunks(const Surface &surface, const Frustum &frustum,
+                   unsigned int x_min, unsigned int y_min, unsigned int x_max,
+                   unsigned int y_max, Vector3 camera_pos, float y_offset,
+                   bool is_inside);
+  /// Level of detail of a resident chunk, nullopt if not resident.
+  std::optional<unsigned int> get_chunk_lod(const Surface &surface,
+                                            std::size_t chunk_idx,
+                                            Vector3 camera_pos) const;
+  /// Uploads the chunk's heights if they changed since the last upload.
+  const ChunkTexture &update_chunk_texture(std::size_t chunk_idx,
+                                           const Surface::Chunk &chunk);
+  /// Grid of (2^lod)x(2^lod) unit cells covering a chunk of width x height
+  /// units, built on first use.
+  const Mesh &get_grid_mesh(unsigned int lod, unsigned int width,
+                            unsigned int height);
+};
+
+#endif
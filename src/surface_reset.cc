@@ -0,0 +1,163 @@
+#include "surface_reset.h"
+
+// standard library includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// local includes
+#include "surface_renderer.h"
+#include "surface_shatter.h"
+
+namespace {
+
+// Triangles are built in batches of this many units between checks of the
+// time spent.
+constexpr std::size_t UNIT_BATCH_SIZE = 1024;
+// Mesh arrays are filled in batches of this many triangles.
+constexpr std::size_t TRIANGLE_BATCH_SIZE = 4096;
+
+}  // namespace
+
+SurfaceReset::SurfaceReset(const Surface &current,
+                           std::unique_ptr<Surface> next,
+                           std::vector<Vector3> focus_points, float radius,
+                           unsigned int triangle_seed, std::size_t idx_hit,
+                           bool is_gpu_animated,
+                           SurfaceTriangleBatch triangles)
+    : units(),
+      triangles(std::move(triangles)),
+      colors(),
+      mesh{},
+      next(std::move(next)),
+      focus_points(std::move(focus_points)),
+      focus_chunks(),
+      engine(triangle_seed),
+      next_unit(0),
+      next_triangle(0),
+      next_chunk(0),
+      idx_hit(idx_hit),
+      radius(radius),
+      is_gpu_animated(is_gpu_animated),
+      is_mesh_allocated(false),
+      is_mesh_filled(false) {
+  // Copying the heights is much cheaper than building the triangles.
+  units.reserve(current.get_resident_chunk_count() * SURFACE_CHUNK_SIZE *
+                SURFACE_CHUNK_SIZE);
+  for (std::size_t cidx = 0; cidx < current.get_chunk_count(); ++cidx) {
+    const Surface::Chunk *chunk = current.get_resident_chunk(cidx);
+    if (!chunk) {
+      continue;
+    }
+    for (unsigned int y = chunk->y; y < chunk->y + chunk->height; ++y) {
+      for (unsigned int x = chunk->x; x < chunk->x + chunk->width; ++x) {
+        units.push_back(
+            Unit{.heights = current[x + (std::size_t)y * current.get_width()],
+                 .x = (float)x - current.get_x_offset(),
+                 .z = (float)y - current.get_y_offset(),
+                 .idx = x + (std::size_t)y * current.get_width()});
+      }
+    }
+  }
+  this->triangles.clear();
+  this->triangles.reserve(units.size() * 2);
+  colors.reserve(units.size() * 2);
+  focus_chunks = this->next->get_focus_chunks(this->focus_points, radius);
+}
+
+SurfaceReset::~SurfaceReset() {
+  if (is_mesh_allocated) {
+    free_surface_shatter_mesh(mesh);
+  }
+}
+
+void SurfaceReset::run() {
+  for (; next_unit < units.size(); ++next_unit) {
+    append_unit(units[next_unit]);
+  }
+  fill_mesh(triangles.size());
+  if (next_chunk < focus_chunks.size()) {
+    next->update_residency(focus_points, radius);
+    next_chunk = focus_chunks.size();
+  }
+}
+
+bool SurfaceReset::step(double max_seconds) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto is_over_fn = [start, max_seconds]() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+               .count() >= max_seconds;
+  };
+
+  while (next_unit < units.size()) {
+    const std::size_t end = std::min(next_unit + UNIT_BATCH_SIZE, units.size());
+    for (; next_unit < end; ++next_unit) {
+      append_unit(units[next_unit]);
+    }
+    if (is_over_fn()) {
+      return false;
+    }
+  }
+  while (!is_mesh_filled) {
+    fill_mesh(std::min(next_triangle + TRIANGLE_BATCH_SIZE, triangles.size()));
+    if (is_over_fn()) {
+      return false;
+    }
+  }
+  // A chunk at a time, the next update_residency() finds them resident.
+  while (next_chunk < focus_chunks.size()) {
+    next->get_chunk(focus_chunks[next_chunk++]);
+    if (is_over_fn()) {
+      break;
+    }
+  }
+  return next_chunk == focus_chunks.size();
+}
+
+std::unique_ptr<Surface> SurfaceReset::take_surface() {
+  return std::move(next);
+}
+
+SurfaceTriangleBatch SurfaceReset::take_triangles() {
+  return std::move(triangles);
+}
+
+const std::vector<Color> &SurfaceReset::get_colors() const { return colors; }
+
+Mesh SurfaceReset::take_mesh() {
+  const Mesh taken = mesh;
+  mesh = Mesh{};
+  is_mesh_allocated = false;
+  return taken;
+}
+
+void SurfaceReset::append_unit(const Unit &unit) {
+  append_unit_triangles(triangles, unit.heights, unit.x, unit.z, engine);
+  // The next surface has the same size, so its unit colors are the same.
+  const Color color =
+      unit.idx == idx_hit
+          ? RAYWHITE
+          : get_surface_unit_color(*next, unit.idx % next->get_width(),
+                                   unit.idx / next->get_width());
+  colors.push_back(color);
+  colors.push_back(color);
+}
+
+void SurfaceReset::fill_mesh(std::size_t end) {
+  if (!is_mesh_allocated) {
+    mesh = alloc_surface_shatter_mesh(triangles.size(), is_gpu_animated);
+    is_mesh_allocated = true;
+  }
+  fill_surface_shatter_mesh(mesh, triangles, colors, next_triangle, end,
+                            is_gpu_animated);
+  next_triangle = end;
+  if (next_triangle < triangles.size() || is_mesh_filled) {
+    return;
+  }
+  if (!is_gpu_animated) {
+    // The vertices are animated on the CPU from these.
+    get_surface_triangle_vertices(triangles, 0.0F, mesh.vertices);
+  }
+  is_mesh_filled = true;
+}
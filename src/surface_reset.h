@@ -0,0 +1,92 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_RESET_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_RESET_H_
+
+// standard library includes
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+// local includes
+#include "surface.h"
+#include "surface_triangle.h"
+
+/*
+ * Prepares a surface reset away from the frame loop: the shatter triangles of
+ * the current surface's resident chunks, their colors and mesh arrays, and the
+ * chunks of the next surface around the focus points. So the frame that swaps
+ * the surfaces only uploads the mesh.
+ *
+ * The constructor copies what it needs from the current surface, after that
+ * the reset only touches its own data. So run() may be called on a worker
+ * thread while the current surface is still used, or step() once per frame
+ * where there are no threads.
+ */
+class SurfaceReset {
+ public:
+  /// The triangles are built into the given batch, which is cleared first, so
+  /// that a batch from an earlier reset is reused without allocating. The unit
+  /// at idx_hit is colored RAYWHITE, the mesh is filled as
+  /// SurfaceShatter::is_gpu_animated() needs it.
+  SurfaceReset(const Surface &current, std::unique_ptr<Surface> next,
+               std::vector<Vector3> focus_points, float radius,
+               unsigned int triangle_seed, std::size_t idx_hit,
+               bool is_gpu_animated,
+               SurfaceTriangleBatch triangles = SurfaceTriangleBatch());
+  /// Frees the mesh arrays if they weren't taken.
+  ~SurfaceReset();
+
+  // No copy.
+  SurfaceReset(const SurfaceReset &) = delete;
+  SurfaceReset &operator=(const SurfaceReset &) = delete;
+
+  // No move.
+  SurfaceReset(SurfaceReset &&) = delete;
+  SurfaceReset &operator=(SurfaceReset &&) = delete;
+
+  /// Does all remaining work, generating chunks on the next surface's threads.
+  void run();
+  /// Does work for about max_seconds, true once all of it is done.
+  bool step(double max_seconds);
+
+  /// Only valid once done.
+  std::unique_ptr<Surface> take_surface();
+  SurfaceTriangleBatch take_triangles();
+  /// One color per triangle.
+  const std::vector<Color> &get_colors() const;
+  /// Arrays for SurfaceShatter::load(), not uploaded yet.
+  Mesh take_mesh();
+
+ private:
+  struct Unit {
+    SurfaceUnit heights;
+    float x, z;
+    std::size_t idx;
+  };
+
+  void append_unit(const Unit &unit);
+  /// Fills the mesh arrays of triangles next_triangle to end.
+  void fill_mesh(std::size_t end);
+
+  std::vector<Unit> units;
+  SurfaceTriangleBatch triangles;
+  std::vector<Color> colors;
+  Mesh mesh;
+  std::unique_ptr<Surface> next;
+  std::vector<Vector3> focus_points;
+  std::vector<std::size_t> focus_chunks;
+  std::minstd_rand engine;
+  std::size_t next_unit;
+  std::size_t next_triangle;
+  std::size_t next_chunk;
+  std::size_t idx_hit;
+  float radius;
+  bool is_gpu_animated;
+  bool is_mesh_allocated;
+  bool is_mesh_filled;
+};
+
+#endif
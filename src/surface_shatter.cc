@@ -0,0 +1,197 @@
+#include "surface_shatter.h"
+
+// standard library includes
+#include <utility>
+
+// third party includes
+#include <raymath.h>
+#include <rlgl.h>
+
+// local includes
+#include "3d_helpers.h"
+
+Mesh alloc_surface_shatter_mesh(std::size_t triangle_count,
+                                bool is_gpu_animated) {
+  Mesh mesh{};
+  const unsigned int vertex_count = (unsigned int)triangle_count * 3;
+  mesh.vertexCount = (int)vertex_count;
+  mesh.triangleCount = (int)triangle_count;
+  mesh.vertices = (float *)MemAlloc(vertex_count * 3 * sizeof(float));
+  mesh.colors = (unsigned char *)MemAlloc(vertex_count * 4);
+  if (is_gpu_animated) {
+    mesh.texcoords = (float *)MemAlloc(vertex_count * 2 * sizeof(float));
+    mesh.normals = (float *)MemAlloc(vertex_count * 3 * sizeof(float));
+    mesh.tangents = (float *)MemAlloc(vertex_count * 4 * sizeof(float));
+  }
+  return mesh;
+}
+
+void fill_surface_shatter_mesh(Mesh &mesh,
+                               const SurfaceTriangleBatch &triangles,
+                               const std::vector<Color> &colors,
+                               std::size_t begin, std::size_t end,
+                               bool is_gpu_animated) {
+  for (std::size_t tri_idx = begin; tri_idx < end; ++tri_idx) {
+    for (std::size_t k = 0; k < 3; ++k) {
+      const std::size_t idx = tri_idx * 3 + k;
+      unsigned char *color = mesh.colors + idx * 4;
+      color[0] = colors[tri_idx].r;
+      color[1] = colors[tri_idx].g;
+      color[2] = colors[tri_idx].b;
+      color[3] = 255;
+      if (!is_gpu_animated) {
+        continue;
+      }
+
+      float *vertex = mesh.vertices + idx * 3;
+      vertex[0] = triangles.x[k][tri_idx];
+      vertex[1] = triangles.y[k][tri_idx];
+      vertex[2] = triangles.z[k][tri_idx];
+
+      float *texcoord = mesh.texcoords + idx * 2;
+      texcoord[0] = triangles.pos_x[tri_idx];
+      texcoord[1] = triangles.pos_z[tri_idx];
+
+      float *normal = mesh.normals + idx * 3;
+      normal[0] = triangles.axis_x[tri_idx];
+      normal[1] = triangles.axis_y[tri_idx];
+      normal[2] = triangles.axis_z[tri_idx];
+
+      float *tangent = mesh.tangents + idx * 4;
+      tangent[0] = triangles.move_x[tri_idx];
+      tangent[1] = triangles.move_y[tri_idx];
+      tangent[2] = triangles.move_z[tri_idx];
+      tangent[3] = triangles.pos_y[tri_idx];
+    }
+  }
+}
+
+void free_surface_shatter_mesh(Mesh &mesh) {
+  MemFree(mesh.vertices);
+  MemFree(mesh.colors);
+  MemFree(mesh.texcoords);
+  MemFree(mesh.normals);
+  MemFree(mesh.tangents);
+  mesh = Mesh{};
+}
+
+SurfaceShatter::SurfaceShatter()
+    : triangles(),
+      mesh{},
+      material(LoadMaterialDefault()),
+      uniform_shatter(0),
+      triangle_count(0),
+      is_mesh_loaded(false),
+      is_shader_loaded(false) {
+  init_shader();
+}
+
+SurfaceShatter::~SurfaceShatter() {
+  clear();
+  // Also unloads the shatter shader.
+  UnloadMaterial(material);
+}
+
+void SurfaceShatter::load(SurfaceTriangleBatch new_triangles, Mesh new_mesh) {
+  clear();
+  triangles = std::move(new_triangles);
+  triangle_count = triangles.size();
+  if (triangles.size() == 0) {
+    free_surface_shatter_mesh(new_mesh);
+    return;
+  }
+
+  mesh = new_mesh;
+  if (is_shader_loaded) {
+    UploadMesh(&mesh, false);
+    // Everything the shader needs is in the mesh now.
+    triangles.clear();
+  } else {
+    UploadMesh(&mesh, true);
+  }
+  is_mesh_loaded = true;
+}
+
+void SurfaceShatter::clear() {
+  if (is_mesh_loaded) {
+    UnloadMesh(mesh);
+    mesh = Mesh{};
+    is_mesh_loaded = false;
+  }
+  triangles.clear();
+  triangle_count = 0;
+}
+
+SurfaceTriangleBatch SurfaceShatter::take_triangles() {
+  triangles.clear();
+  return std::move(triangles);
+}
+
+void SurfaceShatter::draw(float time, unsigned char alpha) {
+  if (!is_mesh_loaded) {
+    return;
+  }
+
+  if (is_shader_loaded) {
+    const Vector2 shatter{time * SURFACE_TRIANGLE_ROTATION_RATE,
+                          time * SURFACE_TRIANGLE_MOVE_RATE};
+    SetShaderValue(material.shader, uniform_shatter, &shatter,
+                   SHADER_UNIFORM_VEC2);
+  } else {
+    get_surface_triangle_vertices(triangles, time, mesh.vertices);
+    UpdateMeshBuffer(mesh, 0, mesh.vertices,
+                     mesh.vertexCount * 3 * sizeof(float), 0);
+  }
+  material.maps[MATERIAL_MAP_DIFFUSE].color = Color{255, 255, 255, alpha};
+  DrawMesh(mesh, material, get_identity_matrix());
+}
+
+bool SurfaceShatter::is_gpu_animated() const { return is_shader_loaded; }
+
+std::size_t SurfaceShatter::get_triangle_count() const {
+  return triangle_count;
+}
+
+void SurfaceShatter::init_shader() {
+  // Same as SurfaceTriangle::get_vertex(), shatter is the rotation angle and
+  // move amount at the current time.
+  material.shader = LoadShaderFromMemory(
+      // vertex
+      "#version 100                       \n"
+      "attribute vec3 vertexPosition;     \n"
+      "attribute vec2 vertexTexCoord;     \n"
+      "attribute vec3 vertexNormal;       \n"
+      "attribute vec4 vertexTangent;      \n"
+      "attribute vec4 vertexColor;        \n"
+      "varying vec4 fragColor;            \n"
+      "uniform mat4 mvp;                  \n"
+      "uniform vec2 shatter;              \n"
+      "void main()                        \n"
+      "{                                  \n"
+      "    vec3 v = vertexPosition;       \n"
+      "    vec3 k = vertexNormal;         \n"
+      "    float c = cos(shatter.x);      \n"
+      "    float s = sin(shatter.x);      \n"
+      "    vec3 rotated = v * c + cross(k, v) * s + \n"
+      "                   k * dot(k, v) * (1.0 - c); \n"
+      "    vec3 origin = vec3(vertexTexCoord.x, vertexTangent.w, \n"
+      "                       vertexTexCoord.y); \n"
+      "    fragColor = vertexColor;       \n"
+      "    gl_Position = mvp*vec4(rotated + origin + \n"
+      "                           vertexTangent.xyz * shatter.y, 1.0); \n"
+      "}                                  \n",
+
+      // fragment
+      "#version 100                       \n"
+      "precision mediump float;           \n"
+      "varying vec4 fragColor;            \n"
+      "uniform vec4 colDiffuse;           \n"
+      "void main()                        \n"
+      "{                                  \n"
+      "    gl_FragColor = fragColor*colDiffuse; \n"
+      "}                                  \n");
+
+  // A shader that fails to compile is replaced by raylib's default one.
+  is_shader_loaded = material.shader.id != rlGetShaderIdDefault();
+  uniform_shatter = GetShaderLocation(material.shader, "shatter");
+}
@@ -0,0 +1,91 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_SHATTER_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_SURFACE_SHATTER_H_
+
+// standard library includes
+#include <cstddef>
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+// local includes
+#include "surface_triangle.h"
+
+/// Allocates the CPU arrays of a shatter mesh for triangle_count triangles,
+/// with the attributes the shader needs if is_gpu_animated. Doesn't touch the
+/// GPU, so it may be called on any thread.
+extern Mesh alloc_surface_shatter_mesh(std::size_t triangle_count,
+                                       bool is_gpu_animated);
+/// Writes triangles begin to end, colored with colors (one per triangle), into
+/// the mesh's arrays. Without is_gpu_animated only the colors are written, the
+/// vertices are written by get_surface_triangle_vertices().
+extern void fill_surface_shatter_mesh(Mesh &mesh,
+                                      const SurfaceTriangleBatch &triangles,
+                                      const std::vector<Color> &colors,
+                                      std::size_t begin, std::size_t end,
+                                      bool is_gpu_animated);
+/// Frees the arrays of a mesh that was never uploaded.
+extern void free_surface_shatter_mesh(Mesh &mesh);
+
+/*
+ * Draws the triangles of a reset surface flying apart.
+ *
+ * The triangles are uploaded once into a static mesh. Each vertex holds its
+ * position relative to the triangle's origin, with the triangle's rotation
+ * axis as its normal and its move direction and the origin's y as its
+ * tangent. The origin's x and z are its texture coordinates. The vertex
+ * shader evaluates SurfaceTriangle::get_vertex() from the time since the
+ * reset, so a frame of the animation is one draw call without any work per
+ * triangle on the CPU.
+ *
+ * If the shader can't be compiled the triangles are kept and every frame
+ * get_surface_triangle_vertices() writes their vertices into a dynamic mesh
+ * instead, still drawn with one call.
+ *
+ * The mesh's arrays are filled by the free functions above away from the
+ * frame loop, see SurfaceReset, so load() only uploads them. The triangle
+ * batch is handed back by take_triangles() once the animation is over, so
+ * that the next reset fills the same arrays.
+ */
+class SurfaceShatter {
+ public:
+  SurfaceShatter();
+  ~SurfaceShatter();
+
+  // No copy.
+  SurfaceShatter(const SurfaceShatter &) = delete;
+  SurfaceShatter &operator=(const SurfaceShatter &) = delete;
+
+  // No move.
+  SurfaceShatter(SurfaceShatter &&) = delete;
+  SurfaceShatter &operator=(SurfaceShatter &&) = delete;
+
+  /// Replaces the triangles and uploads new_mesh, filled for them with
+  /// fill_surface_shatter_mesh() and is_gpu_animated(), taking ownership of
+  /// its arrays. Alpha is set by draw().
+  void load(SurfaceTriangleBatch new_triangles, Mesh new_mesh);
+  void clear();
+  /// The emptied batch of the last load(), for the next reset to reuse.
+  SurfaceTriangleBatch take_triangles();
+
+  /// Assumes 3D mode is active. time is seconds since the reset.
+  void draw(float time, unsigned char alpha);
+
+  /// False if the triangles are animated on the CPU.
+  bool is_gpu_animated() const;
+  std::size_t get_triangle_count() const;
+
+ private:
+  /// Empty unless the animation runs on the CPU, kept for its capacity.
+  SurfaceTriangleBatch triangles;
+  Mesh mesh;
+  Material material;
+  int uniform_shatter;
+  std::size_t triangle_count;
+  bool is_mesh_loaded;
+  bool is_shader_loaded;
+
+  void init_shader();
+};
+
+#endif
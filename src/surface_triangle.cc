@@ -1,33 +1,224 @@
 #include "surface_triangle.h"
 
+// standard library includes
+#include <cmath>
+
 // third party includes
 #include <raylib.h>
 #include <raymath.h>
 
+#if defined(__x86_64__) && !defined(__EMSCRIPTEN__)
+#define SURFACE_TRIANGLE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
 // local includes
 #include "3d_helpers.h"
 #include "ems.h"
 
+/*
+ * The kernels do the same multiplies and adds in the same order as
+ * get_vertices_scalar(), so all of them give bit-identical results. The
+ * rotation angle is the same for every triangle, so its sine and cosine are
+ * computed once per call.
+ */
+
+namespace {
+
+struct Shatter {
+  float c, s, one_minus_c, move;
+};
+
+Shatter get_shatter(float time) {
+  const float angle = time * SURFACE_TRIANGLE_ROTATION_RATE;
+  const float c = std::cos(angle);
+  return Shatter{.c = c,
+                 .s = std::sin(angle),
+                 .one_minus_c = 1.0F - c,
+                 .move = time * SURFACE_TRIANGLE_MOVE_RATE};
+}
+
+void get_vertices_scalar(const SurfaceTriangleBatch &triangles,
+                         const Shatter &shatter, std::size_t begin,
+                         float *vertices) {
+  for (std::size_t idx = begin; idx < triangles.size(); ++idx) {
+    const float kx = triangles.axis_x[idx];
+    const float ky = triangles.axis_y[idx];
+    const float kz = triangles.axis_z[idx];
+    // Origin of the triangle after moving.
+    const float ox =
+        triangles.pos_x[idx] + triangles.move_x[idx] * shatter.move;
+    const float oy =
+        triangles.pos_y[idx] + triangles.move_y[idx] * shatter.move;
+    const float oz =
+        triangles.pos_z[idx] + triangles.move_z[idx] * shatter.move;
+    for (std::size_t k = 0; k < 3; ++k) {
+      const float vx = triangles.x[k][idx];
+      const float vy = triangles.y[k][idx];
+      const float vz = triangles.z[k][idx];
+      const float d = (kx * vx + ky * vy + kz * vz) * shatter.one_minus_c;
+      float *out = vertices + idx * 9 + k * 3;
+      out[0] = vx * shatter.c + (ky * vz - kz * vy) * shatter.s + kx * d + ox;
+      out[1] = vy * shatter.c + (kz * vx - kx * vz) * shatter.s + ky * d + oy;
+      out[2] = vz * shatter.c + (kx * vy - ky * vx) * shatter.s + kz * d + oz;
+    }
+  }
+}
+
+#ifdef SURFACE_TRIANGLE_X86_KERNELS
+std::size_t get_vertices_sse(const SurfaceTriangleBatch &triangles,
+                             const Shatter &shatter, float *vertices) {
+  const __m128 c = _mm_set1_ps(shatter.c);
+  const __m128 s = _mm_set1_ps(shatter.s);
+  const __m128 one_minus_c = _mm_set1_ps(shatter.one_minus_c);
+  const __m128 move = _mm_set1_ps(shatter.move);
+
+  std::size_t idx = 0;
+  for (; idx + 4 <= triangles.size(); idx += 4) {
+    const __m128 kx = _mm_loadu_ps(&triangles.axis_x[idx]);
+    const __m128 ky = _mm_loadu_ps(&triangles.axis_y[idx]);
+    const __m128 kz = _mm_loadu_ps(&triangles.axis_z[idx]);
+    const __m128 ox =
+        _mm_add_ps(_mm_loadu_ps(&triangles.pos_x[idx]),
+                   _mm_mul_ps(_mm_loadu_ps(&triangles.move_x[idx]), move));
+    const __m128 oy =
+        _mm_add_ps(_mm_loadu_ps(&triangles.pos_y[idx]),
+                   _mm_mul_ps(_mm_loadu_ps(&triangles.move_y[idx]), move));
+    const __m128 oz =
+        _mm_add_ps(_mm_loadu_ps(&triangles.pos_z[idx]),
+                   _mm_mul_ps(_mm_loadu_ps(&triangles.move_z[idx]), move));
+    // Vertex coordinates of the 4 triangles, then written out per triangle.
+    alignas(16) float out[9][4];
+    for (std::size_t k = 0; k < 3; ++k) {
+      const __m128 vx = _mm_loadu_ps(&triangles.x[k][idx]);
+      const __m128 vy = _mm_loadu_ps(&triangles.y[k][idx]);
+      const __m128 vz = _mm_loadu_ps(&triangles.z[k][idx]);
+      const __m128 d = _mm_mul_ps(
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(kx, vx), _mm_mul_ps(ky, vy)),
+                     _mm_mul_ps(kz, vz)),
+          one_minus_c);
+      const __m128 cross_x = _mm_sub_ps(_mm_mul_ps(ky, vz), _mm_mul_ps(kz, vy));
+      const __m128 cross_y = _mm_sub_ps(_mm_mul_ps(kz, vx), _mm_mul_ps(kx, vz));
+      const __m128 cross_z = _mm_sub_ps(_mm_mul_ps(kx, vy), _mm_mul_ps(ky, vx));
+      _mm_store_ps(out[k * 3],
+                   _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, c),
+                                                    _mm_mul_ps(cross_x, s)),
+                                         _mm_mul_ps(kx, d)),
+                              ox));
+      _mm_store_ps(out[k * 3 + 1],
+                   _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vy, c),
+                                                    _mm_mul_ps(cross_y, s)),
+                                         _mm_mul_ps(ky, d)),
+                              oy));
+      _mm_store_ps(out[k * 3 + 2],
+                   _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vz, c),
+                                                    _mm_mul_ps(cross_z, s)),
+                                         _mm_mul_ps(kz, d)),
+                              oz));
+    }
+    for (std::size_t lane = 0; lane < 4; ++lane) {
+      for (std::size_t coord = 0; coord < 9; ++coord) {
+        vertices[(idx + lane) * 9 + coord] = out[coord][lane];
+      }
+    }
+  }
+  return idx;
+}
+
+__attribute__((target("avx"))) std::size_t get_vertices_avx(
+    const SurfaceTriangleBatch &triangles, const Shatter &shatter,
+    float *vertices) {
+  const __m256 c = _mm256_set1_ps(shatter.c);
+  const __m256 s = _mm256_set1_ps(shatter.s);
+  const __m256 one_minus_c = _mm256_set1_ps(shatter.one_minus_c);
+  const __m256 move = _mm256_set1_ps(shatter.move);
+
+  std::size_t idx = 0;
+  for (; idx + 8 <= triangles.size(); idx += 8) {
+    const __m256 kx = _mm256_loadu_ps(&triangles.axis_x[idx]);
+    const __m256 ky = _mm256_loadu_ps(&triangles.axis_y[idx]);
+    const __m256 kz = _mm256_loadu_ps(&triangles.axis_z[idx]);
+    const __m256 ox = _mm256_add_ps(
+        _mm256_loadu_ps(&triangles.pos_x[idx]),
+        _mm256_mul_ps(_mm256_loadu_ps(&triangles.move_x[idx]), move));
+    const __m256 oy = _mm256_add_ps(
+        _mm256_loadu_ps(&triangles.pos_y[idx]),
+        _mm256_mul_ps(_mm256_loadu_ps(&triangles.move_y[idx]), move));
+    const __m256 oz = _mm256_add_ps(
+        _mm256_loadu_ps(&triangles.pos_z[idx]),
+        _mm256_mul_ps(_mm256_loadu_ps(&triangles.move_z[idx]), move));
+    alignas(32) float out[9][8];
+    for (std::size_t k = 0; k < 3; ++k) {
+      const __m256 vx = _mm256_loadu_ps(&triangles.x[k][idx]);
+      const __m256 vy = _mm256_loadu_ps(&triangles.y[k][idx]);
+      const __m256 vz = _mm256_loadu_ps(&triangles.z[k][idx]);
+      const __m256 d = _mm256_mul_ps(
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_mul_ps(kx, vx), _mm256_mul_ps(ky, vy)),
+              _mm256_mul_ps(kz, vz)),
+          one_minus_c);
+      const __m256 cross_x =
+          _mm256_sub_ps(_mm256_mul_ps(ky, vz), _mm256_mul_ps(kz, vy));
+      const __m256 cross_y =
+          _mm256_sub_ps(_mm256_mul_ps(kz, vx), _mm256_mul_ps(kx, vz));
+      const __m256 cross_z =
+          _mm256_sub_ps(_mm256_mul_ps(kx, vy), _mm256_mul_ps(ky, vx));
+      _mm256_store_ps(
+          out[k * 3],
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, c),
+                                          _mm256_mul_ps(cross_x, s)),
+                            _mm256_mul_ps(kx, d)),
+              ox));
+      _mm256_store_ps(
+          out[k * 3 + 1],
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vy, c),
+                                          _mm256_mul_ps(cross_y, s)),
+                            _mm256_mul_ps(ky, d)),
+              oy));
+      _mm256_store_ps(
+          out[k * 3 + 2],
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vz, c),
+                                          _mm256_mul_ps(cross_z, s)),
+                            _mm256_mul_ps(kz, d)),
+              oz));
+    }
+    for (std::size_t lane = 0; lane < 8; ++lane) {
+      for (std::size_t coord = 0; coord < 9; ++coord) {
+        vertices[(idx + lane) * 9 + coord] = out[coord][lane];
+      }
+    }
+  }
+  return idx;
+}
+#endif
+
+}  // namespace
+
 SurfaceTriangle::SurfaceTriangle()
     : triangle_coords{Vector3{0.5F, 0.0F, -0.5F}, Vector3{-0.5F, 0.0F, -0.5F},
                       Vector3{-0.5F, 0.0F, 0.5F}},
       triangle_pos{0.0F, 0.0F, 0.0F},
       rotate_axis{0.0F, 1.0F, 0.0F},
-      pos_move_dir{0.0F, 1.0F, 0.0F},
-      rotation(0.0F),
-      move_amount(0.0F) {}
+      pos_move_dir{0.0F, 1.0F, 0.0F} {}
 
 SurfaceTriangle::SurfaceTriangle(Vector3 a, Vector3 b, Vector3 c, Vector3 pos)
+    : SurfaceTriangle(a, b, c, pos,
+                      Vector3{call_js_get_random() * 2.0F - 1.0F,
+                              call_js_get_random() * 2.0F - 1.0F,
+                              call_js_get_random() * 2.0F - 1.0F},
+                      Vector3{call_js_get_random() * 2.0F - 1.0F,
+                              call_js_get_random() * 2.0F - 1.0F,
+                              call_js_get_random() * 2.0F - 1.0F}) {}
+
+SurfaceTriangle::SurfaceTriangle(Vector3 a, Vector3 b, Vector3 c, Vector3 pos,
+                                 Vector3 axis, Vector3 move_dir)
     : triangle_coords{a, b, c},
       triangle_pos{pos},
-      rotate_axis{call_js_get_random() * 2.0F - 1.0F,
-                  call_js_get_random() * 2.0F - 1.0F,
-                  call_js_get_random() * 2.0F - 1.0F},
-      pos_move_dir{call_js_get_random() * 2.0F - 1.0F,
-                   call_js_get_random() * 2.0F - 1.0F,
-                   call_js_get_random() * 2.0F - 1.0F},
-      rotation(0.0F),
-      move_amount(0.0F) {
+      rotate_axis{axis},
+      pos_move_dir{move_dir} {
   if (FloatEquals(rotate_axis.x, 0.0F) && FloatEquals(rotate_axis.x, 0.0F) &&
       FloatEquals(rotate_axis.x, 0.0F)) {
     rotate_axis.x = 1.0F;
@@ -41,20 +232,158 @@ SurfaceTriangle::SurfaceTriangle(Vector3 a, Vector3 b, Vector3 c, Vector3 pos)
   pos_move_dir = Vector3Normalize(pos_move_dir);
 }
 
-void SurfaceTriangle::update(float dt) {
-  rotation += dt * SURFACE_TRIANGLE_ROTATION_RATE;
-  move_amount += dt * SURFACE_TRIANGLE_MOVE_RATE;
+Vector3 SurfaceTriangle::get_vertex(std::size_t idx, float time) const {
+  // Rodrigues' rotation of the vertex about the unit axis, the same rotation
+  // as MatrixRotate() without building the matrix.
+  const float angle = time * SURFACE_TRIANGLE_ROTATION_RATE;
+  const float c = std::cos(angle);
+  const float s = std::sin(angle);
+  const Vector3 v = triangle_coords[idx];
+  const Vector3 rotated =
+      v * c + Vector3CrossProduct(rotate_axis, v) * s +
+      rotate_axis * (Vector3DotProduct(rotate_axis, v) * (1.0F - c));
+  return rotated +
+         (triangle_pos + pos_move_dir * (time * SURFACE_TRIANGLE_MOVE_RATE));
+}
+
+void SurfaceTriangle::draw(Color color, float time) const {
+  DrawTriangle3D(get_vertex(0, time), get_vertex(1, time), get_vertex(2, time),
+                 color);
 }
 
-void SurfaceTriangle::draw(Color color) {
-  const auto mat =
-      MatrixRotate(rotate_axis, rotation) *
-      MatrixTranslate(triangle_pos.x + pos_move_dir.x * move_amount,
-                      triangle_pos.y + pos_move_dir.y * move_amount,
-                      triangle_pos.z + pos_move_dir.z * move_amount);
-  Vector3 a = mat * triangle_coords[0];
-  Vector3 b = mat * triangle_coords[1];
-  Vector3 c = mat * triangle_coords[2];
+void SurfaceTriangleBatch::add(const SurfaceTriangle &tri) {
+  for (std::size_t k = 0; k < 3; ++k) {
+    x[k].push_back(tri.triangle_coords[k].x);
+    y[k].push_back(tri.triangle_coords[k].y);
+    z[k].push_back(tri.triangle_coords[k].z);
+  }
+  pos_x.push_back(tri.triangle_pos.x);
+  pos_y.push_back(tri.triangle_pos.y);
+  pos_z.push_back(tri.triangle_pos.z);
+  axis_x.push_back(tri.rotate_axis.x);
+  axis_y.push_back(tri.rotate_axis.y);
+  axis_z.push_back(tri.rotate_axis.z);
+  move_x.push_back(tri.pos_move_dir.x);
+  move_y.push_back(tri.pos_move_dir.y);
+  move_z.push_back(tri.pos_move_dir.z);
+}
+
+SurfaceTriangle SurfaceTriangleBatch::get(std::size_t idx) const {
+  SurfaceTriangle tri;
+  for (std::size_t k = 0; k < 3; ++k) {
+    tri.triangle_coords[k] = Vector3{x[k][idx], y[k][idx], z[k][idx]};
+  }
+  tri.triangle_pos = Vector3{pos_x[idx], pos_y[idx], pos_z[idx]};
+  tri.rotate_axis = Vector3{axis_x[idx], axis_y[idx], axis_z[idx]};
+  tri.pos_move_dir = Vector3{move_x[idx], move_y[idx], move_z[idx]};
+  return tri;
+}
+
+void SurfaceTriangleBatch::clear() {
+  for (std::size_t k = 0; k < 3; ++k) {
+    x[k].clear();
+    y[k].clear();
+    z[k].clear();
+  }
+  pos_x.clear();
+  pos_y.clear();
+  pos_z.clear();
+  axis_x.clear();
+  axis_y.clear();
+  axis_z.clear();
+  move_x.clear();
+  move_y.clear();
+  move_z.clear();
+}
+
+void SurfaceTriangleBatch::reserve(std::size_t count) {
+  for (std::size_t k = 0; k < 3; ++k) {
+    x[k].reserve(count);
+    y[k].reserve(count);
+    z[k].reserve(count);
+  }
+  pos_x.reserve(count);
+  pos_y.reserve(count);
+  pos_z.reserve(count);
+  axis_x.reserve(count);
+  axis_y.reserve(count);
+  axis_z.reserve(count);
+  move_x.reserve(count);
+  move_y.reserve(count);
+  move_z.reserve(count);
+}
+
+bool is_surface_triangle_kernel_supported(SurfaceTriangleKernel kernel) {
+  switch (kernel) {
+    case SurfaceTriangleKernel::SCALAR:
+      return true;
+#ifdef SURFACE_TRIANGLE_X86_KERNELS
+    case SurfaceTriangleKernel::SSE:
+      // Part of the x86-64 baseline.
+      return true;
+    case SurfaceTriangleKernel::AVX:
+      return __builtin_cpu_supports("avx");
+#endif
+    default:
+      return false;
+  }
+}
+
+SurfaceTriangleKernel get_surface_triangle_kernel() {
+  static const SurfaceTriangleKernel kernel = []() {
+    if (is_surface_triangle_kernel_supported(SurfaceTriangleKernel::AVX)) {
+      return SurfaceTriangleKernel::AVX;
+    } else if (is_surface_triangle_kernel_supported(
+                   SurfaceTriangleKernel::SSE)) {
+      return SurfaceTriangleKernel::SSE;
+    }
+    return SurfaceTriangleKernel::SCALAR;
+  }();
+  return kernel;
+}
+
+void get_surface_triangle_vertices(SurfaceTriangleKernel kernel,
+                                   const SurfaceTriangleBatch &triangles,
+                                   float time, float *vertices) {
+  const Shatter shatter = get_shatter(time);
+  std::size_t done = 0;
+  switch (kernel) {
+#ifdef SURFACE_TRIANGLE_X86_KERNELS
+    case SurfaceTriangleKernel::SSE:
+      done = get_vertices_sse(triangles, shatter, vertices);
+      break;
+    case SurfaceTriangleKernel::AVX:
+      done = get_vertices_avx(triangles, shatter, vertices);
+      break;
+#endif
+    default:
+      break;
+  }
+  get_vertices_scalar(triangles, shatter, done, vertices);
+}
+
+void get_surface_triangle_vertices(const SurfaceTriangleBatch &triangles,
+                                   float time, float *vertices) {
+  get_surface_triangle_vertices(get_surface_triangle_kernel(), triangles, time,
+                                vertices);
+}
 
-  DrawTriangle3D(a, b, c, color);
+void append_unit_triangles(SurfaceTriangleBatch &triangles,
+                           const SurfaceUnit &unit, float x, float z,
+                           std::minstd_rand &engine) {
+  std::uniform_real_distribution<float> dist(-1.0F, 1.0F);
+  const auto random_dir_fn = [&dist, &engine]() {
+    return Vector3{dist(engine), dist(engine), dist(engine)};
+  };
+  // Arguments are evaluated in any order, so the directions are drawn first.
+  Vector3 axis = random_dir_fn();
+  Vector3 move_dir = random_dir_fn();
+  triangles.add(SurfaceTriangle(
+      Vector3{0.5F, unit.ne, -0.5F}, Vector3{-0.5F, unit.nw, -0.5F},
+      Vector3{-0.5F, unit.sw, 0.5F}, Vector3{x, 0.0F, z}, axis, move_dir));
+  axis = random_dir_fn();
+  move_dir = random_dir_fn();
+  triangles.add(SurfaceTriangle(
+      Vector3{0.5F, unit.ne, -0.5F}, Vector3{-0.5F, unit.sw, 0.5F},
+      Vector3{0.5F, unit.se, 0.5F}, Vector3{x, 0.0F, z}, axis, move_dir));
 }
@@ -3,66 +3,91 @@
 
 // standard library includes
 #include <array>
-#include <memory>
+#include <cstddef>
+#include <random>
+#include <vector>
 
 // third party includes
 #include <raylib.h>
 
 // local includes
-#include "common_constants.h"
+#include "surface.h"
 
 constexpr float SURFACE_TRIANGLE_ROTATION_RATE = 0.4F;
 constexpr float SURFACE_TRIANGLE_MOVE_RATE = 1.0F;
 
+/*
+ * A triangle of the surface flying apart once the surface is reset. Its
+ * vertices are rotated about triangle_pos around rotate_axis and moved along
+ * pos_move_dir, both at a constant rate, so where it is only depends on the
+ * time since the reset. SurfaceShatter does the same on the GPU.
+ */
 struct SurfaceTriangle {
   SurfaceTriangle();
+  /// Rotates and moves in random directions.
   SurfaceTriangle(Vector3 a, Vector3 b, Vector3 c, Vector3 pos);
+  SurfaceTriangle(Vector3 a, Vector3 b, Vector3 c, Vector3 pos,
+                  Vector3 axis, Vector3 move_dir);
 
   std::array<Vector3, 3> triangle_coords;
   Vector3 triangle_pos;
   Vector3 rotate_axis;
   Vector3 pos_move_dir;
-  float rotation;
-  float move_amount;
 
-  void update(float dt);
-  void draw(Color color);
+  /// World position of vertex idx (0 to 2) time seconds after the reset.
+  Vector3 get_vertex(std::size_t idx, float time) const;
+  void draw(Color color, float time) const;
 };
 
-template <typename SurfaceUnitOptT, std::size_t ASize>
-extern std::unique_ptr<std::array<SurfaceTriangle, ASize * 2> >
-surface_to_triangles(const std::array<SurfaceUnitOptT, ASize> &surface,
-                     const std::size_t width) {
-  std::unique_ptr<std::array<SurfaceTriangle, ASize * 2> > triangles =
-      std::make_unique<std::array<SurfaceTriangle, ASize * 2> >();
+/// Triangles in structure-of-arrays form, triangle n is at index n of every
+/// array.
+struct SurfaceTriangleBatch {
+  /// Vertex k of triangle n relative to its origin is at index n of the k'th
+  /// arrays.
+  std::array<std::vector<float>, 3> x{}, y{}, z{};
+  std::vector<float> pos_x{}, pos_y{}, pos_z{};
+  /// Normalized rotation axes and move directions.
+  std::vector<float> axis_x{}, axis_y{}, axis_z{};
+  std::vector<float> move_x{}, move_y{}, move_z{};
 
-  for (std::size_t idx = 0; idx < ASize; ++idx) {
-    std::size_t x = idx % width;
-    std::size_t y = idx / width;
+  void add(const SurfaceTriangle &tri);
+  SurfaceTriangle get(std::size_t idx) const;
+  std::size_t size() const;
+  /// Keeps the arrays' capacity, so that the batch is refilled without
+  /// allocating.
+  void clear();
+  void reserve(std::size_t count);
+};
 
-    float posx = ((float)x) - SURFACE_X_OFFSET;
-    float posz = ((float)y) - SURFACE_Y_OFFSET;
+/*
+ * Implementations of the shatter animation on the CPU, all of them give
+ * identical results. The vectorised ones move 4 or 8 triangles at once, only
+ * exist on x86-64 and are picked at runtime depending on what the CPU
+ * supports.
+ */
+enum class SurfaceTriangleKernel { SCALAR, SSE, AVX };
 
-    std::size_t toffset = x * 2 + y * width * 2;
+extern bool is_surface_triangle_kernel_supported(SurfaceTriangleKernel kernel);
+/// Fastest supported kernel, chosen on first call.
+extern SurfaceTriangleKernel get_surface_triangle_kernel();
 
-    if (!surface[idx].has_value()) {
-      triangles->at(toffset) = SurfaceTriangle();
-      triangles->at(toffset + 1) = SurfaceTriangle();
-      continue;
-    }
+/// Writes the world positions of every triangle's vertices time seconds after
+/// the reset to vertices, 9 floats per triangle in the layout of
+/// Mesh::vertices. Same as SurfaceTriangle::get_vertex() up to rounding.
+extern void get_surface_triangle_vertices(SurfaceTriangleKernel kernel,
+                                          const SurfaceTriangleBatch &triangles,
+                                          float time, float *vertices);
+/// Same as above with get_surface_triangle_kernel().
+extern void get_surface_triangle_vertices(const SurfaceTriangleBatch &triangles,
+                                          float time, float *vertices);
 
-    const auto &surface_unit = surface[idx].value();
-    triangles->at(toffset) = SurfaceTriangle(
-        Vector3{0.5F, surface_unit.ne, -0.5F},
-        Vector3{-0.5F, surface_unit.nw, -0.5F},
-        Vector3{-0.5F, surface_unit.sw, 0.5F}, Vector3{posx, 0.0F, posz});
-    triangles->at(toffset + 1) = SurfaceTriangle(
-        Vector3{0.5F, surface_unit.ne, -0.5F},
-        Vector3{-0.5F, surface_unit.sw, 0.5F},
-        Vector3{0.5F, surface_unit.se, 0.5F}, Vector3{posx, 0.0F, posz});
-  }
+/// Appends the two triangles of a unit centered at world (x, z), they are
+/// adjacent and share their origin. Their random directions come from engine,
+/// so this may run on any thread.
+extern void append_unit_triangles(SurfaceTriangleBatch &triangles,
+                                  const SurfaceUnit &unit, float x, float z,
+                                  std::minstd_rand &engine);
 
-  return triangles;
-}
+inline std::size_t SurfaceTriangleBatch::size() const { return pos_x.size(); }
 
 #endif
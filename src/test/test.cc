@@ -1,8 +1,23 @@
 // standard library includes
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 
 // local includes
 #include "../3d_helpers.h"
+#include "../flow_field.h"
+#include "../minimap.h"
+#include "../parallel.h"
+#include "../ray_batch.h"
+#include "../surface.h"
+#include "../surface_noise.h"
+#include "../surface_renderer.h"
+#include "../surface_reset.h"
+#include "../surface_shatter.h"
+#include "../surface_triangle.h"
+#include "../walker.h"
 
 #define ASSERT_TRUE(v)                                                 \
   if (!(v)) {                                                          \
@@ -255,6 +270,901 @@ int main() {
     ASSERT_FALSE(result.has_value());
   }
 
+  {
+    // Looking down -z from the origin.
+    const Camera3D camera{Vector3{0.0F, 0.0F, 0.0F},
+                          Vector3{0.0F, 0.0F, -1.0F},
+                          Vector3{0.0F, 1.0F, 0.0F}, 90.0F,
+                          CAMERA_PERSPECTIVE};
+    const Frustum frustum = get_frustum_from_camera(camera, 1.0F);
+    ASSERT_TRUE(is_sphere_in_frustum(frustum, Vector3{0.0F, 0.0F, -5.0F},
+                                     0.1F));
+    ASSERT_FALSE(is_sphere_in_frustum(frustum, Vector3{0.0F, 0.0F, 5.0F},
+                                      0.1F));
+    // 90 degree fov, so the side planes are at 45 degrees.
+    ASSERT_FALSE(is_sphere_in_frustum(frustum, Vector3{6.0F, 0.0F, -5.0F},
+                                      0.5F));
+    ASSERT_TRUE(is_sphere_in_frustum(frustum, Vector3{6.0F, 0.0F, -5.0F},
+                                     1.0F));
+    ASSERT_FALSE(is_sphere_in_frustum(frustum, Vector3{0.0F, 0.0F, -1100.0F},
+                                      1.0F));
+
+    ASSERT_TRUE(test_box_in_frustum(
+                    frustum, BoundingBox{Vector3{-1.0F, -1.0F, -6.0F},
+                                         Vector3{1.0F, 1.0F, -4.0F}}) ==
+                FrustumTest::INSIDE);
+    ASSERT_TRUE(test_box_in_frustum(
+                    frustum, BoundingBox{Vector3{-1.0F, -1.0F, -1.0F},
+                                         Vector3{1.0F, 1.0F, 1.0F}}) ==
+                FrustumTest::INTERSECTS);
+    ASSERT_TRUE(test_box_in_frustum(
+                    frustum, BoundingBox{Vector3{-1.0F, -1.0F, 1.0F},
+                                         Vector3{1.0F, 1.0F, 3.0F}}) ==
+                FrustumTest::OUTSIDE);
+    ASSERT_FALSE(is_box_in_frustum(
+        frustum,
+        BoundingBox{Vector3{8.0F, -1.0F, -6.0F}, Vector3{9.0F, 1.0F, -4.0F}}));
+  }
+
+  std::cout << "Testing flow_field...\n";
+  {
+    // A flat surface with a wall along x = 24 that is open at its far end.
+    Surface surface(48, 32, 1);
+    for (unsigned int y = 0; y <= 32; ++y) {
+      for (unsigned int x = 0; x <= 48; ++x) {
+        surface.set_vertex(x, y, x == 24 && y <= 28 ? 100.0F : 0.0F);
+      }
+    }
+    ASSERT_TRUE(get_flow_field_region(48, 0) == 0);
+    ASSERT_TRUE(get_flow_field_region(48, 16 + 16 * 48) == 4);
+    ASSERT_TRUE(get_flow_field_region(48, 47 + 31 * 48) == 5);
+
+    const FlowField field(surface, get_flow_field_region(48, 40 + 2 * 48));
+    ASSERT_TRUE(field.is_goal(32));
+    ASSERT_FALSE(field.get_next(32).has_value());
+    // Walls can't be climbed.
+    ASSERT_FALSE(field.get_next(24 + 10 * 48).has_value());
+
+    // Following the field goes around the wall and into the region.
+    std::size_t idx = 2 + 2 * 48;
+    unsigned int steps = 0;
+    bool is_through_gap = true;
+    while (!field.is_goal(idx) && steps < 200) {
+      const std::optional<std::size_t> next = field.get_next(idx);
+      if (!next.has_value()) {
+        break;
+      }
+      idx = next.value();
+      if (idx % 48 == 23 || idx % 48 == 24) {
+        is_through_gap = is_through_gap && idx / 48 >= 29;
+      }
+      ++steps;
+    }
+    ASSERT_TRUE(field.is_goal(idx));
+    ASSERT_TRUE(is_through_gap);
+    ASSERT_TRUE(steps > 27 && steps < 80);
+
+    // Fields only cover the units near their region and load the chunks of
+    // their window that aren't resident.
+    const SurfaceRect window = get_flow_field_window(256, 160, 8 + 4 * 16);
+    ASSERT_TRUE(window.x_min == 64 && window.y_min == 0 &&
+                window.x_max == 207 && window.y_max == 143);
+    Surface wide(256, 64, 5);
+    wide.get_chunk(0);
+    const FlowField loading(wide, 0);
+    ASSERT_TRUE(wide.get_resident_chunk(1) != nullptr &&
+                wide.get_resident_chunk(2) == nullptr);
+    ASSERT_TRUE(loading.get_next(63 + 10 * 256).has_value());
+    ASSERT_TRUE(loading.get_next(65 + 10 * 256).has_value());
+    ASSERT_FALSE(loading.is_goal(200) || loading.get_next(200).has_value());
+
+    // Walkers heading to the same region share its field until cleared.
+    FlowFieldCache cache;
+    const auto first = cache.get(surface, 3);
+    ASSERT_TRUE(cache.get(surface, 3) == first);
+    cache.get(surface, 4);
+    ASSERT_TRUE(cache.get_integration_count() == 2);
+    const unsigned long long generation = cache.get_generation();
+    cache.clear();
+    ASSERT_TRUE(cache.size() == 0);
+    ASSERT_TRUE(cache.get_generation() != generation);
+    ASSERT_FALSE(cache.get(surface, 3) == first);
+    ASSERT_TRUE(cache.get_integration_count() == 3);
+
+    // Only fields whose window sees the changed vertices are dropped.
+    cache.clear();
+    cache.get(wide, 0);
+    cache.get(wide, 12);
+    const std::size_t integrated = cache.get_integration_count();
+    const unsigned long long before_invalidate = cache.get_generation();
+    cache.invalidate(SurfaceRect{100, 10, 110, 12});
+    ASSERT_TRUE(cache.size() == 2 &&
+                cache.get_generation() == before_invalidate);
+    cache.invalidate(SurfaceRect{80, 10, 82, 12});
+    ASSERT_TRUE(cache.size() == 1 &&
+                cache.get_generation() != before_invalidate);
+    cache.get(wide, 12);
+    ASSERT_TRUE(cache.get_integration_count() == integrated);
+    cache.get(wide, 0);
+    ASSERT_TRUE(cache.get_integration_count() == integrated + 1);
+
+    // The least recently used field is dropped once full.
+    Surface large(FLOW_FIELD_REGION_SIZE * 17, FLOW_FIELD_REGION_SIZE * 16, 2);
+    cache.clear();
+    for (std::size_t region = 0; region <= FLOW_FIELD_CACHE_SIZE; ++region) {
+      cache.get(large, region);
+    }
+    ASSERT_TRUE(cache.size() == FLOW_FIELD_CACHE_SIZE);
+    const std::size_t integration_count = cache.get_integration_count();
+    cache.get(large, FLOW_FIELD_CACHE_SIZE);
+    ASSERT_TRUE(cache.get_integration_count() == integration_count);
+    cache.get(large, 0);
+    ASSERT_TRUE(cache.get_integration_count() == integration_count + 1);
+  }
+
+  std::cout << "Testing minimap...\n";
+  {
+    ASSERT_TRUE(get_minimap_scale(51, 51) == 1);
+    ASSERT_TRUE(get_minimap_scale(MINIMAP_MAX_RESOLUTION, 1) == 1);
+    ASSERT_TRUE(get_minimap_scale(MINIMAP_MAX_RESOLUTION + 1, 1) == 2);
+    ASSERT_TRUE(get_minimap_scale(1, MINIMAP_MAX_RESOLUTION * 4) == 4);
+    ASSERT_TRUE(get_minimap_scale(1, MINIMAP_MAX_RESOLUTION * 4 + 1) == 8);
+
+    // Higher is lighter, heights beyond the range are clamped.
+    const Color low = get_minimap_height_color(MINIMAP_LOW_Y);
+    const Color mid = get_minimap_height_color(0.0F);
+    const Color high = get_minimap_height_color(MINIMAP_HIGH_Y);
+    ASSERT_TRUE(low.r < mid.r && mid.r < high.r);
+    ASSERT_TRUE(low.g < mid.g && mid.g < high.g);
+    ASSERT_TRUE(low.b < mid.b && mid.b < high.b);
+    ASSERT_TRUE(low.a == 255 && high.a == 255);
+    const Color below = get_minimap_height_color(MINIMAP_LOW_Y - 10.0F);
+    const Color above = get_minimap_height_color(MINIMAP_HIGH_Y + 10.0F);
+    ASSERT_TRUE(below.r == low.r && below.g == low.g && below.b == low.b);
+    ASSERT_TRUE(above.r == high.r && above.g == high.g && above.b == high.b);
+  }
+
+  std::cout << "Testing ray_batch...\n";
+  {
+    // Boxes on a grid, 19 of them so every kernel has a scalar tail.
+    BoxBatch boxes;
+    for (int idx = 0; idx < 19; ++idx) {
+      const Vector3 center{(float)(idx % 5) * 3.0F - 6.0F,
+                           (float)(idx % 3) - 1.0F,
+                           (float)(idx / 5) * 3.0F - 4.5F};
+      boxes.add(BoundingBox{Vector3Subtract(center, Vector3{1.0F, 1.0F, 1.0F}),
+                            Vector3Add(center, Vector3{1.0F, 1.0F, 1.0F})});
+    }
+    RayBatch rays;
+    for (int ray_idx = 0; ray_idx < 40; ++ray_idx) {
+      const float angle = (float)ray_idx * 0.7F;
+      rays.add(Ray{Vector3{std::cos(angle) * 20.0F,
+                           (float)(ray_idx % 5) * 2.0F - 3.75F,
+                           std::sin(angle) * 20.0F},
+                   Vector3Normalize(Vector3{-std::cos(angle * 1.1F),
+                                            (float)(ray_idx % 3) * 0.1F,
+                                            -std::sin(angle * 0.9F)})});
+    }
+    // Axis aligned, the other direction components are zero.
+    rays.add(Ray{Vector3{-20.0F, -1.0F, -4.5F}, Vector3{1.0F, 0.0F, 0.0F}});
+    std::vector<std::optional<RayBoxHit> > hits;
+    get_nearest_ray_box_hits(RayBatchKernel::SCALAR, rays, boxes, hits);
+    ASSERT_TRUE(hits.size() == rays.size());
+    ASSERT_TRUE(hits.back().has_value() && hits.back()->box_idx == 0 &&
+                hits.back()->t == 13.0F);
+
+    // Same nearest boxes as raylib, none of the rays start inside a box.
+    bool is_same = true;
+    for (std::size_t ray_idx = 0; ray_idx < rays.size(); ++ray_idx) {
+      const Ray ray{
+          Vector3{rays.origin_x[ray_idx], rays.origin_y[ray_idx],
+                  rays.origin_z[ray_idx]},
+          Vector3{1.0F / rays.inv_dir_x[ray_idx],
+                  1.0F / rays.inv_dir_y[ray_idx],
+                  1.0F / rays.inv_dir_z[ray_idx]}};
+      std::optional<std::size_t> nearest;
+      float nearest_distance = INFINITY;
+      for (std::size_t box_idx = 0; box_idx < boxes.size(); ++box_idx) {
+        const RayCollision collision = GetRayCollisionBox(
+            ray, BoundingBox{Vector3{boxes.min_x[box_idx], boxes.min_y[box_idx],
+                                     boxes.min_z[box_idx]},
+                             Vector3{boxes.max_x[box_idx], boxes.max_y[box_idx],
+                                     boxes.max_z[box_idx]}});
+        if (collision.hit && collision.distance < nearest_distance) {
+          nearest = box_idx;
+          nearest_distance = collision.distance;
+        }
+      }
+      is_same = is_same && hits[ray_idx].has_value() == nearest.has_value() &&
+                (!nearest.has_value() || hits[ray_idx]->box_idx == *nearest);
+    }
+    ASSERT_TRUE(is_same);
+
+    // Rays ending before any box don't hit.
+    RayBatch short_rays;
+    short_rays.add(
+        Ray{Vector3{-20.0F, -1.0F, -4.5F}, Vector3{2.0F, 0.0F, 0.0F}}, 12.0F);
+    std::vector<std::optional<RayBoxHit> > short_hits;
+    get_nearest_ray_box_hits(short_rays, boxes, short_hits);
+    ASSERT_FALSE(short_hits[0].has_value());
+
+    // Every supported kernel gives the same hits.
+    for (const RayBatchKernel kernel :
+         {RayBatchKernel::SSE, RayBatchKernel::AVX}) {
+      if (!is_ray_batch_kernel_supported(kernel)) {
+        std::cout << "  Skipping unsupported ray batch kernel.\n";
+        continue;
+      }
+      std::vector<std::optional<RayBoxHit> > kernel_hits;
+      get_nearest_ray_box_hits(kernel, rays, boxes, kernel_hits);
+      bool is_identical = kernel_hits.size() == hits.size();
+      for (std::size_t idx = 0; is_identical && idx < hits.size(); ++idx) {
+        is_identical =
+            kernel_hits[idx].has_value() == hits[idx].has_value() &&
+            (!hits[idx].has_value() ||
+             (kernel_hits[idx]->box_idx == hits[idx]->box_idx &&
+              kernel_hits[idx]->t == hits[idx]->t));
+      }
+      ASSERT_TRUE(is_identical);
+    }
+  }
+
+  std::cout << "Testing surface...\n";
+  {
+    // Adjacent units share their corner vertices.
+    Surface surface(4, 3, 0);
+    ASSERT_TRUE(surface.size() == 12);
+    surface.set_vertex(0, 0, 0.0F);
+    surface.set_vertex(1, 0, 1.0F);
+    surface.set_vertex(0, 1, 0.5F);
+    surface.set_vertex(1, 1, 2.0F);
+    ASSERT_FLOAT_EQUALS(surface[0].ne, 1.0F);
+    ASSERT_FLOAT_EQUALS(surface[0].se, 2.0F);
+    ASSERT_FLOAT_EQUALS(surface[1].nw, 1.0F);
+    ASSERT_FLOAT_EQUALS(surface[1].sw, 2.0F);
+    ASSERT_FLOAT_EQUALS(surface[4].ne, 2.0F);
+    ASSERT_FLOAT_EQUALS(surface[5].nw, 2.0F);
+
+    // Bounding boxes follow the vertices and are centered on the origin.
+    ASSERT_FLOAT_EQUALS(surface.get_bb(0).min.y, 0.0F);
+    ASSERT_FLOAT_EQUALS(surface.get_bb(0).max.y, 2.0F);
+    ASSERT_FLOAT_EQUALS(surface.get_bb(0).min.x, -2.0F);
+    ASSERT_FLOAT_EQUALS(surface.get_bb(0).min.z, -1.5F);
+    ASSERT_FLOAT_EQUALS(surface.get_bb(11).max.x, 2.0F);
+    ASSERT_FLOAT_EQUALS(surface.get_bb(11).max.z, 1.5F);
+    // Heights are interpolated on the triangle under the position, split
+    // along the ne-sw diagonal.
+    ASSERT_FLOAT_EQUALS(surface.height_at(-2.0F, -1.5F).value(), 0.0F);
+    ASSERT_FLOAT_EQUALS(surface.height_at(-1.0F, -1.5F).value(), 1.0F);
+    ASSERT_FLOAT_EQUALS(surface.height_at(-1.5F, -1.5F).value(), 0.5F);
+    ASSERT_FLOAT_EQUALS(surface.height_at(-1.25F, -0.75F).value(), 1.375F);
+    ASSERT_FLOAT_EQUALS(surface.height_at(-1.75F, -1.25F).value(), 0.375F);
+    ASSERT_FALSE(surface.height_at(-2.1F, 0.0F).has_value());
+    ASSERT_TRUE(surface.get_unit_idx(-1.9F, -1.4F) == 0);
+    ASSERT_TRUE(surface.get_unit_idx(1.9F, 1.4F) == 11);
+    ASSERT_FALSE(surface.get_unit_idx(2.1F, 0.0F).has_value());
+  }
+  {
+    // Chunks are generated on access and evicted when over budget.
+    Surface surface(130, 70, 7);
+    ASSERT_TRUE(surface.get_chunk_count() == 6);
+    ASSERT_TRUE(surface.get_resident_chunk_count() == 0);
+    const SurfaceUnit first = surface[0];
+    const SurfaceUnit last = surface[129];
+    ASSERT_TRUE(surface.get_resident_chunk_count() == 2);
+    ASSERT_TRUE(surface.get_chunk(2).width == 2);
+    ASSERT_TRUE(surface.get_chunk(5).height == 6);
+
+    // Seams between chunks are shared.
+    ASSERT_FLOAT_EQUALS(surface[63].ne, surface[64].nw);
+    ASSERT_FLOAT_EQUALS(surface[63 + 63 * 130].se, surface[64 + 64 * 130].nw);
+
+    // Only the chunk around the focus point is kept.
+    surface.set_memory_budget(0);
+    surface.update_residency({Vector3{-64.5F, 0.0F, -34.5F}}, 1.0F);
+    ASSERT_TRUE(surface.get_resident_chunk_count() == 1);
+    ASSERT_TRUE(surface.get_resident_chunk(0) != nullptr);
+    // Heights are only read from resident chunks, without loading any.
+    ASSERT_FLOAT_EQUALS(surface.resident_height_at(-64.5F, -34.5F).value(),
+                        first.nw);
+    ASSERT_FALSE(surface.resident_height_at(64.0F, 34.0F).has_value());
+    ASSERT_TRUE(surface.get_resident_chunk_count() == 1);
+    // Every focus point keeps the chunks within its own radius.
+    surface.update_residency(
+        {SurfaceFocus{.point = Vector3{-64.5F, 0.0F, -34.5F}, .radius = 1.0F},
+         SurfaceFocus{.point = Vector3{64.0F, 0.0F, 34.0F}, .radius = 1.0F}});
+    ASSERT_TRUE(surface.get_resident_chunk_count() == 2);
+    ASSERT_TRUE(surface.get_resident_chunk(5) != nullptr);
+
+    // Regenerated chunks match a surface with the same seed.
+    Surface same_seed(130, 70, 7);
+    ASSERT_FLOAT_EQUALS(same_seed[0].se, first.se);
+    ASSERT_FLOAT_EQUALS(surface[129].sw, last.sw);
+
+    // A saved surface loads with the same heights, including changes that
+    // were made before saving.
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "jad0_test_surface.bin")
+            .string();
+    same_seed.set_vertex(65, 3, 9.0F);
+    ASSERT_TRUE(same_seed.save(path));
+    std::optional<Surface> loaded = Surface::load(path);
+    ASSERT_TRUE(loaded.has_value());
+    if (loaded.has_value()) {
+      ASSERT_TRUE(loaded->is_mapped());
+      ASSERT_TRUE(loaded->get_seed() == 7);
+      ASSERT_TRUE(loaded->get_resident_chunk_count() == 0);
+      bool is_identical = true;
+      for (std::size_t idx = 0; idx < same_seed.size(); ++idx) {
+        const SurfaceUnit a = same_seed[idx];
+        const SurfaceUnit b = (*loaded)[idx];
+        is_identical = is_identical && a.nw == b.nw && a.ne == b.ne &&
+                       a.sw == b.sw && a.se == b.se;
+        const BoundingBox bb_a = same_seed.get_bb(idx);
+        const BoundingBox bb_b = loaded->get_bb(idx);
+        is_identical = is_identical && bb_a.min.y == bb_b.min.y &&
+                       bb_a.max.y == bb_b.max.y;
+      }
+      ASSERT_TRUE(is_identical);
+      ASSERT_FLOAT_EQUALS(loaded->get_vertex(65, 3), 9.0F);
+      // Only the pyramids of mapped chunks count against the memory budget.
+      std::size_t pyramid_usage = 0;
+      for (std::size_t idx = 0; idx < loaded->get_chunk_count(); ++idx) {
+        pyramid_usage +=
+            loaded->get_chunk(idx).pyramid.capacity() * sizeof(float);
+      }
+      ASSERT_TRUE(loaded->get_memory_usage() ==
+                  loaded->get_chunk_count() * sizeof(Surface::Chunk) +
+                      pyramid_usage);
+    }
+    std::filesystem::remove(path);
+    ASSERT_FALSE(Surface::load(path).has_value());
+
+    // Quantized heights stay within half a step (plus rounding) of the float
+    // heights, in about half the memory.
+    Surface quantized(130, 70, 7, SURFACE_DEFAULT_MEMORY_BUDGET,
+                      SurfaceHeightFormat::UNORM16);
+    Surface exact(130, 70, 7);
+    bool is_within_bound = true;
+    for (std::size_t idx = 0; idx < quantized.size(); ++idx) {
+      const Surface::Chunk &chunk = quantized.get_chunk(
+          quantized.get_chunk_idx(idx % 130, (unsigned int)(idx / 130)));
+      const float bound = (chunk.max_y - chunk.min_y) / 65535.0F / 2.0F;
+      const SurfaceUnit a = quantized[idx];
+      const SurfaceUnit b = exact[idx];
+      is_within_bound = is_within_bound &&
+                        std::abs(a.nw - b.nw) <= bound * 1.05F &&
+                        std::abs(a.se - b.se) <= bound * 1.05F &&
+                        quantized.get_bb(idx).min.y <= a.nw &&
+                        quantized.get_bb(idx).max.y >= a.se;
+    }
+    ASSERT_TRUE(is_within_bound);
+    ASSERT_TRUE(quantized.get_memory_usage() * 20 <=
+                exact.get_memory_usage() * 11);
+
+    // Widening a quantized chunk's range keeps the new height exact enough.
+    quantized.set_vertex(10, 10, 20.0F);
+    ASSERT_FLOAT_EQUALS(quantized.get_vertex(10, 10), 20.0F);
+    ASSERT_TRUE(std::abs(quantized.get_vertex(11, 10) -
+                         exact.get_vertex(11, 10)) < 0.001F);
+    ASSERT_TRUE(quantized.save(path));
+    loaded = Surface::load(path);
+    ASSERT_TRUE(loaded.has_value() &&
+                loaded->get_height_format() == SurfaceHeightFormat::UNORM16);
+    if (loaded.has_value()) {
+      ASSERT_TRUE(loaded->get_vertex(11, 10) == quantized.get_vertex(11, 10));
+      ASSERT_TRUE(loaded->get_bb(129).max.y == quantized.get_bb(129).max.y);
+    }
+    loaded.reset();
+
+    // Headers with sizes the chunk table can't back are rejected before any
+    // chunks are allocated for them.
+    const auto patch_header_fn = [&path](std::streamoff offset,
+                                         std::uint32_t value) {
+      std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+      file.seekp(offset);
+      file.write((const char *)&value, sizeof(value));
+    };
+    // Width and height.
+    patch_header_fn(12, 0xFFFFFFC0);
+    patch_header_fn(16, 0xFFFFFFC0);
+    ASSERT_FALSE(Surface::load(path).has_value());
+    // A matching chunk count, but far more chunks than the file holds.
+    patch_header_fn(16, 64);
+    patch_header_fn(28, 0xFFFFFFC0 / 64);
+    ASSERT_FALSE(Surface::load(path).has_value());
+    std::filesystem::remove(path);
+  }
+  {
+    // Picking finds the nearest triangle hit, same as testing every unit.
+    Surface surface(130, 70, 5);
+    surface.update_residency({Vector3{0.0F, 0.0F, 0.0F}}, 100.0F);
+    const auto brute_force_fn = [&surface](Ray ray) {
+      std::optional<SurfaceRayHit> nearest;
+      for (std::size_t idx = 0; idx < surface.size(); ++idx) {
+        const SurfaceUnit unit = surface[idx];
+        const float xf = (float)(idx % 130) - surface.get_x_offset();
+        const float zf = (float)(idx / 130) - surface.get_y_offset();
+        const Vector3 nw{xf - 0.5F, unit.nw, zf - 0.5F};
+        const Vector3 ne{xf + 0.5F, unit.ne, zf - 0.5F};
+        const Vector3 sw{xf - 0.5F, unit.sw, zf + 0.5F};
+        const Vector3 se{xf + 0.5F, unit.se, zf + 0.5F};
+        for (const RayCollision &collision :
+             {GetRayCollisionTriangle(ray, nw, sw, ne),
+              GetRayCollisionTriangle(ray, ne, sw, se)}) {
+          if (collision.hit && (!nearest.has_value() ||
+                                collision.distance < nearest->distance)) {
+            nearest = SurfaceRayHit{.idx = idx,
+                                    .point = collision.point,
+                                    .distance = collision.distance};
+          }
+        }
+      }
+      return nearest;
+    };
+    bool is_same = true;
+    for (int ray_idx = 0; ray_idx < 40; ++ray_idx) {
+      // Rays from above at shallow and steep angles, some grazing the surface.
+      const float angle = (float)ray_idx * 0.7F;
+      const Ray ray{
+          .position = Vector3{std::cos(angle) * 70.0F,
+                              1.0F + (float)(ray_idx % 5) * 3.0F,
+                              std::sin(angle) * 40.0F},
+          .direction = Vector3Normalize(Vector3{
+              -std::cos(angle * 1.3F), -0.05F - (float)(ray_idx % 4) * 0.3F,
+              -std::sin(angle * 1.1F)})};
+      const std::optional<SurfaceRayHit> picked = surface.pick(ray);
+      const std::optional<SurfaceRayHit> expected = brute_force_fn(ray);
+      is_same = is_same && picked.has_value() == expected.has_value() &&
+                (!picked.has_value() || picked->idx == expected->idx);
+    }
+    ASSERT_TRUE(is_same);
+    // Straight down onto a unit.
+    const std::optional<SurfaceRayHit> down = surface.pick(
+        Ray{Vector3{0.2F, 50.0F, -0.2F}, Vector3{0.0F, -1.0F, 0.0F}});
+    ASSERT_TRUE(down.has_value() &&
+                down->idx == surface.get_unit_idx(0.2F, -0.2F).value());
+    // Pointing away from the surface.
+    ASSERT_FALSE(surface
+                     .pick(Ray{Vector3{0.0F, 50.0F, 0.0F},
+                               Vector3{0.0F, 1.0F, 0.0F}})
+                     .has_value());
+
+    // Raised terrain blocks sight and rays once its pyramid is updated.
+    const Vector3 a{-20.0F, 10.0F, 0.3F};
+    const Vector3 b{20.0F, 10.0F, 0.3F};
+    ASSERT_TRUE(surface.line_of_sight(a, b));
+    const std::size_t wall_idx = surface.get_unit_idx(0.0F, 0.3F).value();
+    const unsigned int wall_x = wall_idx % 130;
+    const unsigned int wall_y = wall_idx / 130;
+    for (unsigned int y = wall_y; y <= wall_y + 1; ++y) {
+      for (unsigned int x = wall_x; x <= wall_x + 1; ++x) {
+        surface.set_vertex(x, y, 30.0F);
+      }
+    }
+    ASSERT_FALSE(surface.line_of_sight(a, b));
+    ASSERT_TRUE(surface.line_of_sight(a, Vector3{-1.0F, 10.0F, 0.3F}));
+    const std::optional<SurfaceRayHit> wall_hit =
+        surface.pick(Ray{a, Vector3{1.0F, 0.0F, 0.0F}});
+    // The unit west of the wall slopes up to it.
+    ASSERT_TRUE(wall_hit.has_value() && wall_hit->idx == wall_idx - 1);
+    ASSERT_FALSE(surface.pick(Ray{a, Vector3{1.0F, 0.0F, 0.0F}}, 10.0F)
+                     .has_value());
+  }
+
+  {
+    // Deforming only changes vertices within the radius, the same in every
+    // chunk sharing them, and keeps unit ranges and the pyramid up to date.
+    Surface surface(130, 70, 5);
+    const float x = 64.0F - surface.get_x_offset() - 0.5F;
+    const float z = 10.0F - surface.get_y_offset() - 0.5F;
+    const float before = surface.get_vertex(64, 10);
+    const std::size_t west_idx = surface.get_chunk_idx(63, 10);
+    const std::size_t east_idx = surface.get_chunk_idx(64, 10);
+    const unsigned long long east_version =
+        surface.get_chunk(east_idx).version;
+    const std::optional<SurfaceRect> rect =
+        surface.deform(x, z, 3.0F, 2.0F, SurfaceBrush::RAISE);
+    ASSERT_TRUE(rect.has_value() && rect->x_min == 61 && rect->x_max == 67 &&
+                rect->y_min == 7 && rect->y_max == 13);
+    ASSERT_FLOAT_EQUALS(surface.get_vertex(64, 10), before + 2.0F);
+    ASSERT_TRUE(surface.get_chunk(west_idx).get_vertex(64 + 10 * 65) ==
+                surface.get_chunk(east_idx).get_vertex(0 + 10 * 65));
+    ASSERT_TRUE(surface.get_vertex(67, 10) ==
+                Surface(130, 70, 5).get_vertex(67, 10));
+    const Surface::Chunk &east = surface.get_chunk(east_idx);
+    ASSERT_TRUE(east.dirty_version == east_version &&
+                east.version != east_version && east.is_edited);
+    ASSERT_TRUE(east.dirty.x_min == 0 && east.dirty.x_max == 3 &&
+                east.dirty.y_min == 7 && east.dirty.y_max == 13);
+    const std::optional<SurfaceRayHit> hit = surface.pick(
+        Ray{Vector3{x + 0.1F, 50.0F, z + 0.1F}, Vector3{0.0F, -1.0F, 0.0F}});
+    ASSERT_TRUE(hit.has_value());
+    if (hit.has_value()) {
+      ASSERT_FLOAT_EQUALS(hit->point.y,
+                          surface.height_at(x + 0.1F, z + 0.1F).value());
+    }
+
+    // Flattening all the way levels the brush's area to its center.
+    surface.deform(x, z, 6.0F, 1000.0F, SurfaceBrush::FLATTEN);
+    ASSERT_FLOAT_EQUALS(surface.get_vertex(62, 9), before + 2.0F);
+    ASSERT_FALSE(surface.deform(-1000.0F, 0.0F, 3.0F, 1.0F,
+                                SurfaceBrush::LOWER)
+                     .has_value());
+
+    // Edited chunks aren't evicted.
+    surface.update_residency({Vector3{100.0F, 0.0F, 100.0F}}, 1.0F);
+    surface.set_memory_budget(0);
+    ASSERT_TRUE(surface.get_resident_chunk(east_idx) != nullptr);
+    ASSERT_TRUE(surface.get_resident_chunk(surface.get_chunk_idx(0, 64)) ==
+                nullptr);
+
+    // Quantized chunks grow their range with headroom.
+    Surface quantized(130, 70, 5, SURFACE_DEFAULT_MEMORY_BUDGET,
+                      SurfaceHeightFormat::UNORM16);
+    const float quantized_before = quantized.get_vertex(20, 20);
+    quantized.deform(20.0F - quantized.get_x_offset() - 0.5F,
+                     20.0F - quantized.get_y_offset() - 0.5F, 3.0F, 10.0F,
+                     SurfaceBrush::RAISE);
+    ASSERT_TRUE(std::abs(quantized.get_vertex(20, 20) -
+                         (quantized_before + 10.0F)) < 0.001F);
+    const Surface::Chunk &quantized_chunk = quantized.get_chunk(0);
+    ASSERT_TRUE(quantized_chunk.max_y > quantized_before + 10.5F);
+    ASSERT_TRUE(quantized_chunk.dirty.x_max == quantized_chunk.width);
+  }
+
+  std::cout << "Testing surface_noise...\n";
+  {
+    // Heights only depend on seed and position.
+    ASSERT_TRUE(get_surface_noise_height(5, 100, 200) ==
+                get_surface_noise_height(5, 100, 200));
+    ASSERT_FALSE(get_surface_noise_height(5, 100, 200) ==
+                 get_surface_noise_height(6, 100, 200));
+    float heights[3 * 2];
+    generate_surface_noise_heights(5, 99, 200, 3, 2, heights, 3);
+    ASSERT_TRUE(heights[1] == get_surface_noise_height(5, 100, 200));
+    ASSERT_TRUE(heights[5] == get_surface_noise_height(5, 101, 201));
+
+    // Every supported kernel gives the same heights, including the scalar
+    // tail of a row.
+    for (const SurfaceNoiseKernel kernel :
+         {SurfaceNoiseKernel::SSE4_1, SurfaceNoiseKernel::AVX2}) {
+      if (!is_surface_noise_kernel_supported(kernel)) {
+        std::cout << "  Skipping unsupported noise kernel.\n";
+        continue;
+      }
+      bool is_identical = true;
+      float row[77];
+      float scalar_row[77];
+      for (unsigned int y = 0; y < 70; y += 3) {
+        generate_surface_noise_row(kernel, 23, 1000 - y * 7, y, 77, row);
+        generate_surface_noise_row(SurfaceNoiseKernel::SCALAR, 23,
+                                   1000 - y * 7, y, 77, scalar_row);
+        for (unsigned int idx = 0; idx < 77; ++idx) {
+          is_identical = is_identical && row[idx] == scalar_row[idx];
+        }
+      }
+      ASSERT_TRUE(is_identical);
+    }
+
+    // Bit identical regardless of the number of threads.
+    Surface single(300, 300, 11);
+    single.set_thread_count(1);
+    single.update_residency({Vector3{0.0F, 0.0F, 0.0F}}, 150.0F);
+    Surface multi(300, 300, 11);
+    multi.set_thread_count(7);
+    multi.update_residency({Vector3{0.0F, 0.0F, 0.0F}}, 150.0F);
+    ASSERT_TRUE(single.get_resident_chunk_count() == 25);
+    ASSERT_TRUE(multi.get_resident_chunk_count() == 25);
+    bool is_identical = true;
+    for (std::size_t idx = 0; idx < single.get_chunk_count(); ++idx) {
+      is_identical = is_identical && single.get_resident_chunk(idx)->storage ==
+                                         multi.get_resident_chunk(idx)->storage;
+    }
+    ASSERT_TRUE(is_identical);
+    ASSERT_TRUE(single.get_vertex(123, 45) ==
+                get_surface_noise_height(11, 123, 45));
+  }
+
+  std::cout << "Testing surface_renderer...\n";
+  {
+    ASSERT_TRUE(get_surface_lod(0.0F) == 0);
+    ASSERT_TRUE(get_surface_lod(SURFACE_LOD_DISTANCE - 0.1F) == 0);
+    ASSERT_TRUE(get_surface_lod(SURFACE_LOD_DISTANCE) == 1);
+    ASSERT_TRUE(get_surface_lod(SURFACE_LOD_DISTANCE * 2.0F) == 2);
+    ASSERT_TRUE(get_surface_lod(1.0e6F) == SURFACE_LOD_MAX);
+
+    // Edge vertices between the corners of a coarser cell are interpolated.
+    Surface surface(8, 8, 3);
+    surface.set_vertex(0, 0, 1.0F);
+    surface.set_vertex(4, 0, 3.0F);
+    surface.set_vertex(8, 0, 5.0F);
+    surface.set_vertex(0, 4, 2.0F);
+    const Surface::Chunk &chunk = surface.get_chunk(0);
+    const SurfaceChunkEdges north_coarse{4, 1, 1, 1};
+    ASSERT_FLOAT_EQUALS(
+        get_stitched_chunk_height(chunk, 1, 0, north_coarse), 1.5F);
+    ASSERT_FLOAT_EQUALS(
+        get_stitched_chunk_height(chunk, 4, 0, north_coarse), 3.0F);
+    ASSERT_FLOAT_EQUALS(
+        get_stitched_chunk_height(chunk, 6, 0, north_coarse), 4.0F);
+    const SurfaceChunkEdges west_coarse{1, 1, 4, 1};
+    ASSERT_FLOAT_EQUALS(get_stitched_chunk_height(chunk, 0, 2, west_coarse),
+                        1.5F);
+    // Vertices off the stitched edges are unchanged.
+    ASSERT_FLOAT_EQUALS(get_stitched_chunk_height(chunk, 1, 0, west_coarse),
+                        surface.get_vertex(1, 0));
+
+    // Height texels span the chunk's range, quantized chunks are uploaded as
+    // they are.
+    std::vector<std::uint16_t> texels;
+    const SurfaceRect corner{0, 0, 1, 1};
+    get_surface_height_texels(chunk, corner, texels);
+    ASSERT_TRUE(texels.size() == 4);
+    const float y_step = (chunk.max_y - chunk.min_y) / 65535.0F;
+    ASSERT_TRUE(std::abs(chunk.min_y + (float)texels[0] * y_step - 1.0F) <=
+                y_step);
+    ASSERT_TRUE(std::abs(chunk.min_y + (float)texels[1] * y_step -
+                         surface.get_vertex(1, 0)) <= y_step);
+    Surface quantized(8, 8, 3, SURFACE_DEFAULT_MEMORY_BUDGET,
+                      SurfaceHeightFormat::UNORM16);
+    const Surface::Chunk &quantized_chunk = quantized.get_chunk(0);
+    get_surface_height_texels(quantized_chunk, SurfaceRect{1, 2, 3, 2},
+                              texels);
+    ASSERT_TRUE(texels.size() == 3 &&
+                texels[2] == quantized_chunk.quantized_vertices[3 + 2 * 9]);
+  }
+
+  std::cout << "Testing surface_reset...\n";
+  {
+    // Preparing in slices gives the same result as all at once.
+    Surface current(130, 70, 3);
+    const std::vector<Vector3> focus_points{Vector3{0.0F, 0.0F, 0.0F}};
+    current.update_residency(focus_points, 10.0F);
+    ASSERT_TRUE(current.get_resident_chunk_count() == 2);
+    SurfaceReset at_once(current, std::make_unique<Surface>(130, 70, 4),
+                         focus_points, 10.0F, 9, 1, true);
+    at_once.run();
+    SurfaceReset sliced(current, std::make_unique<Surface>(130, 70, 4),
+                        focus_points, 10.0F, 9, 1, true);
+    unsigned int step_count = 1;
+    while (!sliced.step(0.0)) {
+      ++step_count;
+    }
+    ASSERT_TRUE(step_count > 2);
+
+    SurfaceTriangleBatch triangles = at_once.take_triangles();
+    const SurfaceTriangleBatch sliced_triangles = sliced.take_triangles();
+    ASSERT_TRUE(triangles.size() == 64 * 64 * 2 * 2);
+    ASSERT_TRUE(triangles.pos_x == sliced_triangles.pos_x &&
+                triangles.y[2] == sliced_triangles.y[2] &&
+                triangles.axis_z == sliced_triangles.axis_z);
+    ASSERT_TRUE(triangles.y[2][1] == current[0].se);
+
+    // Colors and mesh arrays are prepared with the triangles.
+    const std::vector<Color> &colors = at_once.get_colors();
+    ASSERT_TRUE(colors.size() == triangles.size());
+    const Color unit_color = get_surface_unit_color(current, 0, 0);
+    ASSERT_TRUE(colors[0].r == unit_color.r && colors[1].g == unit_color.g);
+    ASSERT_TRUE(colors[2].r == RAYWHITE.r && colors[3].b == RAYWHITE.b);
+    Mesh mesh = at_once.take_mesh();
+    Mesh sliced_mesh = sliced.take_mesh();
+    ASSERT_TRUE(mesh.vertexCount == (int)triangles.size() * 3 &&
+                mesh.tangents != nullptr);
+    const std::size_t last = (std::size_t)mesh.vertexCount - 1;
+    ASSERT_TRUE(mesh.vertices[last * 3 + 1] == triangles.y[2].back() &&
+                mesh.tangents[last * 4 + 3] == triangles.pos_y.back() &&
+                mesh.colors[last * 4 + 3] == 255);
+    ASSERT_TRUE(std::equal(mesh.normals, mesh.normals + last * 3 + 3,
+                           sliced_mesh.normals) &&
+                std::equal(mesh.colors, mesh.colors + last * 4 + 4,
+                           sliced_mesh.colors));
+    free_surface_shatter_mesh(mesh);
+    free_surface_shatter_mesh(sliced_mesh);
+
+    // A batch handed to the next reset is refilled without allocating.
+    const float *pos_x_data = triangles.pos_x.data();
+    SurfaceReset reused(current, std::make_unique<Surface>(130, 70, 4),
+                        focus_points, 10.0F, 9, 1, false,
+                        std::move(triangles));
+    reused.run();
+    const SurfaceTriangleBatch reused_triangles = reused.take_triangles();
+    // Without the shader only the vertices at time 0 and colors are needed,
+    // the mesh left with the reset is freed by it.
+    std::vector<float> vertices(reused_triangles.size() * 9);
+    get_surface_triangle_vertices(reused_triangles, 0.0F, vertices.data());
+    Mesh reused_mesh = reused.take_mesh();
+    ASSERT_TRUE(reused_mesh.tangents == nullptr &&
+                std::equal(vertices.begin(), vertices.end(),
+                           reused_mesh.vertices));
+    free_surface_shatter_mesh(reused_mesh);
+    ASSERT_TRUE(reused_triangles.pos_x.data() == pos_x_data);
+    ASSERT_TRUE(reused_triangles.axis_z == sliced_triangles.axis_z);
+    ASSERT_TRUE(at_once.take_surface()->get_resident_chunk_count() == 2);
+    ASSERT_TRUE(sliced.take_surface()->get_resident_chunk_count() == 2);
+  }
+
+  std::cout << "Testing surface_triangle...\n";
+  {
+    const SurfaceTriangle tri(
+        Vector3{0.5F, 1.0F, -0.5F}, Vector3{-0.5F, 2.0F, -0.5F},
+        Vector3{-0.5F, 3.0F, 0.5F}, Vector3{4.0F, 0.5F, -2.0F},
+        Vector3{1.0F, 2.0F, -1.0F}, Vector3{-1.0F, 1.0F, 0.5F});
+    for (std::size_t idx = 0; idx < 3; ++idx) {
+      const Vector3 start = tri.get_vertex(idx, 0.0F);
+      ASSERT_FLOAT_EQUALS(start.x, tri.triangle_coords[idx].x + 4.0F);
+      ASSERT_FLOAT_EQUALS(start.y, tri.triangle_coords[idx].y + 0.5F);
+      ASSERT_FLOAT_EQUALS(start.z, tri.triangle_coords[idx].z - 2.0F);
+    }
+
+    // Same as rotating with MatrixRotate() and then translating.
+    for (float time : {0.5F, 2.0F, 3.5F}) {
+      const float move = time * SURFACE_TRIANGLE_MOVE_RATE;
+      const Matrix mat =
+          MatrixRotate(tri.rotate_axis,
+                       time * SURFACE_TRIANGLE_ROTATION_RATE) *
+          MatrixTranslate(tri.triangle_pos.x + tri.pos_move_dir.x * move,
+                          tri.triangle_pos.y + tri.pos_move_dir.y * move,
+                          tri.triangle_pos.z + tri.pos_move_dir.z * move);
+      for (std::size_t idx = 0; idx < 3; ++idx) {
+        const Vector3 expected =
+            Vector3Transform(tri.triangle_coords[idx], mat);
+        const Vector3 vertex = tri.get_vertex(idx, time);
+        ASSERT_TRUE(Vector3Distance(expected, vertex) < 0.0001F);
+      }
+    }
+
+    // Every kernel moves a batch the same as get_vertex(), 21 triangles so
+    // that every kernel has a scalar tail.
+    SurfaceTriangleBatch batch;
+    std::minstd_rand engine(5);
+    for (unsigned int idx = 0; idx < 21; idx += 2) {
+      append_unit_triangles(
+          batch,
+          SurfaceUnit{.nw = 0.1F * idx, .ne = 1.0F, .sw = -0.5F, .se = 0.3F},
+          (float)idx, -(float)idx, engine);
+    }
+    batch.clear();
+    ASSERT_TRUE(batch.size() == 0);
+    for (unsigned int idx = 0; idx < 21; ++idx) {
+      append_unit_triangles(
+          batch,
+          SurfaceUnit{.nw = 0.1F * idx, .ne = 1.0F, .sw = -0.5F, .se = 0.3F},
+          (float)idx, -(float)idx, engine);
+    }
+    ASSERT_TRUE(batch.size() == 42);
+    const SurfaceTriangle second = batch.get(1);
+    ASSERT_TRUE(second.triangle_coords[2].y == 0.3F &&
+                second.triangle_pos.x == 0.0F);
+
+    std::vector<float> expected(batch.size() * 9);
+    get_surface_triangle_vertices(SurfaceTriangleKernel::SCALAR, batch, 2.5F,
+                                  expected.data());
+    bool is_near = true;
+    for (std::size_t idx = 0; idx < batch.size(); ++idx) {
+      const SurfaceTriangle tri = batch.get(idx);
+      for (std::size_t k = 0; k < 3; ++k) {
+        const Vector3 vertex = tri.get_vertex(k, 2.5F);
+        const float *out = &expected[idx * 9 + k * 3];
+        is_near = is_near &&
+                  Vector3Distance(vertex, Vector3{out[0], out[1], out[2]}) <
+                      0.0001F;
+      }
+    }
+    ASSERT_TRUE(is_near);
+    for (SurfaceTriangleKernel kernel :
+         {SurfaceTriangleKernel::SSE, SurfaceTriangleKernel::AVX}) {
+      if (!is_surface_triangle_kernel_supported(kernel)) {
+        continue;
+      }
+      std::vector<float> vertices(batch.size() * 9);
+      get_surface_triangle_vertices(kernel, batch, 2.5F, vertices.data());
+      ASSERT_TRUE(vertices == expected);
+    }
+  }
+
+  std::cout << "Testing walker...\n";
+  {
+    // Walkers follow the same trajectories on one thread and on many.
+    Surface surface(96, 96, 3);
+    surface.update_residency({Vector3{0.0F, 0.0F, 0.0F}}, 96.0F);
+    const auto make_walkers_fn = []() {
+      std::vector<Walker> walkers;
+      for (unsigned int idx = 0; idx < 37; ++idx) {
+        walkers.emplace_back((float)(idx % 6) * 12.0F - 30.0F,
+                             (float)(idx / 6) * 12.0F - 30.0F, true, 9 + idx);
+      }
+      return walkers;
+    };
+    std::vector<Walker> serial = make_walkers_fn();
+    std::vector<Walker> threaded = make_walkers_fn();
+    FlowFieldCache serial_fields;
+    FlowFieldCache threaded_fields;
+    const auto update_fn = [&surface](std::vector<Walker> &walkers,
+                                      FlowFieldCache &flow_fields,
+                                      unsigned int thread_count) {
+      for (Walker &walker : walkers) {
+        walker.update_roaming(0.1F, surface, flow_fields);
+      }
+      parallel_for(walkers.size(), thread_count,
+                   [&](std::size_t begin, std::size_t end) {
+                     for (std::size_t idx = begin; idx < end; ++idx) {
+                       walkers[idx].update(0.1F, surface);
+                     }
+                   });
+    };
+    for (unsigned int step = 0; step < 300; ++step) {
+      update_fn(serial, serial_fields, 1);
+      update_fn(threaded, threaded_fields, 16);
+    }
+    bool is_same = true;
+    bool has_moved = false;
+    for (std::size_t idx = 0; idx < serial.size(); ++idx) {
+      const Vector3 a = serial[idx].get_body_pos();
+      const Vector3 b = threaded[idx].get_body_pos();
+      is_same = is_same && a.x == b.x && a.y == b.y && a.z == b.z &&
+                serial[idx].get_rotation() == threaded[idx].get_rotation();
+      has_moved = has_moved || a.x != (float)(idx % 6) * 12.0F - 30.0F;
+    }
+    ASSERT_TRUE(is_same);
+    ASSERT_TRUE(has_moved);
+  }
+  {
+    // Parts are the body raised by its idle move and the legs, each moved by
+    // the model transform and then rotated with the walker.
+    const Walker walker(3.0F, -2.0F, false, 1);
+    std::vector<Matrix> transforms;
+    walker.append_part_transforms(MatrixTranslate(0.0F, 0.5F, 0.0F),
+                                  transforms);
+    ASSERT_TRUE(transforms.size() == 5);
+    ASSERT_FLOAT_EQUALS(transforms[0].m12, 3.0F);
+    ASSERT_FLOAT_EQUALS(transforms[0].m13, 2.5F);
+    ASSERT_FLOAT_EQUALS(transforms[0].m14, -2.0F);
+    // nw leg.
+    ASSERT_TRUE(transforms[1].m12 < 3.0F && transforms[1].m14 < -2.0F);
+    ASSERT_FLOAT_EQUALS(transforms[1].m13, 0.5F);
+    ASSERT_FLOAT_EQUALS(transforms[4].m0, 1.0F);
+  }
+  {
+    // Reduced walkers are updated with the time since their last update and
+    // drawn moving from where they were drawn before it.
+    Surface surface(64, 64, 5);
+    surface.update_residency({Vector3{0.0F, 0.0F, 0.0F}}, 64.0F);
+    Walker every_frame(0.0F, 0.0F, false, 2);
+    Walker reduced(0.0F, 0.0F, false, 2);
+    for (Walker *walker : {&every_frame, &reduced}) {
+      walker->update(0.0F, surface);
+      walker->set_body_pos(Vector3{0.0F, 0.0F, 10.0F});
+    }
+    ASSERT_FALSE(reduced.is_idle());
+    ASSERT_TRUE(reduced.get_lod(true, 10.0F) == WalkerLod::FULL);
+    ASSERT_TRUE(reduced.get_lod(true, 100.0F) == WalkerLod::REDUCED);
+    ASSERT_TRUE(reduced.get_lod(false, 10.0F) == WalkerLod::MINIMAL);
+    std::vector<Matrix> before;
+    reduced.append_part_transforms(get_identity_matrix(), before);
+
+    const float step = WALKER_LOD_REDUCED_INTERVAL / 2.0F;
+    reduced.update_lod(step, surface, WalkerLod::REDUCED);
+    std::vector<Matrix> transforms;
+    reduced.append_part_transforms(get_identity_matrix(), transforms);
+    ASSERT_TRUE(transforms[0].m12 == before[0].m12);
+    reduced.update_lod(step, surface, WalkerLod::REDUCED);
+    every_frame.update(step * 2.0F, surface);
+    ASSERT_FLOAT_EQUALS(reduced.get_rotation(), every_frame.get_rotation());
+    ASSERT_FALSE(reduced.get_rotation() == 0.0F);
+    // Drawn where it was before the update, until the next interval passes.
+    transforms.clear();
+    reduced.append_part_transforms(get_identity_matrix(), transforms);
+    ASSERT_FLOAT_EQUALS(transforms[0].m12, before[0].m12);
+
+    // Asleep walkers aren't updated at all.
+    Walker idle(0.0F, 0.0F, false, 3);
+    idle.update(0.0F, surface);
+    ASSERT_TRUE(idle.is_idle());
+    ASSERT_TRUE(idle.get_lod(false, 10.0F) == WalkerLod::ASLEEP);
+    ASSERT_TRUE(idle.get_lod(true, 10.0F) == WalkerLod::FULL);
+  }
+
   std::cout << "Finished tests.\n";
   return 0;
 }
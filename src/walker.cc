@@ -1,7 +1,9 @@
 #include "walker.h"
 
 // standard library includes
+#include <algorithm>
 #include <cmath>
+#include <optional>
 
 // third party includes
 #include <raylib.h>
@@ -9,11 +11,11 @@
 
 // local includes
 #include "3d_helpers.h"
-#include "ems.h"
 
-Walker::Walker(float x, float z, bool auto_roaming, float body_height,
-               float body_feet_radius, float feet_radius)
-    : body_pos{x, body_height, z},
+Walker::Walker(float x, float z, bool auto_roaming, unsigned int seed,
+               float body_height, float body_feet_radius, float feet_radius)
+    : random_engine(),
+      body_pos{x, body_height, z},
       target_body_pos{x, body_height, z},
       leg_nw(),
       leg_ne(),
@@ -36,10 +38,19 @@ Walker::Walker(float x, float z, bool auto_roaming, float body_height,
       target_rotation(0.0F),
       body_idle_move_timer(0.0F),
       roaming_time(5.0F),
-      roaming_timer(0.0F) {
+      roaming_timer(0.0F),
+      roaming_goal(0),
+      flow_field(),
+      flow_field_generation(0),
+      lod_pose(),
+      lod_timer(0.0F),
+      lod_interval(0.0F) {
+  // Spreads nearby seeds, consecutive seeds would give similar streams.
+  std::seed_seq seed_seq{seed};
+  random_engine.seed(seed_seq);
+
   flags |= auto_roaming ? 4 : 0;
-  roaming_time =
-      call_js_get_random() * ROAMING_WAIT_VARIANCE + ROAMING_WAIT_AMOUNT;
+  roaming_time = get_random() * ROAMING_WAIT_VARIANCE + ROAMING_WAIT_AMOUNT;
 
   const Vector3 nw = Vector3Normalize(Vector3{-1.0F, 0.0F, -1.0F});
   const Vector3 ne = Vector3Normalize(Vector3{1.0F, 0.0F, -1.0F});
@@ -50,89 +61,366 @@ Walker::Walker(float x, float z, bool auto_roaming, float body_height,
 
   leg_nw =
       offset +
-      Vector3{(call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
-              (call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
+      Vector3{(get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
+              (get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
       Vector3Scale(nw, body_feet_radius);
   target_leg_nw = leg_nw;
   leg_ne =
       offset +
-      Vector3{(call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
-              (call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
+      Vector3{(get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
+              (get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
       Vector3Scale(ne, body_feet_radius);
   target_leg_ne = leg_ne;
   leg_sw =
       offset +
-      Vector3{(call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
-              (call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
+      Vector3{(get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
+              (get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
       Vector3Scale(sw, body_feet_radius);
   target_leg_sw = leg_sw;
   leg_se =
       offset +
-      Vector3{(call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
-              (call_js_get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
+      Vector3{(get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV, 0.0F,
+              (get_random() - 0.5F) / FEET_INIT_POS_VARIANCE_DIV} +
       Vector3Scale(se, body_feet_radius);
   target_leg_se = leg_se;
+  lod_pose = get_pose();
 }
 
-void Walker::draw(const Model &model) {
+void Walker::update_roaming(float dt, const Surface &surface,
+                            FlowFieldCache &flow_fields) {
+  if ((flags & 8) != 0 || (flags & 4) == 0 || (flags & 3) != 0) {
+    return;
+  }
+  // Arrived at the last unit it headed to.
+  if (flow_field) {
+    if (follow_flow_field(surface, flow_fields)) {
+      return;
+    }
+    flow_field.reset();
+  }
+
+  roaming_timer += dt;
+  if (roaming_timer > roaming_time) {
+    roaming_timer = 0.0F;
+    roaming_time = get_random() * ROAMING_WAIT_VARIANCE + ROAMING_WAIT_AMOUNT;
+    // Goals are near enough for the field of their region to cover the walker.
+    const std::optional<std::size_t> unit =
+        surface.get_unit_idx(body_pos.x, body_pos.z);
+    if (!unit.has_value()) {
+      return;
+    }
+    const unsigned int width = surface.get_width();
+    const auto pick_fn = [this](unsigned int from, unsigned int size) {
+      const float offset = (get_random() * 2.0F - 1.0F) * ROAMING_GOAL_RANGE;
+      return (std::size_t)std::clamp((long long)from + (long long)offset, 0LL,
+                                     (long long)size - 1);
+    };
+    // Drawn one at a time, arguments are evaluated in any order.
+    const std::size_t goal_x = pick_fn(unit.value() % width, width);
+    const std::size_t goal_y =
+        pick_fn(unit.value() / width, surface.get_height());
+    roaming_goal = goal_x + goal_y * width;
+    flow_field = flow_fields.get(
+        surface, get_flow_field_region(surface.get_width(), roaming_goal));
+    flow_field_generation = flow_fields.get_generation();
+    if (!follow_flow_field(surface, flow_fields)) {
+      flow_field.reset();
+    }
+  }
+}
+
+void Walker::update(float dt, const Surface &surface) {
+  const unsigned int width = surface.get_width();
+
+  // Sets ground_y to the surface's height under pos, false if off the surface
+  // or if its chunk isn't resident.
+  const auto ground_hit_fn = [&surface](Vector3 pos, float &ground_y) -> bool {
+    if (const std::optional<float> y =
+            surface.resident_height_at(pos.x, pos.z);
+        y.has_value()) {
+      ground_y = y.value();
+      return true;
+    }
+    return false;
+  };
+
+  const auto initialized_setup_fn = [&ground_hit_fn](Vector3 &leg,
+                                                      Vector3 &leg_target) {
+    ground_hit_fn(leg, leg_target.y);
+  };
+
+  if ((nw_flags & 7) == 0) {
+    initialized_setup_fn(leg_nw, target_leg_nw);
+    nw_flags |= 1;
+  }
+  if ((ne_flags & 7) == 0) {
+    initialized_setup_fn(leg_ne, target_leg_ne);
+    ne_flags |= 1;
+  }
+  if ((sw_flags & 7) == 0) {
+    initialized_setup_fn(leg_sw, target_leg_sw);
+    sw_flags |= 1;
+  }
+  if ((se_flags & 7) == 0) {
+    initialized_setup_fn(leg_se, target_leg_se);
+    se_flags |= 1;
+  }
+
+  // body rotation
+  if ((flags & 8) == 0) {
+    if ((flags & 3) == 1) {
+      float diff = target_rotation - rotation;
+      if (diff > PI) {
+        rotation -= dt * BODY_ROTATION_SPEED;
+        if (rotation < 0.0F) {
+          rotation += PI * 2.0F;
+        }
+      } else if (diff < -PI) {
+        rotation += dt * BODY_ROTATION_SPEED;
+        if (rotation > PI * 2.0F) {
+          rotation -= PI * 2.0F;
+        }
+      } else if (diff > 0.0F) {
+        rotation += dt * BODY_ROTATION_SPEED;
+        if (rotation > PI * 2.0F) {
+          rotation -= PI * 2.0F;
+        }
+      } else {
+        rotation -= dt * BODY_ROTATION_SPEED;
+        if (rotation < 0.0F) {
+          rotation += PI * 2.0F;
+        }
+      }
+
+      if (std::abs(target_rotation - rotation) < dt * BODY_ROTATION_SPEED) {
+        rotation = target_rotation;
+        flags &= ~3;
+        flags |= 2;
+      }
+    }
+  } else {
+    if ((flags & 0x30) == 0x10) {
+      rotation += dt * BODY_ROTATION_SPEED;
+    } else if ((flags & 0x30) == 0x20) {
+      rotation -= dt * BODY_ROTATION_SPEED;
+    }
+  }
+
   const Matrix rotationMatrix = get_rotation_matrix_about_y(rotation);
-  // draw body
-  DrawModel(Model{.transform = model.transform * rotationMatrix,
-                  .meshCount = model.meshCount,
-                  .materialCount = model.materialCount,
-                  .meshes = model.meshes,
-                  .materials = model.materials,
-                  .meshMaterial = model.meshMaterial,
-                  .boneCount = model.boneCount,
-                  .bones = model.bones,
-                  .bindPose = model.bindPose},
-            Vector3{body_pos.x,
-                    body_pos.y + BODY_IDLE_MOVE_AMOUNT *
-                                     std::sin(body_idle_move_timer + PI),
-                    body_pos.z},
-            1.0F, WHITE);
-
-  // draw legs
-  DrawModel(Model{.transform = model.transform * rotationMatrix,
-                  .meshCount = model.meshCount,
-                  .materialCount = model.materialCount,
-                  .meshes = model.meshes,
-                  .materials = model.materials,
-                  .meshMaterial = model.meshMaterial,
-                  .boneCount = model.boneCount,
-                  .bones = model.bones,
-                  .bindPose = model.bindPose},
-            leg_nw, 1.0F, WHITE);
-  DrawModel(Model{.transform = model.transform * rotationMatrix,
-                  .meshCount = model.meshCount,
-                  .materialCount = model.materialCount,
-                  .meshes = model.meshes,
-                  .materials = model.materials,
-                  .meshMaterial = model.meshMaterial,
-                  .boneCount = model.boneCount,
-                  .bones = model.bones,
-                  .bindPose = model.bindPose},
-            leg_ne, 1.0F, WHITE);
-  DrawModel(Model{.transform = model.transform * rotationMatrix,
-                  .meshCount = model.meshCount,
-                  .materialCount = model.materialCount,
-                  .meshes = model.meshes,
-                  .materials = model.materials,
-                  .meshMaterial = model.meshMaterial,
-                  .boneCount = model.boneCount,
-                  .bones = model.bones,
-                  .bindPose = model.bindPose},
-            leg_sw, 1.0F, WHITE);
-  DrawModel(Model{.transform = model.transform * rotationMatrix,
-                  .meshCount = model.meshCount,
-                  .materialCount = model.materialCount,
-                  .meshes = model.meshes,
-                  .materials = model.materials,
-                  .meshMaterial = model.meshMaterial,
-                  .boneCount = model.boneCount,
-                  .bones = model.bones,
-                  .bindPose = model.bindPose},
-            leg_se, 1.0F, WHITE);
+
+  // body to target pos
+  if ((flags & 8) == 0) {
+    if ((flags & 3) == 2) {
+      float diff = Vector3Distance(target_body_pos, body_pos);
+      body_pos = body_pos + Vector3Normalize(target_body_pos - body_pos) *
+                                (dt * BODY_TARGET_SPEED);
+      if (Vector3Distance(target_body_pos, body_pos) > diff) {
+        flags &= ~3;
+        body_pos = target_body_pos;
+      }
+    }
+  } else if ((flags & 0x30) == 0x30) {
+    Vector3 dir = rotationMatrix * Vector3{1.0F, 0.0F, 0.0F};
+    Vector3 prev_body_pos = body_pos;
+    body_pos = body_pos + dir * (dt * BODY_TARGET_SPEED);
+    if (body_pos.x < surface.get_x_offset() - (float)width + 0.5F ||
+        body_pos.x > surface.get_x_offset() + 0.5F ||
+        body_pos.z <
+            surface.get_y_offset() - (float)surface.get_height() + 0.5F ||
+        body_pos.z > surface.get_y_offset() + 0.5F) {
+      body_pos = prev_body_pos;
+    }
+    target_body_pos = body_pos + dir * 1.0F;
+
+    // Ensure body is at proper height above surface.
+    float target_height = body_pos.y;
+    if (float ground_y; ground_hit_fn(body_pos, ground_y)) {
+      target_height = ground_y + body_height;
+    }
+    body_pos.y += (target_height - body_pos.y) * (dt * BODY_TARGET_SPEED);
+  }
+
+  // moving legs
+  const auto update_leg_fn = [this, &ground_hit_fn, dt, &rotationMatrix](
+                                 Vector3 &leg_target, Vector3 &leg_pos,
+                                 unsigned int &flags,
+                                 unsigned int grounded_count) {
+    if ((flags & 7) == 1 && grounded_count > 1) {
+      // Grounded.
+      bool should_lift = false;
+      Vector3 body_pos_same_y = this->body_pos;
+      body_pos_same_y.y = leg_target.y;
+      Vector3 ideal_foot_pos;
+      if ((flags & 0x18) == 0) {
+        // Is nw.
+        ideal_foot_pos =
+            rotationMatrix * Vector3Normalize(Vector3{-1.0F, 0.0F, -1.0F});
+      } else if ((flags & 0x18) == 0x8) {
+        // Is ne.
+        ideal_foot_pos =
+            rotationMatrix * Vector3Normalize(Vector3{1.0F, 0.0F, -1.0F});
+      } else if ((flags & 0x18) == 0x10) {
+        // Is sw.
+        ideal_foot_pos =
+            rotationMatrix * Vector3Normalize(Vector3{-1.0F, 0.0F, 1.0F});
+      } else if ((flags & 0x18) == 0x18) {
+        // Is se.
+        ideal_foot_pos =
+            rotationMatrix * Vector3Normalize(Vector3{1.0F, 0.0F, 1.0F});
+      }
+      ideal_foot_pos =
+          body_pos_same_y + (ideal_foot_pos * this->body_feet_radius);
+      // Check if body is past threshold.
+      if (Vector3Distance(ideal_foot_pos, leg_target) >
+          FEET_RADIUS_PLACEMENT_CHECK_SCALE * this->feet_radius) {
+        should_lift = true;
+        Vector3 diff = this->target_body_pos - this->body_pos;
+        if (Vector3Length(diff) > 0.1F) {
+          Vector3 dir = Vector3Normalize(diff);
+          leg_target =
+              ideal_foot_pos +
+              (dir * (this->feet_radius * FEET_RADIUS_PLACEMENT_SCALE));
+        } else {
+          Vector3 dir = Vector3Normalize(ideal_foot_pos - leg_target);
+          leg_target =
+              ideal_foot_pos +
+              (dir * (this->feet_radius * FEET_RADIUS_PLACEMENT_SCALE));
+        }
+        // Place the foot on the ground's triangle at the target position.
+        ground_hit_fn(leg_target, leg_target.y);
+      }
+      if (should_lift) {
+        this->lift_start_y = leg_pos.y;
+        flags = (flags & ~7) | 2;
+      }
+    }
+    if ((flags & 7) == 2) {
+      // Lifting.
+      leg_pos.y += dt * FEET_LIFT_SPEED;
+      if (leg_pos.y > this->lift_start_y + FEET_LIFT_HEIGHT) {
+        leg_pos.y = this->lift_start_y + FEET_LIFT_HEIGHT;
+        flags = (flags & ~7) | 3;
+      }
+    }
+    if ((flags & 7) == 3) {
+      // Moving horizontally.
+      float prev_dist = Vector3Distance(
+          leg_pos, Vector3{leg_target.x, leg_pos.y, leg_target.z});
+      Vector3 dir = Vector3Normalize(
+          Vector3{leg_target.x, leg_pos.y, leg_target.z} - leg_pos);
+      leg_pos = leg_pos + (dir * (dt * FEET_HORIZ_MOVE_SPEED));
+      if (Vector3Distance(leg_pos, Vector3{leg_target.x, leg_pos.y,
+                                           leg_target.z}) >= prev_dist) {
+        leg_pos.x = leg_target.x;
+        leg_pos.z = leg_target.z;
+        flags = (flags & ~7) | 4;
+      }
+    }
+    if ((flags & 7) == 4) {
+      // Lowering leg.
+      leg_pos.y -= dt * FEET_LIFT_SPEED;
+      if (leg_pos.y < leg_target.y) {
+        leg_pos.y = leg_target.y;
+        flags = (flags & ~7) | 1;
+      }
+    }
+  };
+
+  update_leg_fn(target_leg_nw, leg_nw, nw_flags,
+                ((ne_flags & 7) == 1 ? 1 : 0) + ((sw_flags & 7) == 1 ? 1 : 0) +
+                    ((se_flags & 7) == 1 ? 1 : 0));
+  update_leg_fn(target_leg_se, leg_se, se_flags,
+                ((nw_flags & 7) == 1 ? 1 : 0) + ((ne_flags & 7) == 1 ? 1 : 0) +
+                    ((sw_flags & 7) == 1 ? 1 : 0));
+  update_leg_fn(target_leg_ne, leg_ne, ne_flags,
+                ((nw_flags & 7) == 1 ? 1 : 0) + ((sw_flags & 7) == 1 ? 1 : 0) +
+                    ((se_flags & 7) == 1 ? 1 : 0));
+  update_leg_fn(target_leg_sw, leg_sw, sw_flags,
+                ((nw_flags & 7) == 1 ? 1 : 0) + ((ne_flags & 7) == 1 ? 1 : 0) +
+                    ((se_flags & 7) == 1 ? 1 : 0));
+
+  if ((flags & 8) == 0) {
+    if ((flags & 3) == 0) {
+      body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
+      if (body_idle_move_timer > PI * 2.0F) {
+        body_idle_move_timer -= PI * 2.0F;
+      }
+    } else if (!FloatEquals(body_idle_move_timer, 0.0F)) {
+      if (body_idle_move_timer < PI) {
+        body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
+        if (body_idle_move_timer > PI) {
+          body_idle_move_timer = 0;
+        }
+      } else {
+        body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
+        if (body_idle_move_timer > PI * 2.0F) {
+          body_idle_move_timer = 0.0F;
+        }
+      }
+    }
+  } else if (!FloatEquals(body_idle_move_timer, 0.0F)) {
+    if (body_idle_move_timer < PI) {
+      body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
+      if (body_idle_move_timer > PI) {
+        body_idle_move_timer = 0;
+      }
+    } else {
+      body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
+      if (body_idle_move_timer > PI * 2.0F) {
+        body_idle_move_timer = 0.0F;
+      }
+    }
+  }
+}
+
+WalkerLod Walker::get_lod(bool is_visible, float camera_distance) const {
+  if ((flags & 8) != 0) {
+    return WalkerLod::FULL;
+  }
+  if (is_visible) {
+    return camera_distance <= WALKER_LOD_NEAR_DISTANCE ? WalkerLod::FULL
+                                                       : WalkerLod::REDUCED;
+  }
+  return is_idle() ? WalkerLod::ASLEEP : WalkerLod::MINIMAL;
+}
+
+void Walker::update_lod(float dt, const Surface &surface, WalkerLod lod) {
+  if (lod == WalkerLod::ASLEEP) {
+    return;
+  }
+  float interval = 0.0F;
+  if (lod == WalkerLod::REDUCED) {
+    interval = WALKER_LOD_REDUCED_INTERVAL;
+  } else if (lod == WalkerLod::MINIMAL) {
+    interval = WALKER_LOD_MINIMAL_INTERVAL;
+  }
+  lod_timer += dt;
+  if (lod_timer < interval) {
+    return;
+  }
+  // Continues from where the walker is drawn, so it doesn't jump when its
+  // LOD changes.
+  lod_pose = get_drawn_pose();
+  update(lod_timer, surface);
+  lod_timer = 0.0F;
+  lod_interval = interval;
+}
+
+void Walker::append_part_transforms(const Matrix &model_transform,
+                                    std::vector<Matrix> &transforms) const {
+  const Pose pose = get_drawn_pose();
+  // The parts only differ in their translation, which is added to the
+  // rotated model transform's translation.
+  const Matrix rotated =
+      model_transform * get_rotation_matrix_about_y(pose.rotation);
+  for (const Vector3 &pos : {pose.body, pose.legs[0], pose.legs[1],
+                             pose.legs[2], pose.legs[3]}) {
+    Matrix transform = rotated;
+    transform.m12 += pos.x * transform.m15;
+    transform.m13 += pos.y * transform.m15;
+    transform.m14 += pos.z * transform.m15;
+    transforms.push_back(transform);
+  }
 }
 
 void Walker::set_body_pos(Vector3 pos) {
@@ -161,9 +449,9 @@ void Walker::set_player_controlled(bool player_controlled) {
     flags &= ~0x3B;
     flags |= 8;
     target_body_pos = body_pos;
+    flow_field.reset();
     roaming_timer = 0.0F;
-    roaming_time =
-        call_js_get_random() * ROAMING_WAIT_VARIANCE + ROAMING_WAIT_AMOUNT;
+    roaming_time = get_random() * ROAMING_WAIT_VARIANCE + ROAMING_WAIT_AMOUNT;
   } else {
     flags &= ~0x38;
   }
@@ -205,6 +493,96 @@ BoundingBox Walker::get_body_bb() const {
                                 0.5F}};
 }
 
+BoundingBox Walker::get_draw_bb() const {
+  BoundingBox bb = get_body_bb();
+  for (const Vector3 &leg : {leg_nw, leg_ne, leg_sw, leg_se}) {
+    bb.min = Vector3Min(bb.min, leg);
+    bb.max = Vector3Max(bb.max, leg);
+  }
+  // Legs are drawn as cubes on top of their positions.
+  bb.min = bb.min - Vector3{0.5F, 0.0F, 0.5F};
+  bb.max = bb.max + Vector3{0.5F, 1.0F, 0.5F};
+  return bb;
+}
+
 float Walker::get_rotation() const { return rotation; }
 
 Vector3 Walker::get_body_pos() const { return body_pos; }
+
+bool Walker::is_idle() const {
+  return (flags & 8) == 0 && (flags & 3) == 0 && (nw_flags & 7) == 1 &&
+         (ne_flags & 7) == 1 && (sw_flags & 7) == 1 && (se_flags & 7) == 1;
+}
+
+float Walker::get_random() {
+  // minstd_rand gives 31 bits, 24 of them fit a float exactly.
+  return (float)((random_engine() >> 7) & 0xFFFFFF) / 16777216.0F;
+}
+
+bool Walker::follow_flow_field(const Surface &surface,
+                               FlowFieldCache &flow_fields) {
+  const std::optional<std::size_t> unit =
+      surface.get_unit_idx(body_pos.x, body_pos.z);
+  if (!unit.has_value() || unit.value() == roaming_goal) {
+    return false;
+  }
+  // The surface changed since the field was integrated.
+  if (flow_field_generation != flow_fields.get_generation()) {
+    flow_field = flow_fields.get(surface, flow_field->get_region());
+    flow_field_generation = flow_fields.get_generation();
+  }
+
+  std::size_t next = roaming_goal;
+  if (!flow_field->is_goal(unit.value())) {
+    const std::optional<std::size_t> step = flow_field->get_next(unit.value());
+    if (!step.has_value()) {
+      return false;
+    }
+    // Keeps going while the field points the same way, so that the walker
+    // doesn't stop at every unit.
+    const long long delta = (long long)step.value() - (long long)unit.value();
+    next = step.value();
+    for (unsigned int count = 1; count < ROAMING_MAX_STRAIGHT_STEPS;
+         ++count) {
+      const std::optional<std::size_t> further = flow_field->get_next(next);
+      if (!further.has_value() ||
+          (long long)further.value() - (long long)next != delta) {
+        break;
+      }
+      next = further.value();
+    }
+  }
+
+  const unsigned int width = surface.get_width();
+  const float x = (float)(next % width) - surface.get_x_offset();
+  const float z = (float)(next / width) - surface.get_y_offset();
+  set_body_pos(Vector3{x, surface.height_at(x, z).value(), z});
+  return true;
+}
+
+Walker::Pose Walker::get_pose() const {
+  return Pose{
+      .body = Vector3{body_pos.x,
+                      body_pos.y + BODY_IDLE_MOVE_AMOUNT *
+                                       std::sin(body_idle_move_timer + PI),
+                      body_pos.z},
+      .legs = {leg_nw, leg_ne, leg_sw, leg_se},
+      .rotation = rotation};
+}
+
+Walker::Pose Walker::get_drawn_pose() const {
+  Pose pose = get_pose();
+  if (lod_interval <= 0.0F || lod_timer >= lod_interval) {
+    return pose;
+  }
+  const float amount = lod_timer / lod_interval;
+  pose.body = Vector3Lerp(lod_pose.body, pose.body, amount);
+  for (std::size_t idx = 0; idx < pose.legs.size(); ++idx) {
+    pose.legs[idx] = Vector3Lerp(lod_pose.legs[idx], pose.legs[idx], amount);
+  }
+  // The shorter way around.
+  pose.rotation =
+      lod_pose.rotation +
+      std::remainder(pose.rotation - lod_pose.rotation, PI * 2.0F) * amount;
+  return pose;
+}
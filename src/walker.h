@@ -3,18 +3,17 @@
 
 // standard library includes
 #include <array>
-#ifndef NDEBUG
-#include <iostream>
-#endif
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <vector>
 
 // third party includes
 #include <raylib.h>
-#include <raymath.h>
 
 // local includes
-#include "3d_helpers.h"
-#include "common_constants.h"
-#include "ems.h"
+#include "flow_field.h"
+#include "surface.h"
 
 constexpr float FEET_RADIUS_PLACEMENT_CHECK_SCALE = 1.0F;
 constexpr float FEET_RADIUS_PLACEMENT_SCALE = 0.9F;
@@ -29,17 +28,69 @@ constexpr float BODY_IDLE_TIMER_RATE = 1.0F;
 constexpr float BODY_IDLE_MOVE_AMOUNT = 0.2F;
 constexpr float ROAMING_WAIT_AMOUNT = 2.0F;
 constexpr float ROAMING_WAIT_VARIANCE = 7.0F;
+// Roaming walkers walk up to this many units at a time along their flow
+// field while it keeps pointing the same way.
+constexpr unsigned int ROAMING_MAX_STRAIGHT_STEPS = 8;
+// Roaming goals are at most this many units away along each axis, within the
+// window of the goal region's flow field.
+constexpr unsigned int ROAMING_GOAL_RANGE = 48;
+static_assert(ROAMING_GOAL_RANGE <= FLOW_FIELD_WINDOW_MARGIN);
+
+// Walkers in view within WALKER_LOD_NEAR_DISTANCE of the camera are updated
+// every frame, the others every WALKER_LOD_*_INTERVAL seconds and drawn
+// moving smoothly between updates.
+constexpr float WALKER_LOD_NEAR_DISTANCE = 48.0F;
+constexpr float WALKER_LOD_REDUCED_INTERVAL = 1.0F / 15.0F;
+constexpr float WALKER_LOD_MINIMAL_INTERVAL = 0.25F;
+
+/// How often a walker is updated.
+enum class WalkerLod {
+  /// Every frame, in view and near or player controlled.
+  FULL,
+  /// In view beyond WALKER_LOD_NEAR_DISTANCE.
+  REDUCED,
+  /// Out of view.
+  MINIMAL,
+  /// Out of view and idle, only the roaming timer runs until it wakes the
+  /// walker up.
+  ASLEEP
+};
 
+/*
+ * Each walker draws its random values from its own stream seeded by the seed
+ * it was constructed with, so its trajectory only depends on that seed and
+ * on the surface, not on the other walkers or on the thread updating it.
+ */
 class Walker {
  public:
-  Walker(float x, float z, bool auto_roaming, float body_height = 2.0F,
-         float body_feet_radius = 1.7F, float feet_radius = 1.5F);
-
-  template <std::size_t BBCount>
-  void update(float dt, const std::array<BoundingBox, BBCount> &bbs,
-              unsigned int width, unsigned int height);
-
-  void draw(const Model &model);
+  Walker(float x, float z, bool auto_roaming, unsigned int seed,
+         float body_height = 2.0F, float body_feet_radius = 1.7F,
+         float feet_radius = 1.5F);
+
+  /// Picks the next roaming goal once the roaming timer runs out and walks
+  /// to it along the flow field of its region, shared with the other walkers
+  /// through flow_fields. May integrate flow fields, which loads every chunk
+  /// of the field's window, and loads the chunks stepped onto, so it's called
+  /// on one thread for all walkers before update().
+  void update_roaming(float dt, const Surface &surface,
+                      FlowFieldCache &flow_fields);
+  /// Only reads resident chunks of the surface and only writes to this
+  /// walker, so walkers can be updated on several threads at once.
+  void update(float dt, const Surface &surface);
+  /// Decides how often the walker is updated from whether it's in view and
+  /// its distance to the camera.
+  WalkerLod get_lod(bool is_visible, float camera_distance) const;
+  /// Calls update() with the time since the last update once the LOD's
+  /// interval passed, nothing while asleep. Safe to call on several threads
+  /// like update().
+  void update_lod(float dt, const Surface &surface, WalkerLod lod);
+
+  /// Appends the transforms of the body and the four legs, in that order,
+  /// each placing model_transform's model as a part of the walker. Walkers
+  /// updated less than every frame are placed between their last two
+  /// updates.
+  void append_part_transforms(const Matrix &model_transform,
+                              std::vector<Matrix> &transforms) const;
 
   void set_body_pos(Vector3 pos);
 
@@ -55,10 +106,22 @@ class Walker {
   bool player_is_going_forward() const;
 
   BoundingBox get_body_bb() const;
+  /// Encloses the body and the legs as drawn.
+  BoundingBox get_draw_bb() const;
   float get_rotation() const;
   Vector3 get_body_pos() const;
+  /// Not moving, on all four feet and not player controlled.
+  bool is_idle() const;
 
  private:
+  struct Pose {
+    Vector3 body;
+    /// nw, ne, sw, se.
+    std::array<Vector3, 4> legs;
+    float rotation;
+  };
+
+  std::minstd_rand random_engine;
   Vector3 body_pos;
   Vector3 target_body_pos;
 
@@ -94,269 +157,25 @@ class Walker {
   float body_idle_move_timer;
   float roaming_time;
   float roaming_timer;
+  /// Unit the walker is roaming to, indexed the same as Surface::operator[].
+  std::size_t roaming_goal;
+  /// Field leading to roaming_goal's region, none if not on the way there.
+  std::shared_ptr<const FlowField> flow_field;
+  unsigned long long flow_field_generation;
+  /// Drawn pose at the last update_lod() that updated, the drawn pose moves
+  /// from it to the current pose over lod_interval.
+  Pose lod_pose;
+  float lod_timer;
+  float lod_interval;
+
+  /// Uniform in [0, 1), the same on every platform for the same seed.
+  float get_random();
+  /// Heads to the next unit along the flow field, or to roaming_goal once in
+  /// its region. False if there or if the goal can't be reached.
+  bool follow_flow_field(const Surface &surface, FlowFieldCache &flow_fields);
+  /// Current pose, with the body raised by its idle move.
+  Pose get_pose() const;
+  Pose get_drawn_pose() const;
 };
 
-template <std::size_t BBCount>
-void Walker::update(float dt, const std::array<BoundingBox, BBCount> &bbs,
-                    unsigned int width, unsigned int /*height*/) {
-  if ((flags & 8) == 0 && (flags & 4) != 0 && (flags & 3) == 0) {
-    roaming_timer += dt;
-    if (roaming_timer > roaming_time) {
-      roaming_timer = 0.0F;
-      roaming_time =
-          call_js_get_random() * ROAMING_WAIT_VARIANCE + ROAMING_WAIT_AMOUNT;
-      unsigned int idx = call_js_get_random() * (float)bbs.size();
-      float x = (float)(idx % width) - SURFACE_X_OFFSET;
-      float y = (bbs[idx].min.y + bbs[idx].max.y) / 2.0F;
-      float z = (float)(idx / width) - SURFACE_Y_OFFSET;
-
-      set_body_pos(Vector3{x, y, z});
-    }
-  }
-
-  const auto initialized_setup_fn = [&bbs](Vector3 &leg, Vector3 &leg_target) {
-    Ray downwards{.position = leg, .direction = Vector3{0.0F, -1.0F, 0.0F}};
-    for (const auto &bb : bbs) {
-      if (GetRayCollisionBox(downwards, bb).hit) {
-        leg_target.y = (bb.min.y + bb.max.y) / 2.0F;
-        break;
-      }
-    }
-  };
-
-  if ((nw_flags & 7) == 0) {
-    initialized_setup_fn(leg_nw, target_leg_nw);
-    nw_flags |= 1;
-  }
-  if ((ne_flags & 7) == 0) {
-    initialized_setup_fn(leg_ne, target_leg_ne);
-    ne_flags |= 1;
-  }
-  if ((sw_flags & 7) == 0) {
-    initialized_setup_fn(leg_sw, target_leg_sw);
-    sw_flags |= 1;
-  }
-  if ((se_flags & 7) == 0) {
-    initialized_setup_fn(leg_se, target_leg_se);
-    se_flags |= 1;
-  }
-
-  // body rotation
-  if ((flags & 8) == 0) {
-    if ((flags & 3) == 1) {
-      float diff = target_rotation - rotation;
-      if (diff > PI) {
-        rotation -= dt * BODY_ROTATION_SPEED;
-        if (rotation < 0.0F) {
-          rotation += PI * 2.0F;
-        }
-      } else if (diff < -PI) {
-        rotation += dt * BODY_ROTATION_SPEED;
-        if (rotation > PI * 2.0F) {
-          rotation -= PI * 2.0F;
-        }
-      } else if (diff > 0.0F) {
-        rotation += dt * BODY_ROTATION_SPEED;
-        if (rotation > PI * 2.0F) {
-          rotation -= PI * 2.0F;
-        }
-      } else {
-        rotation -= dt * BODY_ROTATION_SPEED;
-        if (rotation < 0.0F) {
-          rotation += PI * 2.0F;
-        }
-      }
-
-      if (std::abs(target_rotation - rotation) < dt * BODY_ROTATION_SPEED) {
-        rotation = target_rotation;
-        flags &= ~3;
-        flags |= 2;
-      }
-    }
-  } else {
-    if ((flags & 0x30) == 0x10) {
-      rotation += dt * BODY_ROTATION_SPEED;
-    } else if ((flags & 0x30) == 0x20) {
-      rotation -= dt * BODY_ROTATION_SPEED;
-    }
-  }
-
-  const Matrix rotationMatrix = get_rotation_matrix_about_y(rotation);
-
-  // body to target pos
-  if ((flags & 8) == 0) {
-    if ((flags & 3) == 2) {
-      float diff = Vector3Distance(target_body_pos, body_pos);
-      body_pos = body_pos + Vector3Normalize(target_body_pos - body_pos) *
-                                (dt * BODY_TARGET_SPEED);
-      if (Vector3Distance(target_body_pos, body_pos) > diff) {
-        flags &= ~3;
-        body_pos = target_body_pos;
-      }
-    }
-  } else if ((flags & 0x30) == 0x30) {
-    Vector3 dir = rotationMatrix * Vector3{1.0F, 0.0F, 0.0F};
-    Vector3 prev_body_pos = body_pos;
-    body_pos = body_pos + dir * (dt * BODY_TARGET_SPEED);
-    if (body_pos.x < SURFACE_X_OFFSET - (float)SURFACE_UNIT_WIDTH + 0.5F ||
-        body_pos.x > SURFACE_X_OFFSET + 0.5F ||
-        body_pos.z < SURFACE_Y_OFFSET - (float)SURFACE_UNIT_HEIGHT + 0.5F ||
-        body_pos.z > SURFACE_Y_OFFSET + 0.5F) {
-      body_pos = prev_body_pos;
-    }
-    target_body_pos = body_pos + dir * 1.0F;
-
-    // Ensure body is at proper height above surface.
-    float target_height = body_pos.y;
-    Ray downwards{.position = body_pos,
-                  .direction = Vector3{0.0F, -1.0F, 0.0F}};
-    for (auto &bb : bbs) {
-      if (GetRayCollisionBox(downwards, bb).hit) {
-        target_height = (bb.min.y + bb.max.y) / 2.0F + body_height;
-      }
-    }
-    body_pos.y += (target_height - body_pos.y) * (dt * BODY_TARGET_SPEED);
-  }
-
-  // moving legs
-  const auto update_leg_fn = [this, &bbs, dt, &rotationMatrix](
-                                 Vector3 &leg_target, Vector3 &leg_pos,
-                                 unsigned int &flags,
-                                 unsigned int grounded_count) {
-    if ((flags & 7) == 1 && grounded_count > 1) {
-      // Grounded.
-      bool should_lift = false;
-      Vector3 body_pos_same_y = this->body_pos;
-      body_pos_same_y.y = leg_target.y;
-      Vector3 ideal_foot_pos;
-      if ((flags & 0x18) == 0) {
-        // Is nw.
-        ideal_foot_pos =
-            rotationMatrix * Vector3Normalize(Vector3{-1.0F, 0.0F, -1.0F});
-      } else if ((flags & 0x18) == 0x8) {
-        // Is ne.
-        ideal_foot_pos =
-            rotationMatrix * Vector3Normalize(Vector3{1.0F, 0.0F, -1.0F});
-      } else if ((flags & 0x18) == 0x10) {
-        // Is sw.
-        ideal_foot_pos =
-            rotationMatrix * Vector3Normalize(Vector3{-1.0F, 0.0F, 1.0F});
-      } else if ((flags & 0x18) == 0x18) {
-        // Is se.
-        ideal_foot_pos =
-            rotationMatrix * Vector3Normalize(Vector3{1.0F, 0.0F, 1.0F});
-      }
-      ideal_foot_pos =
-          body_pos_same_y + (ideal_foot_pos * this->body_feet_radius);
-      // Check if body is past threshold.
-      if (Vector3Distance(ideal_foot_pos, leg_target) >
-          FEET_RADIUS_PLACEMENT_CHECK_SCALE * this->feet_radius) {
-        should_lift = true;
-        Vector3 diff = this->target_body_pos - this->body_pos;
-        if (Vector3Length(diff) > 0.1F) {
-          Vector3 dir = Vector3Normalize(diff);
-          leg_target =
-              ideal_foot_pos +
-              (dir * (this->feet_radius * FEET_RADIUS_PLACEMENT_SCALE));
-        } else {
-          Vector3 dir = Vector3Normalize(ideal_foot_pos - leg_target);
-          leg_target =
-              ideal_foot_pos +
-              (dir * (this->feet_radius * FEET_RADIUS_PLACEMENT_SCALE));
-        }
-        // Get average .y of ground at target position.
-        Ray downwards{.position = Vector3{leg_target.x, leg_target.y + 5.0F,
-                                          leg_target.z},
-                      .direction = Vector3{0.0F, -1.0F, 0.0F}};
-        for (const auto &bb : bbs) {
-          if (GetRayCollisionBox(downwards, bb).hit) {
-            leg_target.y = (bb.min.y + bb.max.y) / 2.0F;
-            break;
-          }
-        }
-      }
-      if (should_lift) {
-        this->lift_start_y = leg_pos.y;
-        flags = (flags & ~7) | 2;
-      }
-    }
-    if ((flags & 7) == 2) {
-      // Lifting.
-      leg_pos.y += dt * FEET_LIFT_SPEED;
-      if (leg_pos.y > this->lift_start_y + FEET_LIFT_HEIGHT) {
-        leg_pos.y = this->lift_start_y + FEET_LIFT_HEIGHT;
-        flags = (flags & ~7) | 3;
-      }
-    }
-    if ((flags & 7) == 3) {
-      // Moving horizontally.
-      float prev_dist = Vector3Distance(
-          leg_pos, Vector3{leg_target.x, leg_pos.y, leg_target.z});
-      Vector3 dir = Vector3Normalize(
-          Vector3{leg_target.x, leg_pos.y, leg_target.z} - leg_pos);
-      leg_pos = leg_pos + (dir * (dt * FEET_HORIZ_MOVE_SPEED));
-      if (Vector3Distance(leg_pos, Vector3{leg_target.x, leg_pos.y,
-                                           leg_target.z}) >= prev_dist) {
-        leg_pos.x = leg_target.x;
-        leg_pos.z = leg_target.z;
-        flags = (flags & ~7) | 4;
-      }
-    }
-    if ((flags & 7) == 4) {
-      // Lowering leg.
-      leg_pos.y -= dt * FEET_LIFT_SPEED;
-      if (leg_pos.y < leg_target.y) {
-        leg_pos.y = leg_target.y;
-        flags = (flags & ~7) | 1;
-      }
-    }
-  };
-
-  update_leg_fn(target_leg_nw, leg_nw, nw_flags,
-                ((ne_flags & 7) == 1 ? 1 : 0) + ((sw_flags & 7) == 1 ? 1 : 0) +
-                    ((se_flags & 7) == 1 ? 1 : 0));
-  update_leg_fn(target_leg_se, leg_se, se_flags,
-                ((nw_flags & 7) == 1 ? 1 : 0) + ((ne_flags & 7) == 1 ? 1 : 0) +
-                    ((sw_flags & 7) == 1 ? 1 : 0));
-  update_leg_fn(target_leg_ne, leg_ne, ne_flags,
-                ((nw_flags & 7) == 1 ? 1 : 0) + ((sw_flags & 7) == 1 ? 1 : 0) +
-                    ((se_flags & 7) == 1 ? 1 : 0));
-  update_leg_fn(target_leg_sw, leg_sw, sw_flags,
-                ((nw_flags & 7) == 1 ? 1 : 0) + ((ne_flags & 7) == 1 ? 1 : 0) +
-                    ((se_flags & 7) == 1 ? 1 : 0));
-
-  if ((flags & 8) == 0) {
-    if ((flags & 3) == 0) {
-      body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
-      if (body_idle_move_timer > PI * 2.0F) {
-        body_idle_move_timer -= PI * 2.0F;
-      }
-    } else if (!FloatEquals(body_idle_move_timer, 0.0F)) {
-      if (body_idle_move_timer < PI) {
-        body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
-        if (body_idle_move_timer > PI) {
-          body_idle_move_timer = 0;
-        }
-      } else {
-        body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
-        if (body_idle_move_timer > PI * 2.0F) {
-          body_idle_move_timer = 0.0F;
-        }
-      }
-    }
-  } else if (!FloatEquals(body_idle_move_timer, 0.0F)) {
-    if (body_idle_move_timer < PI) {
-      body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
-      if (body_idle_move_timer > PI) {
-        body_idle_move_timer = 0;
-      }
-    } else {
-      body_idle_move_timer += dt * BODY_IDLE_TIMER_RATE;
-      if (body_idle_move_timer > PI * 2.0F) {
-        body_idle_move_timer = 0.0F;
-      }
-    }
-  }
-}
-
 #endif
@@ -0,0 +1,90 @@
+#include "walker_renderer.h"
+
+// third party includes
+#include <rlgl.h>
+
+WalkerRenderer::WalkerRenderer()
+    : transforms(), shader(), is_shader_loaded(false) {
+  init_shader();
+}
+
+WalkerRenderer::~WalkerRenderer() {
+  if (is_shader_loaded) {
+    UnloadShader(shader);
+  }
+}
+
+void WalkerRenderer::add(const Walker &walker, const Model &model) {
+  walker.append_part_transforms(model.transform, transforms);
+}
+
+void WalkerRenderer::draw(const Model &model) {
+  if (transforms.empty()) {
+    return;
+  }
+
+  for (int mesh_idx = 0; mesh_idx < model.meshCount; ++mesh_idx) {
+    // Shares the model's maps, only the shader is swapped.
+    Material material = model.materials[model.meshMaterial[mesh_idx]];
+    if (is_shader_loaded) {
+      material.shader = shader;
+      DrawMeshInstanced(model.meshes[mesh_idx], material, transforms.data(),
+                        (int)transforms.size());
+    } else {
+      for (const Matrix &transform : transforms) {
+        DrawMesh(model.meshes[mesh_idx], material, transform);
+      }
+    }
+  }
+  transforms.clear();
+}
+
+void WalkerRenderer::clear() { transforms.clear(); }
+
+std::size_t WalkerRenderer::get_part_count() const {
+  return transforms.size();
+}
+
+bool WalkerRenderer::is_instanced() const { return is_shader_loaded; }
+
+void WalkerRenderer::init_shader() {
+  // Same as raylib's default shader, with the model matrix of each part taken
+  // from its instance.
+  shader = LoadShaderFromMemory(
+      // vertex
+      "#version 100                       \n"
+      "attribute vec3 vertexPosition;     \n"
+      "attribute vec2 vertexTexCoord;     \n"
+      "attribute vec4 vertexColor;        \n"
+      "attribute mat4 instanceTransform;  \n"
+      "varying vec2 fragTexCoord;         \n"
+      "varying vec4 fragColor;            \n"
+      "uniform mat4 mvp;                  \n"
+      "void main()                        \n"
+      "{                                  \n"
+      "    fragTexCoord = vertexTexCoord; \n"
+      "    fragColor = vertexColor;       \n"
+      "    gl_Position = mvp*instanceTransform*vec4(vertexPosition, 1.0); \n"
+      "}                                  \n",
+
+      // fragment
+      "#version 100                       \n"
+      "precision mediump float;           \n"
+      "varying vec2 fragTexCoord;         \n"
+      "varying vec4 fragColor;            \n"
+      "uniform sampler2D texture0;        \n"
+      "uniform vec4 colDiffuse;           \n"
+      "void main()                        \n"
+      "{                                  \n"
+      "    gl_FragColor = texture2D(texture0, fragTexCoord)*colDiffuse* \n"
+      "                   fragColor;      \n"
+      "}                                  \n");
+
+  // A shader that fails to compile is replaced by raylib's default one.
+  is_shader_loaded = shader.id != rlGetShaderIdDefault();
+  if (is_shader_loaded) {
+    // DrawMeshInstanced() passes the transforms to this attribute.
+    shader.locs[SHADER_LOC_MATRIX_MODEL] =
+        GetShaderLocationAttrib(shader, "instanceTransform");
+  }
+}
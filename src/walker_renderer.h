@@ -0,0 +1,56 @@
+#ifndef JUMPARTIFACT_DOT_COM_DEMO_0_WALKER_RENDERER_H_
+#define JUMPARTIFACT_DOT_COM_DEMO_0_WALKER_RENDERER_H_
+
+// standard library includes
+#include <vector>
+
+// third party includes
+#include <raylib.h>
+
+// local includes
+#include "walker.h"
+
+/*
+ * Draws the bodies and legs of all walkers of a frame together.
+ *
+ * add() collects the transforms of a walker's parts into a buffer kept across
+ * frames, and draw() draws every part with one instanced draw call per mesh
+ * of the part model, binding its material once. If the instancing shader
+ * can't be compiled the parts are drawn one DrawMesh() at a time with the
+ * model's own material instead.
+ */
+class WalkerRenderer {
+ public:
+  WalkerRenderer();
+  ~WalkerRenderer();
+
+  // No copy.
+  WalkerRenderer(const WalkerRenderer &) = delete;
+  WalkerRenderer &operator=(const WalkerRenderer &) = delete;
+
+  // No move.
+  WalkerRenderer(WalkerRenderer &&) = delete;
+  WalkerRenderer &operator=(WalkerRenderer &&) = delete;
+
+  /// Adds the walker's parts, drawn as model, to the next draw().
+  void add(const Walker &walker, const Model &model);
+  /// Assumes 3D mode is active. Draws the added parts with model and forgets
+  /// them.
+  void draw(const Model &model);
+  /// Forgets the added parts without drawing them.
+  void clear();
+
+  /// Parts added since the last draw().
+  std::size_t get_part_count() const;
+  /// False if parts are drawn one draw call at a time.
+  bool is_instanced() const;
+
+ private:
+  std::vector<Matrix> transforms;
+  Shader shader;
+  bool is_shader_loaded;
+
+  void init_shader();
+};
+
+#endif